@@ -0,0 +1,96 @@
+/*
+Counts the texels the bloom kernels read from memory on every level of the pyramid, with the texture() taps the kernels
+used to issue and with the tiles they now load into shared memory. It walks the same dispatches BloomFilter::applyFilter
+records, so it runs without a device
+
+Usage: bloom_fetch_benchmark [width height]...
+*/
+
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <vector>
+
+static constexpr int BLOOM_LEVELS = 6; //Must match BloomFilter::BLOOM_LEVELS
+static constexpr int TILE_SIZE = 16; //Must match BloomFilter::BLOOM_TILE_SIZE
+static constexpr int MAX_RADIUS = 7; //Must match BloomFilter::MAX_UPSAMPLE_RADIUS
+static constexpr int DOWNSAMPLE_SRC_TILE = TILE_SIZE * 2 + 4; //SRC_TILE_SIZE in bloom_downsample.comp
+static constexpr int UPSAMPLE_SRC_TILE = TILE_SIZE + 2 * MAX_RADIUS + 4; //SRC_TILE_SIZE in bloom_upsample.comp
+static constexpr int BILINEAR_TEXELS = 4;
+
+struct Size { int64_t width, height; };
+
+struct LevelFetches {
+    const char* pass;
+    int level;
+    Size size;
+    int64_t taps, shared; //Texels read with the texture() taps and with the shared memory tiles
+};
+
+static Size levelSize(Size base, int level) {
+    for(int i=0; i<level; ++i)
+        base = { (base.width + 1) / 2, (base.height + 1) / 2 };
+    return base;
+}
+
+static int64_t groupCount(int64_t size) {
+    return (size + TILE_SIZE - 1) / TILE_SIZE;
+}
+
+//Builds the level from the one above it, both versions dispatch once per level
+static LevelFetches downsample(Size base, int dstLevel) {
+    Size size = levelSize(base, dstLevel);
+    int64_t tiles = groupCount(size.width) * groupCount(size.height);
+
+    //Every invocation of the old kernel sampled its 13 taps, even the ones out of the level
+    return { "down", dstLevel, size, tiles * TILE_SIZE * TILE_SIZE * 13 * BILINEAR_TEXELS, tiles * DOWNSAMPLE_SRC_TILE * DOWNSAMPLE_SRC_TILE };
+}
+
+//Adds the source level to the one above, dstLevel = srcLevel - 1
+static LevelFetches upsample(Size base, int srcLevel) {
+    Size size = levelSize(base, srcLevel - 1);
+    int64_t tiles = groupCount(size.width) * groupCount(size.height);
+
+    //The old kernel returned early out of the level, the tile is loaded by the whole workgroup
+    return { "up", srcLevel, size, size.width * size.height * 9 * BILINEAR_TEXELS, tiles * UPSAMPLE_SRC_TILE * UPSAMPLE_SRC_TILE };
+}
+
+static void printResolution(Size base) {
+    std::vector<LevelFetches> levels;
+    for(int i=1; i<BLOOM_LEVELS; ++i)
+        levels.push_back(downsample(base, i));
+    for(int i=BLOOM_LEVELS-1; i>0; --i)
+        levels.push_back(upsample(base, i));
+
+    std::cout << std::format("{}x{}\n", base.width, base.height);
+    std::cout << std::format("  {:<5}{:>6}{:>12}{:>14}{:>14}{:>14}{:>14}{:>10}\n",
+        "pass", "level", "texels", "taps", "taps/texel", "shared", "shared/texel", "ratio");
+
+    int64_t totalTaps = 0, totalShared = 0;
+    for(auto& l: levels) {
+        double texels = static_cast<double>(l.size.width * l.size.height);
+        std::cout << std::format("  {:<5}{:>6}{:>12}{:>14}{:>14.2f}{:>14}{:>14.2f}{:>9.2f}x\n",
+            l.pass, l.level, l.size.width * l.size.height,
+            l.taps, l.taps / texels,
+            l.shared, l.shared / texels,
+            static_cast<double>(l.taps) / static_cast<double>(l.shared));
+        totalTaps += l.taps;
+        totalShared += l.shared;
+    }
+    std::cout << std::format("  total {} texels read with taps, {} with shared tiles, {:.2f}x fewer\n\n",
+        totalTaps, totalShared, static_cast<double>(totalTaps) / static_cast<double>(totalShared));
+}
+
+int main(int argc, char** argv) {
+    std::vector<Size> resolutions;
+    for(int i=1; i+1<argc; i+=2)
+        resolutions.push_back({ std::atoll(argv[i]), std::atoll(argv[i+1]) });
+    if(resolutions.empty())
+        resolutions = { {1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160} };
+
+    std::cout << "Texels read from memory per bloom pass, bilinear taps count their 4 texels\n\n";
+    for(auto r: resolutions)
+        printResolution(r);
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+Culls random bounding spheres with the FrustumCuller of the pipelines, turning the camera a bit every frame.
+The spheres are added once and only a few move each frame, like the meshes of a scene
+
+Usage: frustum_cull_benchmark [objects] [frames]
+*/
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "renderer/FrustumCuller.hpp"
+#include <Utils.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace fly;
+
+static constexpr double BUDGET_MS = 1.0;
+
+int main(int argc, char** argv) {
+    size_t objectCount = argc > 1? std::strtoull(argv[1], nullptr, 10) : 100000;
+    int frames = argc > 2? std::atoi(argv[2]) : 500;
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f), radius(0.5f, 4.0f);
+    auto randomSphere = [&]() { return BoundingSphere{ glm::vec3(position(rng), position(rng), position(rng)), radius(rng) }; };
+
+    FrustumCuller culler;
+    std::vector<uint32_t> slots(objectCount);
+    for(auto& slot: slots)
+        slot = culler.add(randomSphere());
+
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+    std::uniform_int_distribution<size_t> pick(0, objectCount - 1);
+    std::vector<uint8_t> visible;
+    std::vector<double> times;
+    size_t visibleCount = 0;
+
+    for(int frame=0; frame<frames; ++frame) {
+        //A hundred objects move every frame, the rest keep their slot untouched
+        for(int i=0; i<100; ++i)
+            culler.set(slots[pick(rng)], randomSphere());
+
+        float angle = static_cast<float>(frame) * 0.01f;
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(std::cos(angle), 0.0f, std::sin(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projView = proj * view;
+
+        Timer timer("cull");
+        culler.cull(projView, visible);
+        times.push_back(timer.elapsedSeconds() * 1000.0);
+
+        visibleCount = static_cast<size_t>(std::count(visible.begin(), visible.end(), 1));
+    }
+
+    //Sorted for the median, the first frames are the slow ones with cold caches
+    std::sort(times.begin(), times.end());
+    double median = times[times.size() / 2], worst = times.back(), best = times.front();
+    std::cout << std::format("{} spheres, {} frames, {} visible in the last one\n", objectCount, frames, visibleCount);
+    std::cout << std::format("cull: best {:.3f}ms, median {:.3f}ms, worst {:.3f}ms\n", best, median, worst);
+    std::cout << std::format("{:.1f} million spheres per ms, the median is {} the {:.1f}ms budget\n",
+        static_cast<double>(objectCount) / median / 1e6, median < BUDGET_MS? "under" : "over", BUDGET_MS);
+    return 0;
+}
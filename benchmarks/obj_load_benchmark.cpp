@@ -0,0 +1,154 @@
+/*
+Loads an OBJ file with loadObj and with the path loadModel used before it: tinyobjloader and an std::unordered_map to merge
+the vertices. Without a file it writes a grid of 5M triangles with normals and uvs, every vertex shared by 6 of them
+
+Usage: obj_load_benchmark [file.obj]
+*/
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+#include "default/ObjLoader.hpp"
+#include <Utils.hpp>
+
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace std {
+    template<> struct hash<fly::Vertex> {
+        size_t operator()(fly::Vertex const& vertex) const {
+            return ((hash<glm::vec3>()(vertex.pos) ^
+                    (hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^
+                    (hash<glm::vec2>()(vertex.texCoord) << 1);
+        }
+    };
+}
+
+using namespace fly;
+
+static constexpr int GRID_SIZE = 1600; //Quads per side, 2 triangles each
+
+static void writeGrid(const std::filesystem::path& path) {
+    std::ofstream file(path, std::ios::binary);
+    if(!file)
+        throw std::runtime_error("failed to create the grid file!");
+
+    std::string text;
+    text.reserve(1 << 20);
+    auto flush = [&]() {
+        file.write(text.data(), static_cast<std::streamsize>(text.size()));
+        text.clear();
+    };
+
+    //A gentle wave, so the normals differ between rows
+    for(int z=0; z<=GRID_SIZE; ++z) {
+        for(int x=0; x<=GRID_SIZE; ++x) {
+            float height = std::sin(static_cast<float>(x + z) * 0.05f);
+            text += std::format("v {} {} {}\nvt {} {}\n", x, height, z,
+                static_cast<float>(x) / GRID_SIZE, static_cast<float>(z) / GRID_SIZE);
+        }
+        text += std::format("vn {} 1 {}\n", -std::cos(static_cast<float>(z) * 0.05f), 0.0f);
+        if(text.size() > (1 << 20) - 4096)
+            flush();
+    }
+
+    auto vertex = [](int x, int z) { return z * (GRID_SIZE + 1) + x + 1; };
+    for(int z=0; z<GRID_SIZE; ++z) {
+        for(int x=0; x<GRID_SIZE; ++x) {
+            int a = vertex(x, z), b = vertex(x + 1, z), c = vertex(x + 1, z + 1), d = vertex(x, z + 1), n = z + 1;
+            text += std::format("f {}/{}/{} {}/{}/{} {}/{}/{}\nf {}/{}/{} {}/{}/{} {}/{}/{}\n",
+                a, a, n, d, d, n, c, c, n,
+                a, a, n, c, c, n, b, b, n);
+            if(text.size() > (1 << 20) - 4096)
+                flush();
+        }
+    }
+    flush();
+}
+
+static ObjMesh loadTinyObj(const std::filesystem::path& path, double& parseSeconds) {
+    Timer timer("tinyobj");
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+
+    if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.string().c_str()))
+        throw std::runtime_error(warn + err);
+    parseSeconds = timer.elapsedSeconds();
+
+    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+    ObjMesh mesh;
+    for(const auto& shape: shapes) {
+        for(const auto& index: shape.mesh.indices) {
+            Vertex vertex{};
+            vertex.pos = {
+                attrib.vertices[3 * index.vertex_index + 0],
+                attrib.vertices[3 * index.vertex_index + 1],
+                attrib.vertices[3 * index.vertex_index + 2]
+            };
+            vertex.normal = {
+                attrib.normals[3 * index.normal_index + 0],
+                attrib.normals[3 * index.normal_index + 1],
+                attrib.normals[3 * index.normal_index + 2]
+            };
+            vertex.texCoord = {
+                attrib.texcoords[2 * index.texcoord_index + 0],
+                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+            };
+
+            if(uniqueVertices.count(vertex) == 0) {
+                uniqueVertices[vertex] = static_cast<uint32_t>(mesh.vertices.size());
+                mesh.vertices.push_back(vertex);
+            }
+            mesh.indices.push_back(uniqueVertices[vertex]);
+        }
+    }
+    return mesh;
+}
+
+int main(int argc, char** argv) {
+    std::filesystem::path path;
+    if(argc > 1) {
+        path = argv[1];
+    } else {
+        path = std::filesystem::temp_directory_path() / "fly_obj_load_benchmark.obj";
+        if(!std::filesystem::exists(path)) {
+            std::cout << std::format("Writing a {}x{} grid to {}\n", GRID_SIZE, GRID_SIZE, path.string());
+            writeGrid(path);
+        }
+    }
+    std::cout << std::format("{}: {:.1f}MB\n", path.filename().string(), static_cast<double>(std::filesystem::file_size(path)) / (1 << 20));
+
+    //loadObj first, so the file is already in the page cache for both of them
+    Timer timer("loadObj");
+    ObjMesh mesh = loadObj(path);
+    double loadSeconds = timer.elapsedSeconds();
+
+    double parseSeconds = 0.0;
+    timer.reset();
+    ObjMesh reference = loadTinyObj(path, parseSeconds);
+    double tinySeconds = timer.elapsedSeconds();
+
+    std::cout << std::format("{} triangles, {} vertices\n", mesh.indices.size() / 3, mesh.vertices.size());
+    std::cout << std::format("tinyobj + unordered_map: {:.3f}s ({:.3f}s parsing, {:.3f}s merging the vertices)\n",
+        tinySeconds, parseSeconds, tinySeconds - parseSeconds);
+    std::cout << std::format("loadObj: {:.3f}s, {:.2f}x faster\n", loadSeconds, tinySeconds / loadSeconds);
+
+    //Both merge the vertices in order of appearance, so they must agree
+    if(mesh.vertices.size() != reference.vertices.size() || mesh.indices != reference.indices) {
+        std::cout << "The meshes are different!\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+//Same layout as TDrawData<PushDefault>
+layout(push_constant) uniform DrawData {
+    vec4 positionCenter;
+    vec4 positionExtent;
+    vec4 texCoordTransform;
+    uint firstInstance;
+    uint textureIndex; //The image in the low 16 bits and the sampler in the high ones, see BindlessTable::packTexture
+} pc;
+
+layout(location = 0) in vec3 fragPos;
+layout(location = 1) in vec3 fragNormal;
+layout(location = 2) in vec2 fragTexCoord;
+
+//The bindless table, runtime arrays need the nonuniform extension even with uniform indices
+layout(set = 1, binding = 0) uniform texture2D images[];
+layout(set = 1, binding = 1) uniform sampler samplers[];
+
+
+layout (location = 0) out vec4 outColorSpecular;
+layout (location = 1) out vec4 outPosition;
+layout (location = 2) out vec4 outNormal;
+layout (location = 3) out uint outPicking;
+
+void main() {
+    //A push constant is uniform for the whole draw
+    uint imageIndex = pc.textureIndex & 0xFFFFu, samplerIndex = pc.textureIndex >> 16;
+    vec3 textureColor = vec3(texture(sampler2D(images[imageIndex], samplers[samplerIndex]), fragTexCoord));
+    
+    outColorSpecular = vec4(textureColor, 0.5);
+    outPosition = vec4(fragPos, 1);
+    outNormal = vec4(fragNormal, 1);
+    outPicking = 0xFFFFFFFF;
+}
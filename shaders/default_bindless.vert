@@ -0,0 +1,53 @@
+#version 450
+
+//Same layout as TDrawData<PushDefault>
+layout(push_constant) uniform DrawData {
+    vec4 positionCenter;
+    vec4 positionExtent;
+    vec4 texCoordTransform;
+    uint firstInstance;
+    uint textureIndex; //Only read in the fragment shader
+} pc;
+
+layout(set = 0, binding = 0) uniform Camera {
+    mat4 projView;
+} camera;
+
+struct InstanceData {
+    mat4 model;
+    mat4 normal;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Instances {
+    InstanceData instances[];
+};
+
+//Packed, see PackedVertex
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inTexCoord;
+
+
+layout(location = 0) out vec3 fragPos;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec2 fragTexCoord;
+
+
+//Inverse of octahedralEncode in VertexFormat.hpp
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0? -t : t;
+    n.y += n.y >= 0.0? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    InstanceData instance = instances[pc.firstInstance + gl_InstanceIndex];
+    vec4 worldPos = instance.model * vec4(pc.positionCenter.xyz + inPosition.xyz * pc.positionExtent.xyz, 1.0);
+    gl_Position = camera.projView * worldPos;
+
+    fragTexCoord = pc.texCoordTransform.xy + inTexCoord * pc.texCoordTransform.zw;
+    fragPos = worldPos.xyz;
+    fragNormal = normalize(mat3(instance.normal) * octDecode(inNormal));
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#version 450
+
+#define MAX_TEXTURES 64 //Same as DefaultPipeline::MAX_TEXTURES
+
+layout(location = 0) in vec3 fragPos;
+layout(location = 1) in vec3 fragNormal;
+layout(location = 2) in vec2 fragTexCoord;
+layout(location = 3) flat in uint fragTextureIndex;
+
+layout(set = 0, binding = 0) uniform sampler2D textures[MAX_TEXTURES];
+
+
+layout (location = 0) out vec4 outColorSpecular;
+layout (location = 1) out vec4 outPosition;
+layout (location = 2) out vec4 outNormal;
+layout (location = 3) out uint outPicking;
+
+void main() {
+    //The index is the same for the whole draw, so it's dynamically uniform
+    vec3 textureColor = vec3(texture(textures[fragTextureIndex], fragTexCoord));
+    
+    outColorSpecular = vec4(textureColor, 0.5);
+    outPosition = vec4(fragPos, 1);
+    outNormal = vec4(fragNormal, 1);
+    outPicking = 0xFFFFFFFF;
+}
\ No newline at end of file
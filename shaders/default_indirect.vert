@@ -0,0 +1,61 @@
+#version 460
+
+//Same layout as TDrawData<PushDefault>, padded to 64 bytes
+struct DrawData {
+    vec4 positionCenter;
+    vec4 positionExtent;
+    vec4 texCoordTransform;
+    uint firstInstance;
+    uint textureIndex;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Draws {
+    DrawData draws[];
+};
+
+layout(set = 0, binding = 1) uniform Camera {
+    mat4 projView;
+} camera;
+
+struct InstanceData {
+    mat4 model;
+    mat4 normal;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Instances {
+    InstanceData instances[];
+};
+
+//Packed, see PackedVertex
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inTexCoord;
+
+
+layout(location = 0) out vec3 fragPos;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec2 fragTexCoord;
+layout(location = 3) flat out uint fragTextureIndex;
+
+
+//Inverse of octahedralEncode in VertexFormat.hpp
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0? -t : t;
+    n.y += n.y >= 0.0? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    //The first instance of each indirect draw is its draw index, so gl_InstanceIndex starts there
+    DrawData draw = draws[gl_BaseInstance];
+    InstanceData instance = instances[draw.firstInstance + gl_InstanceIndex - gl_BaseInstance];
+    vec4 worldPos = instance.model * vec4(draw.positionCenter.xyz + inPosition.xyz * draw.positionExtent.xyz, 1.0);
+    gl_Position = camera.projView * worldPos;
+
+    fragTexCoord = draw.texCoordTransform.xy + inTexCoord * draw.texCoordTransform.zw;
+    fragPos = worldPos.xyz;
+    fragNormal = normalize(mat3(instance.normal) * octDecode(inNormal));
+    fragTextureIndex = draw.textureIndex;
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 fragPos;
+layout(location = 1) in vec3 fragNormal;
+layout(location = 2) in vec2 fragTexCoord;
+layout(location = 3) flat in uint fragTextureIndex; //The image in the low 16 bits and the sampler in the high ones, see BindlessTable::packTexture
+
+//The bindless table, after the draw data
+layout(set = 2, binding = 0) uniform texture2D images[];
+layout(set = 2, binding = 1) uniform sampler samplers[];
+
+
+layout (location = 0) out vec4 outColorSpecular;
+layout (location = 1) out vec4 outPosition;
+layout (location = 2) out vec4 outNormal;
+layout (location = 3) out uint outPicking;
+
+void main() {
+    //The draws of a multi draw can share a subgroup, so the index isn't uniform
+    uint imageIndex = fragTextureIndex & 0xFFFFu, samplerIndex = fragTextureIndex >> 16;
+    vec3 textureColor = vec3(texture(sampler2D(images[nonuniformEXT(imageIndex)], samplers[nonuniformEXT(samplerIndex)]), fragTexCoord));
+    
+    outColorSpecular = vec4(textureColor, 0.5);
+    outPosition = vec4(fragPos, 1);
+    outNormal = vec4(fragNormal, 1);
+    outPicking = 0xFFFFFFFF;
+}
@@ -2,12 +2,18 @@
 
 #include "renderer/vulkan/VulkanConstants.h"
 #include "renderer/vulkan/VulkanHelpers.hpp"
+#include "renderer/WorkgroupTuner.hpp"
+#include "renderer/GeometryArena.hpp"
+#include "renderer/OcclusionCuller.hpp"
+#include "renderer/MeshletCuller.hpp"
+#include "renderer/BindlessTable.hpp"
 
 
 #include <GLFW/glfw3.h>
 #include <imgui.h>
 
 #include <set>
+#include <fstream>
 
 static VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
     auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
@@ -39,6 +45,14 @@ namespace fly {
         pickPhysicalDevice();
         createLogicalDevice();
         createVmaAllocator();
+        vk->geometryArena = std::make_shared<GeometryArena>(vk);
+        createPipelineCache();
+        if(vk->indirectDrawSupported)
+            vk->meshletCuller = std::make_shared<MeshletCuller>(vk);
+        if(vk->indirectDrawSupported && vk->drawIndirectCountSupported)
+            vk->occlusionCuller = std::make_shared<OcclusionCuller>(vk);
+        if(vk->bindlessSupported)
+            vk->bindlessTable = std::make_shared<BindlessTable>(vk);
         createSwapChain();
         createImageViews();
 
@@ -48,6 +62,8 @@ namespace fly {
         this->transferCommandPool = createCommandPool(this->vk, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
         
         createAttachmentsAndBuffers();
+        if(vk->occlusionCuller)
+            vk->occlusionCuller->createResources(this->depthTexture);
         
         this->commandBuffers = createCommandBuffers(vk->device, MAX_FRAMES_IN_FLIGHT, this->drawCommandPool);
         createSyncObjects();
@@ -56,7 +72,11 @@ namespace fly {
 
         this->tonemapper = std::make_unique<Tonemapper>(vk);
         this->tonemapper->allocate();
-        this->tonemapper->createResources(this->hdrColorTexture);
+        this->tonemapper->createResources(this->hdrColorTextures);
+
+        this->fusedFilters = std::make_unique<FusedFilterChain>(vk);
+        this->fusedFilters->allocate();
+        this->fusedFilters->createResources(this->hdrColorTextures);
     }
 
     void Engine::run() {
@@ -99,6 +119,10 @@ namespace fly {
             
             for(auto& pipeline: this->graphicPipelines)
                 pipeline->update(this->currentFrame);
+            //After the detached meshes are destroyed, so their ranges can be compacted
+            vk->geometryArena->update(this->currentFrame, this->transferCommandPool);
+            if(vk->bindlessTable)
+                vk->bindlessTable->update(this->currentFrame);
 
 
             uiManager->setupFrame();
@@ -123,6 +147,7 @@ namespace fly {
         scene.reset();
         uiManager.reset();
         tonemapper.reset();
+        fusedFilters.reset();
         cleanup();
 
         Engine::instance = nullptr;
@@ -235,18 +260,22 @@ namespace fly {
         createSwapChain();
         createImageViews();
         createAttachmentsAndBuffers();
+        if(vk->occlusionCuller)
+            vk->occlusionCuller->createResources(this->depthTexture);
         uiManager->recreateOnNewSwapChain();
         
-        deferredShader->updateShader(hdrColorTexture, albedoSpecTexture, positionsTexture, normalsTexture, pickingTexture);
+        deferredShader->updateShader(hdrColorTextures[0], albedoSpecTexture, positionsTexture, normalsTexture, pickingTexture);
         
-        tonemapper->createResources(hdrColorTexture);
+        tonemapper->createResources(hdrColorTextures);
+        fusedFilters->createResources(hdrColorTextures);
         for(auto& [id, f]: filters)
-            f->createResources();
+            f->createResources(hdrColorTextures);
     }
 
     void Engine::cleanupSwapChain() {
         this->pickingTexture.reset();
-        this->hdrColorTexture.reset();
+        for(auto& t: this->hdrColorTextures)
+            t.reset();
         this->depthTexture.reset();
         this->albedoSpecTexture.reset();
         this->positionsTexture.reset();
@@ -260,6 +289,8 @@ namespace fly {
 
         for(auto imageView : vk->swapChainImageViews)
             vkDestroyImageView(vk->device, imageView, nullptr);
+        for(auto imageView : vk->swapChainStorageViews)
+            vkDestroyImageView(vk->device, imageView, nullptr);
 
         vkDestroySwapchainKHR(vk->device, vk->swapChain, nullptr);
     }
@@ -273,6 +304,44 @@ namespace fly {
         if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
             throw std::runtime_error("failed to begin recording command buffer!");
 
+        //The last frame recorded on this slot has finished, so its timings are ready for the tuner
+        profiler->beginFrame(commandBuffer, this->currentFrame);
+        vk->workgroupTuner->beginFrame(this->currentFrame, profiler->getPassTimes());
+
+        //DYNAMIC RESOLUTION AND FILTER QUALITY, held while the workgroup sizes are tuned so their timings stay comparable
+        if(!vk->workgroupTuner->isTuning()) {
+            vk->renderExtent = this->dynamicResolution.update(profiler->getFrameTime(), vk->swapChainExtent);
+
+            //The resolution reacts first, the filters only go down when it can't and back up when it is native again
+            float scale = this->dynamicResolution.getScale();
+            bool canLower = !this->dynamicResolution.isEnabled() || scale <= DynamicResolution::MIN_SCALE;
+            bool canRaise = scale >= DynamicResolution::MAX_SCALE;
+            this->qualityGovernor.update(profiler->getFrameTime(), profiler->getPassTimes(), this->filters, canLower, canRaise);
+        }
+
+        for(auto& pipeline: this->graphicPipelines)
+            pipeline->prepareFrame(this->currentFrame);
+
+        //STREAMED GEOMETRY
+        for(auto& pipeline: this->graphicPipelines)
+            pipeline->recordTransfers(commandBuffer, this->currentFrame);
+
+        //CULLING ON THE GPU, the meshlets and the draws visible in the last depth pyramid
+        if(vk->indirectDrawSupported) {
+            profiler->beginPass(commandBuffer, "culling");
+            if(vk->occlusionCuller)
+                vk->occlusionCuller->beginFrame(commandBuffer);
+            for(auto& pipeline: this->graphicPipelines)
+                pipeline->recordCulling(commandBuffer, this->currentFrame, 0);
+            memoryBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                VK_ACCESS_SHADER_WRITE_BIT,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT
+            );
+            profiler->endPass(commandBuffer);
+        }
 
         //RENDER PASS
         VkRenderPassBeginInfo renderPassInfo{};
@@ -281,7 +350,7 @@ namespace fly {
         renderPassInfo.framebuffer = this->swapChainFramebuffers[imageIndex];
 
         renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = vk->swapChainExtent;
+        renderPassInfo.renderArea.extent = vk->renderExtent;
 
         std::array<VkClearValue, 5> clearValues{};
         clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
@@ -292,45 +361,75 @@ namespace fly {
         renderPassInfo.clearValueCount = clearValues.size();
         renderPassInfo.pClearValues = clearValues.data();
 
+        profiler->beginPass(commandBuffer, "gbuffer");
         vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
-        viewport.width = static_cast<float>(vk->swapChainExtent.width);
-        viewport.height = static_cast<float>(vk->swapChainExtent.height);
+        viewport.width = static_cast<float>(vk->renderExtent.width);
+        viewport.height = static_cast<float>(vk->renderExtent.height);
         viewport.minDepth = 0.0f;
         viewport.maxDepth = 1.0f;
         vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
         VkRect2D scissor{};
         scissor.offset = {0, 0};
-        scissor.extent = vk->swapChainExtent;
+        scissor.extent = vk->renderExtent;
         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
         
         for(auto& pipeline: this->graphicPipelines)
             pipeline->recordOnCommandBuffer(commandBuffer, this->currentFrame);
 
         vkCmdEndRenderPass(commandBuffer);
+        profiler->endPass(commandBuffer);
+
+        //The pyramid of this frame, then the rejected draws that are visible in it are drawn over the first pass
+        if(vk->occlusionCuller) {
+            profiler->beginPass(commandBuffer, "occlusion");
+            vk->occlusionCuller->buildPyramid(commandBuffer);
+            for(auto& pipeline: this->graphicPipelines)
+                pipeline->recordCulling(commandBuffer, this->currentFrame, 1);
+            memoryBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                VK_ACCESS_SHADER_WRITE_BIT,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT
+            );
+            profiler->endPass(commandBuffer);
+
+            profiler->beginPass(commandBuffer, "gbuffer");
+            renderPassInfo.renderPass = this->renderPassLoad;
+            renderPassInfo.clearValueCount = 0;
+            renderPassInfo.pClearValues = nullptr;
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+            for(auto& pipeline: this->graphicPipelines)
+                pipeline->recordLateOnCommandBuffer(commandBuffer, this->currentFrame);
+
+            vkCmdEndRenderPass(commandBuffer);
+            profiler->endPass(commandBuffer);
+        }
 
 
         //DO THE DEFERRED SHADING
+        profiler->beginPass(commandBuffer, "deferred");
         deferredShader->run(commandBuffer, this->currentFrame);
+        profiler->endPass(commandBuffer);
 
 
-        //FILTERS
-        for(auto& [id, f]: filters)
-            f->applyFilter(commandBuffer, this->hdrColorTexture->getImage(), this->currentFrame);
-
-        
-        //TONEMAPPING (from rgb16 to rgb8)
-        tonemapper->applyFilter(commandBuffer, vk->swapChainImages[imageIndex], this->currentFrame);
+        //FILTERS AND TONEMAPPING
+        applyFilters(commandBuffer, imageIndex);
 
 
-        //RETRIEVE PICKING BUFFER DATA
-        glm::ivec2 mousePos = this->window.getMousePos();
-        if(1 <= mousePos.x && mousePos.x < window.getWidth()-1
-        && 1 <= mousePos.y && mousePos.y < window.getHeight()-1) {
+        //RETRIEVE PICKING BUFFER DATA, the picking image is at render resolution
+        glm::vec2 renderScale = glm::vec2(vk->renderExtent.width, vk->renderExtent.height) / glm::vec2(vk->swapChainExtent.width, vk->swapChainExtent.height);
+        glm::ivec2 mousePos = glm::vec2(this->window.getMousePos()) * renderScale;
+        if(1 <= mousePos.x && mousePos.x < static_cast<int>(vk->renderExtent.width)-1
+        && 1 <= mousePos.y && mousePos.y < static_cast<int>(vk->renderExtent.height)-1) {
             transitionImageLayout(
                 commandBuffer, 
                 this->pickingTexture->getImage(), 
@@ -354,18 +453,92 @@ namespace fly {
         }
 
         
+        profiler->endFrame(commandBuffer);
         if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
             throw std::runtime_error("failed to record command buffer!");
     }
 
+    void Engine::applyFilters(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        //The second hdr image holds nothing useful from the last frame
+        transitionImageLayout(
+            commandBuffer, this->hdrColorTextures[1]->getImage(),
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            VK_ACCESS_SHADER_WRITE_BIT,
+            1, false
+        );
+
+        //Each filter reads hdr[input] and writes hdr[1-input], unless it works in place
+        uint32_t input = 0;
+        auto filterDone = [&](bool inPlace) {
+            if(!inPlace)
+                input = 1 - input;
+
+            memoryBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_WRITE_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+            );
+        };
+
+        //Adjacent pixel filters are fused into a single dispatch
+        std::vector<PixelFilter*> pixelRun;
+        auto flushPixelRun = [&]() {
+            if(pixelRun.empty())
+                return;
+
+            profiler->beginPass(commandBuffer, fusedFilters->getPassName());
+            if(pixelRun.size() == 1)
+                pixelRun[0]->applyFilter(commandBuffer, input, this->currentFrame);
+            else
+                fusedFilters->applyChain(commandBuffer, pixelRun, input, this->currentFrame);
+            profiler->endPass(commandBuffer);
+            
+            pixelRun.clear();
+            filterDone(false);
+        };
+
+        for(auto& [id, f]: filters) {
+            if(f->isBypassed())
+                continue;
+
+            if(auto pixelFilter = dynamic_cast<PixelFilter*>(f.get())) {
+                pixelRun.push_back(pixelFilter);
+                if(pixelRun.size() == PixelFilter::MAX_FUSED_STAGES)
+                    flushPixelRun();
+                continue;
+            }
+
+            flushPixelRun();
+            profiler->beginPass(commandBuffer, f->getPassName());
+            f->applyFilter(commandBuffer, input, this->currentFrame);
+            profiler->endPass(commandBuffer);
+            filterDone(f->isInPlace());
+        }
+        flushPixelRun();
+
+        //TONEMAPPING (from rgb16 to rgb8)
+        profiler->beginPass(commandBuffer, tonemapper->getPassName());
+        tonemapper->applyFilter(commandBuffer, imageIndex, input, this->currentFrame);
+        profiler->endPass(commandBuffer);
+    }
+
     void Engine::cleanup() {
         cleanupSwapChain();
 
         graphicPipelines.clear();
+        nextGraphicsPipelines.clear();
         filters.clear();
         deferredShader.reset();
 
         vkDestroyRenderPass(vk->device, this->renderPass, nullptr);
+        if(this->renderPassLoad)
+            vkDestroyRenderPass(vk->device, this->renderPassLoad, nullptr);
 
         for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
             vkDestroySemaphore(vk->device, this->renderFinishedSemaphores[i], nullptr);
@@ -376,8 +549,17 @@ namespace fly {
         vkDestroyCommandPool(vk->device, this->transferCommandPool, nullptr);
         vkDestroyCommandPool(vk->device, this->drawCommandPool, nullptr);
 
+        vk->occlusionCuller.reset();
+        vk->meshletCuller.reset();
+        vk->bindlessTable.reset();
+        vk->geometryArena.reset();
         vmaDestroyAllocator(vk->allocator);
 
+        this->profiler.reset();
+        vk->workgroupTuner.reset();
+        savePipelineCache();
+        vkDestroyPipelineCache(vk->device, vk->pipelineCache, nullptr);
+
         vkDestroyDevice(vk->device, nullptr);
 
         if(enableValidationLayers)
@@ -400,7 +582,7 @@ namespace fly {
         this->nextFilters.clear();
 
         this->deferredShader = this->nextScene->getDeferredShader(vk); //FIXME: THIS DOES NOT WORK !!!!! AAAAAA
-        deferredShader->updateShader(hdrColorTexture, albedoSpecTexture, positionsTexture, normalsTexture, pickingTexture);
+        deferredShader->updateShader(hdrColorTextures[0], albedoSpecTexture, positionsTexture, normalsTexture, pickingTexture);
 
         this->scene = std::move(this->nextScene);
         this->nextScene = nullptr;
@@ -538,21 +720,67 @@ namespace fly {
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
-        VkPhysicalDeviceFeatures deviceFeatures{};
-        deviceFeatures.samplerAnisotropy = VK_TRUE;
-        deviceFeatures.independentBlend = VK_TRUE;
-        deviceFeatures.fragmentStoresAndAtomics = VK_TRUE;
+        //The indirect draws need all of these, otherwise the pipelines draw mesh by mesh
+        VkPhysicalDeviceVulkan12Features supported12{};
+        supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceVulkan11Features supported11{};
+        supported11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+        supported11.pNext = &supported12;
+        VkPhysicalDeviceFeatures2 supported{};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supported.pNext = &supported11;
+        vkGetPhysicalDeviceFeatures2(vk->physicalDevice, &supported);
+        vk->indirectDrawSupported = supported.features.multiDrawIndirect && supported.features.drawIndirectFirstInstance
+            && supported.features.shaderSampledImageArrayDynamicIndexing && supported11.shaderDrawParameters;
+        //The occlusion culling draws with a count written by the GPU
+        vk->drawIndirectCountSupported = supported12.drawIndirectCount;
+        //The bindless table indexes runtime arrays that are updated while they are bound
+        vk->bindlessSupported = supported12.runtimeDescriptorArray && supported12.descriptorBindingPartiallyBound
+            && supported12.descriptorBindingSampledImageUpdateAfterBind && supported12.descriptorBindingUpdateUnusedWhilePending
+            && supported12.shaderSampledImageArrayNonUniformIndexing;
+
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features12.drawIndirectCount = vk->drawIndirectCountSupported;
+        features12.runtimeDescriptorArray = vk->bindlessSupported;
+        features12.descriptorBindingPartiallyBound = vk->bindlessSupported;
+        features12.descriptorBindingSampledImageUpdateAfterBind = vk->bindlessSupported;
+        features12.descriptorBindingUpdateUnusedWhilePending = vk->bindlessSupported;
+        features12.shaderSampledImageArrayNonUniformIndexing = vk->bindlessSupported;
+
+        VkPhysicalDeviceVulkan11Features features11{};
+        features11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+        features11.pNext = &features12;
+        features11.shaderDrawParameters = vk->indirectDrawSupported;
+
+        VkPhysicalDeviceFeatures2 deviceFeatures{};
+        deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        deviceFeatures.pNext = &features11;
+        deviceFeatures.features.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.features.independentBlend = VK_TRUE;
+        deviceFeatures.features.fragmentStoresAndAtomics = VK_TRUE;
+        deviceFeatures.features.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+        deviceFeatures.features.multiDrawIndirect = vk->indirectDrawSupported;
+        deviceFeatures.features.drawIndirectFirstInstance = vk->indirectDrawSupported;
+        deviceFeatures.features.shaderSampledImageArrayDynamicIndexing = vk->indirectDrawSupported;
 
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.pNext = &deviceFeatures;
 
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-        createInfo.pEnabledFeatures = &deviceFeatures;
+        createInfo.pEnabledFeatures = nullptr;
 
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        //The tonemapper can write an sRGB swapchain through a UNORM view with this one
+        std::vector<const char*> extensions(deviceExtensions.begin(), deviceExtensions.end());
+        vk->swapChainMutableFormat = hasDeviceExtension(vk->physicalDevice, VK_KHR_SWAPCHAIN_MUTABLE_FORMAT_EXTENSION_NAME);
+        if(vk->swapChainMutableFormat)
+            extensions.push_back(VK_KHR_SWAPCHAIN_MUTABLE_FORMAT_EXTENSION_NAME);
+
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
 
         if(enableValidationLayers) {
             createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -581,6 +809,44 @@ namespace fly {
             throw std::runtime_error("Failed to create vma allocator!"); 
     }
 
+    void Engine::createPipelineCache() {
+        std::vector<char> cacheData;
+        try {
+            cacheData = readFile(PIPELINE_CACHE_PATH);
+        } catch(const std::runtime_error&) {
+            std::cout << "There is no pipeline cache yet, it will be created on exit\n";
+        }
+
+        //The driver checks the header and ignores data from another device or driver
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = cacheData.size();
+        cacheInfo.pInitialData = cacheData.data();
+
+        if(vkCreatePipelineCache(vk->device, &cacheInfo, nullptr, &vk->pipelineCache) != VK_SUCCESS)
+            throw std::runtime_error("failed to create pipeline cache!");
+
+        this->profiler = std::make_unique<GpuProfiler>(vk);
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(vk->physicalDevice, &properties);
+        auto deviceKey = std::format("{} {:x}:{:x}:{:x}", properties.deviceName, properties.vendorID, properties.deviceID, properties.driverVersion);
+        vk->workgroupTuner = std::make_shared<WorkgroupTuner>(WORKGROUP_SIZES_PATH, deviceKey, this->profiler->isSupported());
+    }
+
+    void Engine::savePipelineCache() {
+        size_t size = 0;
+        if(vkGetPipelineCacheData(vk->device, vk->pipelineCache, &size, nullptr) != VK_SUCCESS)
+            return;
+
+        std::vector<char> cacheData(size);
+        if(vkGetPipelineCacheData(vk->device, vk->pipelineCache, &size, cacheData.data()) != VK_SUCCESS)
+            return;
+
+        std::ofstream file(PIPELINE_CACHE_PATH, std::ios::binary);
+        file.write(cacheData.data(), size);
+    }
+
     void Engine::createSwapChain() {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(vk->surface, vk->physicalDevice);
 
@@ -603,6 +869,22 @@ namespace fly {
         createInfo.imageArrayLayers = 1;
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
         
+        //The tonemapper writes straight into the swapchain when it can be a storage image, if not it copies into it
+        VkFormat storageFormat = chooseSwapStorageFormat(surfaceFormat.format, swapChainSupport.capabilities);
+        std::array<VkFormat, 2> viewFormats = {surfaceFormat.format, storageFormat};
+        VkImageFormatListCreateInfo formatList{};
+        formatList.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO;
+        formatList.viewFormatCount = static_cast<uint32_t>(viewFormats.size());
+        formatList.pViewFormats = viewFormats.data();
+
+        if(storageFormat != VK_FORMAT_UNDEFINED) {
+            createInfo.imageUsage |= VK_IMAGE_USAGE_STORAGE_BIT;
+            if(storageFormat != surfaceFormat.format) {
+                createInfo.flags = VK_SWAPCHAIN_CREATE_MUTABLE_FORMAT_BIT_KHR;
+                createInfo.pNext = &formatList;
+            }
+        }
+
         createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
         createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
         createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
@@ -619,7 +901,30 @@ namespace fly {
         vkGetSwapchainImagesKHR(vk->device, vk->swapChain, &imageCount, vk->swapChainImages.data());
 
         vk->swapChainImageFormat = surfaceFormat.format;
+        vk->swapChainStorageFormat = storageFormat;
         vk->swapChainExtent = extent;
+        vk->renderExtent = extent;
+    }
+
+    VkFormat Engine::chooseSwapStorageFormat(VkFormat surfaceFormat, const VkSurfaceCapabilitiesKHR& capabilities) {
+        if(!(capabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT))
+            return VK_FORMAT_UNDEFINED;
+
+        //The tonemapper output is rgba8 and already gamma corrected, so an sRGB image is written through its UNORM alias
+        VkFormat storageFormat = VK_FORMAT_UNDEFINED;
+        if(surfaceFormat == VK_FORMAT_R8G8B8A8_UNORM)
+            storageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        else if(surfaceFormat == VK_FORMAT_R8G8B8A8_SRGB && vk->swapChainMutableFormat)
+            storageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        if(storageFormat == VK_FORMAT_UNDEFINED)
+            return VK_FORMAT_UNDEFINED;
+
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(vk->physicalDevice, storageFormat, &properties);
+        if(!(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
+            return VK_FORMAT_UNDEFINED;
+
+        return storageFormat;
     }
 
     VkExtent2D Engine::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
@@ -642,8 +947,15 @@ namespace fly {
         vk->swapChainImageViews.resize(vk->swapChainImages.size());
         
         for (size_t i = 0; i < vk->swapChainImages.size(); i++) {
-            vk->swapChainImageViews[i] = createImageView(this->vk, vk->swapChainImages[i], vk->swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, false);
+            vk->swapChainImageViews[i] = createImageView(this->vk, vk->swapChainImages[i], vk->swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, false, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
         }
+
+        vk->swapChainStorageViews.clear();
+        if(vk->swapChainStorageFormat == VK_FORMAT_UNDEFINED)
+            return;
+        
+        for(auto image: vk->swapChainImages)
+            vk->swapChainStorageViews.push_back(createImageView(this->vk, image, vk->swapChainStorageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, false, VK_IMAGE_USAGE_STORAGE_BIT));
     }
 
     void Engine::createRenderPass() {
@@ -678,6 +990,11 @@ namespace fly {
         depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        if(vk->occlusionCuller) {
+            //The depth pyramid is built from it and the late draws test against it
+            depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        }
 
         VkAttachmentReference depthAttachmentRef{};
         depthAttachmentRef.attachment = 3;
@@ -714,6 +1031,16 @@ namespace fly {
         dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;;
         dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+        //The depth is read by the compute shader that builds the pyramid
+        VkSubpassDependency pyramidDependency{};
+        pyramidDependency.srcSubpass = 0;
+        pyramidDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+        pyramidDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        pyramidDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        pyramidDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        pyramidDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        std::array<VkSubpassDependency, 2> dependencies = {dependency, pyramidDependency};
         std::array<VkAttachmentDescription, 5> attachments = {albedoAttachment, positionsAttachment, normalsAttachment, depthAttachment, pickingAttachment};
         VkRenderPassCreateInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -721,11 +1048,40 @@ namespace fly {
         renderPassInfo.pAttachments = attachments.data();
         renderPassInfo.subpassCount = 1;
         renderPassInfo.pSubpasses = &subpass;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
+        renderPassInfo.dependencyCount = vk->occlusionCuller? 2 : 1;
+        renderPassInfo.pDependencies = dependencies.data();
 
         if(vkCreateRenderPass(vk->device, &renderPassInfo, nullptr, &this->renderPass) != VK_SUCCESS)
             throw std::runtime_error("failed to create render pass!");
+
+        if(!vk->occlusionCuller)
+            return;
+
+        //LATE PASS, the same attachments are loaded and the depth is left as the next passes expect it
+        for(int i: {0, 1, 2, 4}) {
+            attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            attachments[i].initialLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+        attachments[3].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachments[3].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[3].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        attachments[3].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        //After the first pass wrote the attachments and the pyramid read the depth
+        VkSubpassDependency loadDependency{};
+        loadDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        loadDependency.dstSubpass = 0;
+        loadDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        loadDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        loadDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        loadDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT 
+            | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies = &loadDependency;
+
+        if(vkCreateRenderPass(vk->device, &renderPassInfo, nullptr, &this->renderPassLoad) != VK_SUCCESS)
+            throw std::runtime_error("failed to create render pass!");
     }
 
     void Engine::createAttachmentsAndBuffers() {        
@@ -758,12 +1114,16 @@ namespace fly {
         );
 
         auto depthFormat = findDepthFormat(vk->physicalDevice);
+        //The occlusion culling reduces it into the depth pyramid
+        VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if(vk->occlusionCuller)
+            depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
         this->depthTexture = std::make_shared<Texture>(
             this->vk,
             vk->swapChainExtent.width, vk->swapChainExtent.height, 
             depthFormat,
             VK_SAMPLE_COUNT_1_BIT,
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+            depthUsage,
             VK_IMAGE_ASPECT_DEPTH_BIT
         );
 
@@ -776,14 +1136,16 @@ namespace fly {
             VK_IMAGE_ASPECT_COLOR_BIT
         );
 
-        this->hdrColorTexture = std::make_shared<Texture>(
-            this->vk, 
-            vk->swapChainExtent.width, vk->swapChainExtent.height, 
-            this->hdrFormat, 
-            VK_SAMPLE_COUNT_1_BIT,
-            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-            VK_IMAGE_ASPECT_COLOR_BIT
-        );
+        for(auto& hdrColorTexture: this->hdrColorTextures) {
+            hdrColorTexture = std::make_shared<Texture>(
+                this->vk, 
+                vk->swapChainExtent.width, vk->swapChainExtent.height, 
+                this->hdrFormat, 
+                VK_SAMPLE_COUNT_1_BIT,
+                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_IMAGE_ASPECT_COLOR_BIT
+            );
+        }
 
         //CREATE PICKING BUFFER (CPU SIDE)
         VkBufferCreateInfo bufferCreateInfo{};
@@ -875,6 +1237,7 @@ namespace fly {
         
         auto deviceRatio = deviceUsage / deviceBudget;
         ImGui::LabelText("VRAM", "%.1lf / %.1lf MB", deviceUsage / (1 << 20), deviceBudget / (1 << 20));
+        ImGui::LabelText("Geometry arena", "%.1lf / %.1lf MB", double(vk->geometryArena->getUsedBytes()) / (1 << 20), double(vk->geometryArena->getCapacity()) / (1 << 20));
         
         ImVec4 color = {1, 0, 1, 1};
         if(deviceRatio < 0.5) {
@@ -888,6 +1251,15 @@ namespace fly {
         ImGui::ProgressBar(deviceRatio, ImVec2(0,0));
         ImGui::PopStyleColor();
 
+        ImGui::LabelText("GPU time", "%.03fms", profiler->getFrameTime());
+        ImGui::LabelText("Render size", "%dpx x %dpx (%.0f%%)", vk->renderExtent.width, vk->renderExtent.height, dynamicResolution.getScale() * 100);
+        for(auto& [pass, time]: profiler->getPassTimes())
+            ImGui::LabelText(pass.c_str(), "%.03fms", time);
+        if(qualityGovernor.isEnabled())
+            ImGui::LabelText("Filter tiers lowered", "%u", qualityGovernor.getLoweredSteps());
+        if(vk->workgroupTuner->isTuning())
+            ImGui::Text("Tuning workgroup sizes...");
+
         ImGui::Unindent();
         ImGui::Dummy(ImVec2(0.0f, 5.0f));
         ImGui::Separator();
@@ -4,6 +4,9 @@
 #include "ui/UIManager.hpp"
 #include "renderer/FilterPipeline.hpp"
 #include "renderer/DeferredShader.hpp"
+#include "renderer/GpuProfiler.hpp"
+#include "renderer/DynamicResolution.hpp"
+#include "renderer/QualityGovernor.hpp"
 
 
 #include <map>
@@ -31,6 +34,8 @@ namespace fly {
     private:
         static inline const char* ENGINE_NAME = "Fly Engine";
         static inline constexpr uint32_t ENGINE_VERSION = VK_MAKE_VERSION(0, 1, 0);
+        static inline const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+        static inline const char* WORKGROUP_SIZES_PATH = "workgroup_sizes.json"; //Next to the pipeline cache, the winners of the workgroup tuner per device
     
         inline static Engine* instance = nullptr;
         inline static std::mutex instanceMtx = {};
@@ -85,7 +90,7 @@ namespace fly {
         uint64_t addFilter() {
             auto filter = std::make_unique<T>(vk);
             filter->allocate();
-            filter->createResources();
+            filter->createResources(this->hdrColorTextures);
             this->nextFilters.insert(std::make_pair(this->globalFilterId, std::move(filter)));
             return this->globalFilterId++;
         }
@@ -110,6 +115,8 @@ namespace fly {
         }
 
         Tonemapper& getTonemapper() { return *this->tonemapper; }
+        DynamicResolution& getDynamicResolution() { return this->dynamicResolution; }
+        QualityGovernor& getQualityGovernor() { return this->qualityGovernor; }
         void removeFilter(uint64_t filterId);
         void removeFilters();
 
@@ -138,6 +145,7 @@ namespace fly {
         VkDebugUtilsMessengerEXT debugMessenger;
 
         VkRenderPass renderPass;
+        VkRenderPass renderPassLoad = VK_NULL_HANDLE; //Draws over the first pass, for the draws the occlusion culling found late
         
         std::vector<VkFramebuffer> swapChainFramebuffers;
         std::vector<VkCommandBuffer> commandBuffers;
@@ -145,7 +153,8 @@ namespace fly {
         std::vector<std::unique_ptr<IGraphicsPipeline>> graphicPipelines, nextGraphicsPipelines;
 
         VkFormat hdrFormat = VK_FORMAT_R16G16B16A16_SFLOAT, pickingFormat = VK_FORMAT_R32_UINT;
-        std::shared_ptr<Texture> hdrColorTexture, depthTexture, pickingTexture, albedoSpecTexture, positionsTexture, normalsTexture;
+        std::shared_ptr<Texture> depthTexture, pickingTexture, albedoSpecTexture, positionsTexture, normalsTexture;
+        HdrImages hdrColorTextures; //The deferred shader writes the first one, then the filters ping-pong between both
         VkBuffer pickingCPUBuffer;
         VmaAllocation pickingCPUAlloc;
         VmaAllocationInfo pickingCPUBufferInfo;
@@ -155,6 +164,10 @@ namespace fly {
 
         std::unique_ptr<DeferredShader> deferredShader;
         std::unique_ptr<Tonemapper> tonemapper;
+        std::unique_ptr<FusedFilterChain> fusedFilters;
+        std::unique_ptr<GpuProfiler> profiler;
+        DynamicResolution dynamicResolution;
+        QualityGovernor qualityGovernor;
         
         struct FilterDetachInfo { 
             std::unique_ptr<FilterPipeline> pipeline; 
@@ -180,6 +193,8 @@ namespace fly {
         void pickPhysicalDevice();
         void createLogicalDevice();
         void createVmaAllocator();
+        void createPipelineCache();
+        void savePipelineCache();
         void createSwapChain();
         void createImageViews();
         void createRenderPass();
@@ -188,10 +203,11 @@ namespace fly {
         
         void drawImguiEngineInfo(double frameTime);
 
-        void applyFilters(VkCommandBuffer commandBuffer, VkImage swapchainImage);
+        void applyFilters(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 
         void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
         VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
+        VkFormat chooseSwapStorageFormat(VkFormat surfaceFormat, const VkSurfaceCapabilitiesKHR& capabilities);
         static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData);
     };
 
@@ -24,6 +24,9 @@
                 std::abort(); \
             } \
         } while (0)
+
+    //Diagnostics only printed by debug builds
+    #define FLY_DEBUG_LOG(...) std::cout << std::format(__VA_ARGS__)
 #else
     inline void _assert_format() {} // Empty overload
 
@@ -40,6 +43,9 @@
                 std::abort(); \
             } \
         } while (0)
+
+    //The arguments are still checked, but never evaluated
+    #define FLY_DEBUG_LOG(...) do { (void)sizeof(std::format(__VA_ARGS__)); } while (0)
 #endif
 
 namespace fly {
@@ -21,9 +21,8 @@ namespace fly {
         this->descriptorPool = createDescriptorPoolWithLayout(this->descriptorSetLayout, this->vk);
         
         //PIPELINE AND DESCRIPTOR SET CREATION
-        auto [pip, lay] = createComputePipeline(vk, this->descriptorSetLayout.layout, readFile(DEFERRED_SHADER_SRC), 0);
-        this->pipeline = pip;
-        this->pipelineLayout = lay;
+        this->pipelineLayout = createComputePipelineLayout(vk, this->descriptorSetLayout.layout, 0);
+        this->tunedPipeline = std::make_unique<TunedComputePipeline>(vk, "deferred", this->pipelineLayout, readFile(DEFERRED_SHADER_SRC));
         this->descriptorSets = allocateDescriptorSets(vk, this->descriptorSetLayout.layout, this->descriptorPool);
     }
 
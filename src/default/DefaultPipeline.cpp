@@ -1,34 +1,184 @@
 #include "DefaultPipeline.hpp"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader/tiny_obj_loader.h>
-
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
-
+#include <algorithm>
+#include <bit>
+#include <cstring>
 #include <unordered_map>
 
 #include "../renderer/vulkan/Descriptors.hpp"
-
-namespace std {
-    template<> struct hash<fly::Vertex> {
-        size_t operator()(fly::Vertex const& vertex) const {
-            return ((hash<glm::vec3>()(vertex.pos) ^
-                    (hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^
-                    (hash<glm::vec2>()(vertex.texCoord) << 1);
-        }
-    };
-}
+#include "../renderer/MeshCache.hpp"
+#include "../renderer/MeshOptimizer.hpp"
+#include "ObjLoader.hpp"
 
 namespace fly {
 
     //DEFAULT PIPELINE IMPLEMENTATION
+    DefaultPipeline::DefaultPipeline(std::shared_ptr<VulkanInstance> vk): TGraphicsPipeline{vk, DEPTH_TEST_ENABLED | DEFERRED_ENABLED | BACK_CULLING_ENABLED | INDIRECT_DRAW_ENABLED | OCCLUSION_CULLING_ENABLED | MESHLET_CULLING_ENABLED | BINDLESS_ENABLED} {
+        this->cameraBuffer = std::make_unique<TBuffer<CameraUniform>>(vk, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    }
+
+    DefaultPipeline::~DefaultPipeline() {
+        for(auto& frame: this->instanceFrames) {
+            if(frame.buffer)
+                vmaDestroyBuffer(vk->allocator, frame.buffer, frame.alloc);
+        }
+    }
+
+    void DefaultPipeline::setInstances(unsigned meshIndex, const std::vector<glm::mat4>& models) {
+        auto& data = this->instances[meshIndex];
+        data.resize(models.size());
+        for(size_t i=0; i<models.size(); ++i)
+            data[i] = { models[i], glm::mat4(glm::transpose(glm::inverse(glm::mat3(models[i])))) };
+
+        this->instancesMoved = true;
+        this->setInstanceCount(meshIndex, static_cast<int>(models.size()));
+    }
+
+    std::optional<glm::mat4> DefaultPipeline::getModelMatrix(unsigned meshIndex, const MeshData&) const {
+        auto it = this->instances.find(meshIndex);
+        if(it == this->instances.end() || it->second.empty())
+            return std::nullopt;
+        return it->second.front().model;
+    }
+
+    void DefaultPipeline::prepareFrame(uint32_t currentFrame) {
+        this->cameraBuffer->updateBuffer({ this->getCameraProjView() }, currentFrame);
+
+        if(this->instancesMoved)
+            packInstances();
+
+        auto& frame = this->instanceFrames[currentFrame];
+        if(frame.dirty) {
+            reserveInstances(frame, this->packedInstances.size());
+            memcpy(frame.info.pMappedData, this->packedInstances.data(), sizeof(InstanceData) * this->packedInstances.size());
+            frame.dirty = false;
+        }
+
+        //The sets only change when the buffer of the frame grows or a mesh is new
+        if(this->isIndirect() || this->isBindless()) {
+            if(frame.boundBuffer != frame.buffer) {
+                writeInstanceSet(this->getSharedDescriptorSet(currentFrame), currentFrame);
+                frame.boundBuffer = frame.buffer;
+            }
+        }
+
+        //Every mesh of the direct path, and the ones of the indirect path whose textures didn't fit in the shared set
+        for(auto& [id, mesh]: this->meshes) {
+            if(!this->hasOwnDescriptorSets(mesh))
+                continue;
+
+            auto& bound = this->boundMeshBuffers[id];
+            if(bound[currentFrame] != frame.buffer) {
+                for(uint32_t set=0; set<=mesh.materialSets.size(); ++set)
+                    writeInstanceSet(mesh.getDescriptorSet(set, currentFrame), currentFrame);
+                bound[currentFrame] = frame.buffer;
+            }
+        }
+    }
+
+    //The instances of each mesh are contiguous and the meshes whose first instance or quantization changed get their push constant again
+    void DefaultPipeline::packInstances() {
+        this->packedInstances.clear();
+        for(auto it = this->instances.begin(); it != this->instances.end();) {
+            auto mesh = this->meshes.find(it->first);
+            if(mesh == this->meshes.end()) {
+                this->boundMeshBuffers.erase(it->first);
+                it = this->instances.erase(it);
+                continue;
+            }
+
+            const auto& quantization = mesh->second.vertexArray->getQuantization();
+            PushDefault push{};
+            push.positionCenter = glm::vec4(quantization.center, 0.0f);
+            push.positionExtent = glm::vec4(quantization.extent, 0.0f);
+            push.texCoordTransform = glm::vec4(quantization.texCoordOffset, quantization.texCoordScale);
+            push.firstInstance = static_cast<uint32_t>(this->packedInstances.size());
+
+            this->packedInstances.insert(this->packedInstances.end(), it->second.begin(), it->second.end());
+            if(mesh->second.pushConstant != push)
+                this->setPushConstant(it->first, push);
+            ++it;
+        }
+
+        this->instancesMoved = false;
+        for(auto& frame: this->instanceFrames)
+            frame.dirty = true;
+    }
+
+    //The buffer of this frame isn't in use, its fence was waited before prepareFrame
+    void DefaultPipeline::reserveInstances(InstanceFrame& frame, size_t instanceCount) {
+        instanceCount = std::max<size_t>(instanceCount, 1);
+        if(instanceCount <= frame.capacity)
+            return;
+
+        if(frame.buffer)
+            vmaDestroyBuffer(vk->allocator, frame.buffer, frame.alloc);
+        frame.capacity = std::bit_ceil(instanceCount);
+
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = sizeof(InstanceData) * frame.capacity;
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        if(vmaCreateBuffer(vk->allocator, &bufferInfo, &allocInfo, &frame.buffer, &frame.alloc, &frame.info) != VK_SUCCESS)
+            throw std::runtime_error("failed to create instance buffer!");
+    }
+
+    //Binding 1 is the camera and binding 2 the instances, or 0 and 1 with the bindless table that has the textures
+    void DefaultPipeline::writeInstanceSet(VkDescriptorSet set, uint32_t currentFrame) {
+        uint32_t firstBinding = this->isBindless()? 0 : 1;
+
+        VkDescriptorBufferInfo cameraInfo{};
+        cameraInfo.buffer = this->cameraBuffer->getBuffer(currentFrame);
+        cameraInfo.offset = 0;
+        cameraInfo.range = this->cameraBuffer->getSize();
+
+        VkDescriptorBufferInfo instanceInfo{};
+        instanceInfo.buffer = this->instanceFrames[currentFrame].buffer;
+        instanceInfo.offset = 0;
+        instanceInfo.range = VK_WHOLE_SIZE;
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = set;
+        descriptorWrites[0].dstBinding = firstBinding;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &cameraInfo;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = set;
+        descriptorWrites[1].dstBinding = firstBinding + 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = &instanceInfo;
+
+        vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
     void DefaultPipeline::updateDescriptorSet(
         unsigned meshIndex,
         const Texture& texture,
-        const TextureSampler& textureSampler
+        const TextureSampler& textureSampler,
+        uint32_t material
     ) {
+        if(this->isBindless()) {
+            this->setTextureIndex(meshIndex, vk->bindlessTable->registerTexture(texture.getImageView(), textureSampler.getSampler()), material);
+            return;
+        }
+        if(this->isIndirect()) {
+            updateIndirectTexture(meshIndex, { texture.getImageView(), textureSampler.getSampler() }, material);
+            return;
+        }
+
         FLY_ASSERT(this->meshes[meshIndex].descriptorSets.size() == MAX_FRAMES_IN_FLIGHT, "Descriptor set vector bad size!");
+        FLY_ASSERT(material < this->meshes[meshIndex].vertexArray->getMaterialCount(), "Invalid material");
 
         for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
             VkDescriptorImageInfo imageInfo{};
@@ -39,7 +189,7 @@ namespace fly {
             std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
 
             descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = this->meshes[meshIndex].descriptorSets[i];
+            descriptorWrites[0].dstSet = this->meshes[meshIndex].getDescriptorSet(material, i);
             descriptorWrites[0].dstBinding = 0;
             descriptorWrites[0].dstArrayElement = 0;
             descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -50,98 +200,227 @@ namespace fly {
         }
     }
 
+    void DefaultPipeline::modelDetached(unsigned meshIndex, const MeshData&) {
+        if(auto node = this->materialSlots.extract(meshIndex)) {
+            for(auto slot: node.mapped()) {
+                if(slot != NO_SLOT)
+                    releaseTextureSlot(slot);
+            }
+        }
+    }
+
+    void DefaultPipeline::updateIndirectTexture(unsigned meshIndex, TextureKey key, uint32_t material) {
+        FLY_ASSERT(material < this->meshes.at(meshIndex).vertexArray->getMaterialCount(), "Invalid material");
+
+        if(!this->hasOwnDescriptorSets(this->meshes.at(meshIndex))) {
+            auto& materials = this->materialSlots[meshIndex];
+            materials.resize(this->meshes.at(meshIndex).vertexArray->getMaterialCount(), NO_SLOT);
+
+            //Acquired before the old one is released, so a texture set again keeps its slot
+            if(auto slot = acquireTextureSlot(key)) {
+                if(materials[material] != NO_SLOT)
+                    releaseTextureSlot(materials[material]);
+                materials[material] = *slot;
+                this->setTextureIndex(meshIndex, *slot, material);
+                return;
+            }
+            moveToOwnDescriptorSets(meshIndex, key);
+        }
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = key.first;
+        imageInfo.sampler = key.second;
+        writeMeshTextures(meshIndex, material, { imageInfo });
+    }
+
+    std::optional<uint32_t> DefaultPipeline::acquireTextureSlot(TextureKey key) {
+        if(auto it = this->textureSlots.find(key); it != this->textureSlots.end()) {
+            this->slots[it->second].users++;
+            return it->second;
+        }
+
+        auto free = std::find_if(this->slots.begin(), this->slots.end(), [](const TextureSlot& s) { return s.users == 0; });
+        if(free == this->slots.end())
+            return std::nullopt;
+
+        uint32_t slot = static_cast<uint32_t>(free - this->slots.begin());
+        //Every element of the array must be valid, so the first texture fills the empty slots
+        if(this->textureSlots.empty())
+            fillUnusedSlots(key);
+
+        *free = { key, 1 };
+        this->textureSlots[key] = slot;
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = key.first;
+        imageInfo.sampler = key.second;
+        this->writeSharedImage(0, slot, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfo);
+        return slot;
+    }
+
+    void DefaultPipeline::releaseTextureSlot(uint32_t slot) {
+        auto& textureSlot = this->slots[slot];
+        FLY_ASSERT(textureSlot.users > 0, "Texture slot released twice!");
+        if(--textureSlot.users > 0)
+            return;
+
+        //The texture may be destroyed, so the free slots get one still in use
+        this->textureSlots.erase(textureSlot.key);
+        auto live = std::find_if(this->slots.begin(), this->slots.end(), [](const TextureSlot& s) { return s.users > 0; });
+        if(live != this->slots.end())
+            fillUnusedSlots(live->key);
+    }
+
+    void DefaultPipeline::fillUnusedSlots(TextureKey key) {
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = key.first;
+        imageInfo.sampler = key.second;
+
+        for(uint32_t i=0; i<MAX_TEXTURES; ++i) {
+            if(this->slots[i].users == 0)
+                this->writeSharedImage(0, i, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfo);
+        }
+    }
+
+    //The array of the mesh set has the textures of its materials in order, the elements without one have the fallback
+    void DefaultPipeline::moveToOwnDescriptorSets(unsigned meshIndex, TextureKey fallback) {
+        uint32_t materialCount = this->meshes.at(meshIndex).vertexArray->getMaterialCount();
+        if(materialCount > MAX_TEXTURES)
+            throw std::runtime_error("too many materials in a mesh for the default pipeline!");
+
+        this->createOwnDescriptorSets(meshIndex);
+        auto materials = std::move(this->materialSlots.extract(meshIndex).mapped());
+
+        std::vector<VkDescriptorImageInfo> imageInfos(MAX_TEXTURES);
+        for(uint32_t i=0; i<MAX_TEXTURES; ++i) {
+            auto key = i < materials.size() && materials[i] != NO_SLOT? this->slots[materials[i]].key : fallback;
+            imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            imageInfos[i].imageView = key.first;
+            imageInfos[i].sampler = key.second;
+        }
+        writeMeshTextures(meshIndex, 0, imageInfos);
+
+        for(uint32_t material=0; material<materialCount; ++material)
+            this->setTextureIndex(meshIndex, material, material);
+        for(auto slot: materials) {
+            if(slot != NO_SLOT)
+                releaseTextureSlot(slot);
+        }
+    }
+
+    void DefaultPipeline::writeMeshTextures(unsigned meshIndex, uint32_t firstElement, const std::vector<VkDescriptorImageInfo>& imageInfos) {
+        for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
+            VkWriteDescriptorSet descriptorWrite{};
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet = this->meshes.at(meshIndex).getDescriptorSet(0, i);
+            descriptorWrite.dstBinding = 0;
+            descriptorWrite.dstArrayElement = firstElement;
+            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptorWrite.descriptorCount = static_cast<uint32_t>(imageInfos.size());
+            descriptorWrite.pImageInfo = imageInfos.data();
+            vkUpdateDescriptorSets(vk->device, 1, &descriptorWrite, 0, nullptr);
+        }
+    }
+
     DescriptorSetLayout DefaultPipeline::createDescriptorSetLayout() {
+        if(this->isBindless()) {
+            return newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT, {
+                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
+            }).build(vk);
+        }
+
+        if(this->isIndirect()) {
+            return newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT, {
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, MAX_TEXTURES},
+                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
+            }).build(vk);
+        }
+
         return newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT, {
-            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT}
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
         }).build(vk);
     }
 
 
     
     //VERTEX IMPLEMENTATION
-    VkVertexInputBindingDescription Vertex::getBindingDescription() {
-        VkVertexInputBindingDescription bindingDescription{};
-        bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(Vertex);
-        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-        return bindingDescription;
+    bool Vertex::operator==(const Vertex& other) const {
+        return pos == other.pos && normal == other.normal && texCoord == other.texCoord;
     }
-    
-    std::vector<VkVertexInputAttributeDescription> Vertex::getAttributeDescriptions() {
-        std::vector<VkVertexInputAttributeDescription> attributeDescriptions(3);
-        attributeDescriptions[0].binding = 0;
-        attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(Vertex, pos);
 
-        attributeDescriptions[1].binding = 0;
-        attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[1].offset = offsetof(Vertex, normal);
+    std::vector<PackedVertex> packVertices(const std::vector<Vertex>& vertices, VertexQuantization& quantization) {
+        if(vertices.empty())
+            return {};
 
-        attributeDescriptions[2].binding = 0;
-        attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+        glm::vec3 minPos = vertices[0].pos, maxPos = vertices[0].pos;
+        glm::vec2 minUv = vertices[0].texCoord, maxUv = vertices[0].texCoord;
+        for(const auto& v: vertices) {
+            minPos = glm::min(minPos, v.pos);
+            maxPos = glm::max(maxPos, v.pos);
+            minUv = glm::min(minUv, v.texCoord);
+            maxUv = glm::max(maxUv, v.texCoord);
+        }
 
-        return attributeDescriptions;
-    }
+        //A flat axis would divide by zero
+        quantization.center = (minPos + maxPos) * 0.5f;
+        quantization.extent = glm::max((maxPos - minPos) * 0.5f, glm::vec3(1e-6f));
+        quantization.texCoordOffset = minUv;
+        quantization.texCoordScale = glm::max(maxUv - minUv, glm::vec2(1e-6f));
 
-    bool Vertex::operator==(const Vertex& other) const {
-        return pos == other.pos && normal == other.normal && texCoord == other.texCoord;
+        std::vector<PackedVertex> packed(vertices.size());
+        for(size_t i=0; i<vertices.size(); ++i) {
+            glm::vec3 pos = (vertices[i].pos - quantization.center) / quantization.extent;
+            glm::vec2 normal = octahedralEncode(vertices[i].normal);
+            glm::vec2 uv = (vertices[i].texCoord - quantization.texCoordOffset) / quantization.texCoordScale;
+
+            packed[i].pos = { packSnorm16(pos.x), packSnorm16(pos.y), packSnorm16(pos.z), packSnorm16(1.0f) };
+            packed[i].normal = { packSnorm16(normal.x), packSnorm16(normal.y) };
+            packed[i].texCoord = { packUnorm16(uv.x), packUnorm16(uv.y) };
+        }
+        return packed;
     }
 
 
     //LOAD MODEL IMPLEMENTATION
     std::unique_ptr<VertexArray> loadModel(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, std::filesystem::path filepath) {
-        std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string warn, err;
-    
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.string().c_str())) {
-            throw std::runtime_error(warn + err);
-        }
-
-        
-        std::vector<Vertex> vertices;
-        std::vector<uint32_t> indices;
-        for(const auto& shape : shapes) {
-            for(const auto& index : shape.mesh.indices) {
-                Vertex vertex{};
-                
-                vertex.pos = {
-                    attrib.vertices[3 * index.vertex_index + 0],
-                    attrib.vertices[3 * index.vertex_index + 1],
-                    attrib.vertices[3 * index.vertex_index + 2]
-                };
-                
-                
-                vertex.normal = {
-                    attrib.normals[3 * index.normal_index + 0],
-                    attrib.normals[3 * index.normal_index + 1],
-                    attrib.normals[3 * index.normal_index + 2]
-                };
-
-                vertex.texCoord = {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-                };                
-                
-
-                if(uniqueVertices.count(vertex) == 0) {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
-                }
-        
-                indices.push_back(uniqueVertices[vertex]);
-            }
+        if(auto cache = MeshCache::open(filepath)) {
+            if(auto geometry = cache->getGeometry<PackedVertex>())
+                return std::make_unique<VertexArray>(vk, commandPool, *geometry);
         }
 
-        return std::make_unique<VertexArray>(vk, commandPool, std::move(vertices), std::move(indices));
+        auto [vertices, indices, submeshes, materials] = loadObj(filepath);
+
+        //The order of the OBJ faces is bad for the vertex cache and the vertices are in order of appearance. The meshlets start from this order
+        auto before = optimizeMesh(vertices, indices, submeshes).first;
+
+        VertexQuantization quantization;
+        auto packed = packVertices(vertices, quantization);
+
+        //Everything the vertex array would compute is built here, so the cache has it too
+        auto positions = decodePositions(packed, quantization);
+        size_t submeshCount = submeshes.size();
+        auto lods = computeLods(positions, indices, submeshes);
+        size_t fullIndexCount = lods.empty()? indices.size() : lods.front().indexCount;
+        auto meshlets = computeMeshlets(positions, indices, fullIndexCount, std::span(submeshes).first(submeshCount));
+
+        //The meshlets reorder the full level, so the vertices are numbered again in the order the final buffer uses them
+        optimizeVertexFetch(packed, indices);
+        auto after = analyzeVertexCache(indices.data(), fullIndexCount, static_cast<uint32_t>(packed.size()));
+        FLY_DEBUG_LOG("{}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}\n", filepath.filename().string(), before.acmr, after.acmr, before.atvr, after.atvr);
+
+        TMeshGeometry<PackedVertex> geometry{ packed, indices, lods, meshlets, submeshes, computeBounds(positions).value_or(BoundingSphere{}), quantization };
+
+        if(!MeshCache::write(filepath, geometry))
+            std::cout << std::format("{}: failed to write the mesh cache\n", filepath.filename().string());
+
+        return std::make_unique<VertexArray>(vk, commandPool, geometry);
     }
     
 
@@ -1,54 +1,163 @@
 #pragma once
 
 #include "../renderer/TGraphicsPipeline.hpp"
+#include "../renderer/TBuffer.hpp"
 #include "../renderer/TVertexArray.hpp"
+#include "../renderer/VertexFormat.hpp"
 #include "../renderer/Texture.hpp"
 
 #include "../Utils.hpp"
 
 #include <glm/glm.hpp>
 
+#include <array>
+#include <map>
+#include <optional>
+#include <unordered_map>
+
 static const char* const DEFAULT_FRAG_SHADER_SRC = "vulkan-engine/shaders/bin/default.frag.spv";
 static const char* const DEFAULT_VERT_SHADER_SRC = "vulkan-engine/shaders/bin/default.vert.spv";
+static const char* const DEFAULT_INDIRECT_FRAG_SHADER_SRC = "vulkan-engine/shaders/bin/default_indirect.frag.spv";
+static const char* const DEFAULT_INDIRECT_VERT_SHADER_SRC = "vulkan-engine/shaders/bin/default_indirect.vert.spv";
+static const char* const DEFAULT_BINDLESS_FRAG_SHADER_SRC = "vulkan-engine/shaders/bin/default_bindless.frag.spv";
+static const char* const DEFAULT_BINDLESS_VERT_SHADER_SRC = "vulkan-engine/shaders/bin/default_bindless.vert.spv";
+static const char* const DEFAULT_INDIRECT_BINDLESS_FRAG_SHADER_SRC = "vulkan-engine/shaders/bin/default_indirect_bindless.frag.spv";
+static const char* const DEFAULT_INDIRECT_BINDLESS_VERT_SHADER_SRC = "vulkan-engine/shaders/bin/default_indirect_bindless.vert.spv";
 
 namespace fly {
     
+    //How the packed vertices of the mesh are decoded, and where its instances start in the instance buffer
     struct PushDefault {
+        glm::vec4 positionCenter{0.0f}, positionExtent{1.0f}; //Only xyz are used
+        glm::vec4 texCoordTransform{0.0f, 0.0f, 1.0f, 1.0f}; //Offset in xy and scale in zw
+        uint32_t firstInstance = 0;
+
+        bool operator==(const PushDefault& other) const = default;
+    };
+
+    //The normal matrix is computed once on the CPU instead of per vertex. It is a mat4 so the layout is the same in std430
+    struct InstanceData {
         glm::mat4 model;
+        glm::mat4 normal;
+    };
+
+    struct CameraUniform {
         glm::mat4 projView;
     };
 
+    //The vertex as it is loaded, it is packed before going to the GPU
     struct Vertex {
         glm::vec3 pos;
         glm::vec3 normal;
         glm::vec2 texCoord;
     
-        static VkVertexInputBindingDescription getBindingDescription();
+        bool operator==(const Vertex& other) const;
+    };
+
+    //16 bytes instead of 32. The position is relative to the bounds of the mesh, w is always 1
+    struct PackedVertex {
+        Snorm16x4 pos;
+        Snorm16x2 normal; //Octahedral
+        Unorm16x2 texCoord; //Relative to the range of the mesh
     
-        static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+        static constexpr VkVertexInputBindingDescription getBindingDescription() { return makeBindingDescription<PackedVertex>(); }
     
-        bool operator==(const Vertex& other) const;
+        static constexpr auto getAttributeDescriptions() {
+            return makeAttributeDescriptions({
+                FLY_VERTEX_ATTRIBUTE(PackedVertex, pos),
+                FLY_VERTEX_ATTRIBUTE(PackedVertex, normal),
+                FLY_VERTEX_ATTRIBUTE(PackedVertex, texCoord)
+            });
+        }
+
+        glm::vec3 decodePosition(const VertexQuantization& quantization) const {
+            return quantization.center + glm::vec3(unpackSnorm16(pos.x), unpackSnorm16(pos.y), unpackSnorm16(pos.z)) * quantization.extent;
+        }
     };
 
-    class DefaultPipeline: public TGraphicsPipeline<Vertex, PushDefault> {
+    //The quantization is computed from the bounds of the vertices
+    std::vector<PackedVertex> packVertices(const std::vector<Vertex>& vertices, VertexQuantization& quantization);
+
+    class DefaultPipeline: public TGraphicsPipeline<PackedVertex, PushDefault> {
     public:
-        DefaultPipeline(std::shared_ptr<VulkanInstance> vk): TGraphicsPipeline{vk, DEPTH_TEST_ENABLED | DEFERRED_ENABLED | BACK_CULLING_ENABLED} {}
-        ~DefaultPipeline() = default;
+        //Size of the texture array of the indirect path without the bindless table, must match default_indirect.frag
+        //The meshes whose textures don't fit get a set of their own, with the same array for their materials
+        static constexpr uint32_t MAX_TEXTURES = 64;
+
+        DefaultPipeline(std::shared_ptr<VulkanInstance> vk);
+        ~DefaultPipeline();
     
+        //The texture of a material slot of the mesh
         void updateDescriptorSet(
             unsigned meshIndex,
             const Texture& texture,
-            const TextureSampler& textureSampler
+            const TextureSampler& textureSampler,
+            uint32_t material = 0
         );
 
+        //Every instance of the mesh is drawn with one call. The camera is the one of setCamera, so it must be set every frame
+        void setInstances(unsigned meshIndex, const std::vector<glm::mat4>& models);
+        void setModel(unsigned meshIndex, const glm::mat4& model) { setInstances(meshIndex, {model}); }
+
+        void prepareFrame(uint32_t currentFrame) override;
+
     private:
-        std::vector<char> getVertShaderCode() override { return readFile(DEFAULT_VERT_SHADER_SRC); }
-        std::vector<char> getFragShaderCode() override { return readFile(DEFAULT_FRAG_SHADER_SRC); }
+        //TEXTURE SLOTS of the array in the shared set of the indirect path without the bindless table
+        //A slot is freed when no material uses its texture, the handles of a destroyed texture may be reused by a new one
+        using TextureKey = std::pair<VkImageView, VkSampler>;
+        struct TextureSlot { TextureKey key; uint32_t users = 0; };
+        static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+        std::map<TextureKey, uint32_t> textureSlots;
+        std::array<TextureSlot, MAX_TEXTURES> slots;
+        std::unordered_map<unsigned, std::vector<uint32_t>> materialSlots; //Of the meshes using the shared set, NO_SLOT without texture
+
+        //INSTANCES, all the meshes share a buffer per frame that is only written again when they change
+        struct InstanceFrame {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VmaAllocation alloc = VK_NULL_HANDLE;
+            VmaAllocationInfo info{};
+            size_t capacity = 0; //In instances
+            bool dirty = true;
+            VkBuffer boundBuffer = VK_NULL_HANDLE; //The one in the shared set of the indirect path
+        };
+
+        std::unique_ptr<TBuffer<CameraUniform>> cameraBuffer;
+        std::unordered_map<unsigned, std::vector<InstanceData>> instances;
+        std::vector<InstanceData> packedInstances;
+        bool instancesMoved = true; //The meshes have to be packed again
+        std::array<InstanceFrame, MAX_FRAMES_IN_FLIGHT> instanceFrames;
+        std::unordered_map<unsigned, std::array<VkBuffer, MAX_FRAMES_IN_FLIGHT>> boundMeshBuffers; //The ones in the set of each mesh in the direct path
+
+        void packInstances();
+        void reserveInstances(InstanceFrame& frame, size_t instanceCount);
+        void writeInstanceSet(VkDescriptorSet set, uint32_t currentFrame);
+
+        std::vector<char> getVertShaderCode() override { 
+            if(this->isBindless())
+                return readFile(this->isIndirect()? DEFAULT_INDIRECT_BINDLESS_VERT_SHADER_SRC : DEFAULT_BINDLESS_VERT_SHADER_SRC);
+            return readFile(this->isIndirect()? DEFAULT_INDIRECT_VERT_SHADER_SRC : DEFAULT_VERT_SHADER_SRC); 
+        }
+        std::vector<char> getFragShaderCode() override { 
+            if(this->isBindless())
+                return readFile(this->isIndirect()? DEFAULT_INDIRECT_BINDLESS_FRAG_SHADER_SRC : DEFAULT_BINDLESS_FRAG_SHADER_SRC);
+            return readFile(this->isIndirect()? DEFAULT_INDIRECT_FRAG_SHADER_SRC : DEFAULT_FRAG_SHADER_SRC); 
+        }
         DescriptorSetLayout createDescriptorSetLayout() override;
+        std::optional<glm::mat4> getModelMatrix(unsigned meshIndex, const MeshData& mesh) const override;
+        void modelDetached(unsigned meshIndex, const MeshData& mesh) override;
+
+        void updateIndirectTexture(unsigned meshIndex, TextureKey key, uint32_t material);
+        std::optional<uint32_t> acquireTextureSlot(TextureKey key);
+        void releaseTextureSlot(uint32_t slot);
+        void fillUnusedSlots(TextureKey key);
+        void moveToOwnDescriptorSets(unsigned meshIndex, TextureKey fallback);
+        void writeMeshTextures(unsigned meshIndex, uint32_t firstElement, const std::vector<VkDescriptorImageInfo>& imageInfos);
 
     };
 
-    using VertexArray = TVertexArray<Vertex>;
+    using VertexArray = TVertexArray<PackedVertex>;
+    //The faces of each usemtl of the OBJ are a submesh, their material slots are numbered in the order they are first used
     std::unique_ptr<VertexArray> loadModel(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, std::filesystem::path filepath);
 
 }
@@ -0,0 +1,315 @@
+#include "GlbLoader.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string_view>
+
+namespace fly {
+
+    static constexpr uint32_t GLB_MAGIC = 0x46546C67; //glTF
+    static constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+    static constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;
+    static constexpr uint32_t GLB_MAX_NODE_DEPTH = 64; //A malformed file can have cycles
+
+    static constexpr uint32_t GLTF_BYTE = 5120;
+    static constexpr uint32_t GLTF_UNSIGNED_BYTE = 5121;
+    static constexpr uint32_t GLTF_SHORT = 5122;
+    static constexpr uint32_t GLTF_UNSIGNED_SHORT = 5123;
+    static constexpr uint32_t GLTF_UNSIGNED_INT = 5125;
+    static constexpr uint32_t GLTF_FLOAT = 5126;
+    static constexpr uint32_t GLTF_TRIANGLES = 4;
+
+    using json = nlohmann::json;
+
+    static uint32_t componentSize(uint32_t componentType) {
+        switch(componentType) {
+        case GLTF_BYTE: case GLTF_UNSIGNED_BYTE: return 1;
+        case GLTF_SHORT: case GLTF_UNSIGNED_SHORT: return 2;
+        case GLTF_UNSIGNED_INT: case GLTF_FLOAT: return 4;
+        default: throw std::runtime_error("failed to load glb, unknown component type!");
+        }
+    }
+
+    static uint32_t typeComponents(const std::string& type) {
+        if(type == "SCALAR") return 1;
+        if(type == "VEC2") return 2;
+        if(type == "VEC3") return 3;
+        if(type == "VEC4") return 4;
+        throw std::runtime_error("failed to load glb, unsupported accessor type " + type + "!");
+    }
+
+    template<typename T>
+    static T readRaw(const std::byte* p) {
+        T value;
+        memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    //A strided view of an accessor in the binary chunk, interleaved or not
+    struct GlbAccessor {
+        const std::byte* data;
+        size_t count, stride;
+        uint32_t componentType, components;
+        bool normalized;
+
+        //The normalized integers are converted like the vertex input would
+        float read(size_t element, uint32_t component) const {
+            const std::byte* p = this->data + element * this->stride + component * componentSize(this->componentType);
+            switch(this->componentType) {
+            case GLTF_FLOAT: return readRaw<float>(p);
+            case GLTF_BYTE: return this->normalized? std::max(readRaw<int8_t>(p) / 127.0f, -1.0f) : readRaw<int8_t>(p);
+            case GLTF_UNSIGNED_BYTE: return this->normalized? readRaw<uint8_t>(p) / 255.0f : readRaw<uint8_t>(p);
+            case GLTF_SHORT: return this->normalized? std::max(readRaw<int16_t>(p) / 32767.0f, -1.0f) : readRaw<int16_t>(p);
+            case GLTF_UNSIGNED_SHORT: return this->normalized? readRaw<uint16_t>(p) / 65535.0f : readRaw<uint16_t>(p);
+            default: return static_cast<float>(readRaw<uint32_t>(p));
+            }
+        }
+
+        uint32_t readIndex(size_t element) const {
+            const std::byte* p = this->data + element * this->stride;
+            switch(this->componentType) {
+            case GLTF_UNSIGNED_BYTE: return readRaw<uint8_t>(p);
+            case GLTF_UNSIGNED_SHORT: return readRaw<uint16_t>(p);
+            case GLTF_UNSIGNED_INT: return readRaw<uint32_t>(p);
+            default: throw std::runtime_error("failed to load glb, indices must be unsigned integers!");
+            }
+        }
+    };
+
+    static const json& getArray(const json& object, const char* key) {
+        static const json empty = json::array();
+        auto it = object.find(key);
+        return it != object.end() && it->is_array()? *it : empty;
+    }
+
+    static std::span<const std::byte> getBufferView(const json& gltf, std::span<const std::byte> bin, size_t index) {
+        const auto& view = gltf.at("bufferViews").at(index);
+        if(view.value("buffer", 0u) != 0)
+            throw std::runtime_error("failed to load glb, only the binary chunk can be a buffer!");
+
+        size_t offset = view.value("byteOffset", size_t(0)), length = view.at("byteLength").get<size_t>();
+        if(offset > bin.size() || length > bin.size() - offset)
+            throw std::runtime_error("failed to load glb, buffer view out of the binary chunk!");
+        return bin.subspan(offset, length);
+    }
+
+    static GlbAccessor getAccessor(const json& gltf, std::span<const std::byte> bin, size_t index) {
+        const auto& accessor = gltf.at("accessors").at(index);
+        if(accessor.contains("sparse") || !accessor.contains("bufferView"))
+            throw std::runtime_error("failed to load glb, sparse and empty accessors aren't supported!");
+
+        GlbAccessor result{};
+        result.componentType = accessor.at("componentType").get<uint32_t>();
+        result.components = typeComponents(accessor.at("type").get<std::string>());
+        result.count = accessor.at("count").get<size_t>();
+        result.normalized = accessor.value("normalized", false);
+
+        auto view = getBufferView(gltf, bin, accessor.at("bufferView").get<size_t>());
+        size_t elementSize = componentSize(result.componentType) * result.components;
+        size_t offset = accessor.value("byteOffset", size_t(0));
+        result.stride = gltf.at("bufferViews").at(accessor.at("bufferView").get<size_t>()).value("byteStride", elementSize);
+        if(result.count > 0 && (offset > view.size() || (result.count - 1) * result.stride + elementSize > view.size() - offset))
+            throw std::runtime_error("failed to load glb, accessor out of its buffer view!");
+
+        result.data = view.data() + offset;
+        return result;
+    }
+
+    static std::optional<uint32_t> getBaseColorImage(const json& gltf, std::optional<size_t> materialIndex) {
+        if(!materialIndex)
+            return std::nullopt;
+
+        const auto& material = gltf.at("materials").at(*materialIndex);
+        auto pbr = material.find("pbrMetallicRoughness");
+        if(pbr == material.end() || !pbr->contains("baseColorTexture"))
+            return std::nullopt;
+
+        const auto& texture = gltf.at("textures").at(pbr->at("baseColorTexture").at("index").get<size_t>());
+        if(!texture.contains("source"))
+            return std::nullopt;
+        return texture.at("source").get<uint32_t>();
+    }
+
+    static GlbMesh loadMesh(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, const json& gltf, std::span<const std::byte> bin, const json& mesh) {
+        GlbMesh result;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<Submesh> submeshes;
+        std::map<std::optional<size_t>, uint32_t> slots; //Of each glTF material
+        std::span<const uint32_t> mappedIndices; //Used as they are when the mesh has a single primitive with 32-bit indices
+        glm::vec3 minPos(std::numeric_limits<float>::max()), maxPos(std::numeric_limits<float>::lowest());
+
+        const auto& primitives = mesh.at("primitives");
+        for(const auto& primitive: primitives) {
+            if(primitive.value("mode", GLTF_TRIANGLES) != GLTF_TRIANGLES)
+                continue;
+
+            //VERTICES, the attributes that aren't there are zero
+            const auto& attributes = primitive.at("attributes");
+            auto positions = getAccessor(gltf, bin, attributes.at("POSITION").get<size_t>());
+            std::optional<GlbAccessor> normals, texCoords;
+            if(attributes.contains("NORMAL"))
+                normals = getAccessor(gltf, bin, attributes.at("NORMAL").get<size_t>());
+            if(attributes.contains("TEXCOORD_0"))
+                texCoords = getAccessor(gltf, bin, attributes.at("TEXCOORD_0").get<size_t>());
+            if(positions.components != 3 || (normals && (normals->components != 3 || normals->count != positions.count))
+                || (texCoords && (texCoords->components != 2 || texCoords->count != positions.count)))
+                throw std::runtime_error("failed to load glb, the attributes of a primitive don't match!");
+
+            uint32_t vertexBase = static_cast<uint32_t>(vertices.size());
+            vertices.resize(vertexBase + positions.count);
+            for(size_t i=0; i<positions.count; ++i) {
+                auto& v = vertices[vertexBase + i];
+                v.pos = { positions.read(i, 0), positions.read(i, 1), positions.read(i, 2) };
+                if(normals)
+                    v.normal = { normals->read(i, 0), normals->read(i, 1), normals->read(i, 2) };
+                if(texCoords)
+                    v.texCoord = { texCoords->read(i, 0), texCoords->read(i, 1) };
+                minPos = glm::min(minPos, v.pos);
+                maxPos = glm::max(maxPos, v.pos);
+            }
+
+            //INDICES, a primitive without them draws its vertices in order
+            std::optional<size_t> material;
+            if(primitive.contains("material"))
+                material = primitive.at("material").get<size_t>();
+            auto [slot, inserted] = slots.try_emplace(material, static_cast<uint32_t>(result.materialImages.size()));
+            if(inserted)
+                result.materialImages.push_back(getBaseColorImage(gltf, material));
+
+            Submesh range{ static_cast<uint32_t>(indices.size()), 0, slot->second };
+            if(primitive.contains("indices")) {
+                auto accessor = getAccessor(gltf, bin, primitive.at("indices").get<size_t>());
+                bool mappable = primitives.size() == 1 && accessor.componentType == GLTF_UNSIGNED_INT && accessor.stride == sizeof(uint32_t)
+                    && reinterpret_cast<uintptr_t>(accessor.data) % alignof(uint32_t) == 0;
+                if(mappable) {
+                    mappedIndices = { reinterpret_cast<const uint32_t*>(accessor.data), accessor.count };
+                    if(std::any_of(mappedIndices.begin(), mappedIndices.end(), [&](uint32_t i) { return i >= positions.count; }))
+                        throw std::runtime_error("failed to load glb, index out of range!");
+                } else {
+                    indices.reserve(indices.size() + accessor.count);
+                    for(size_t i=0; i<accessor.count; ++i) {
+                        uint32_t index = accessor.readIndex(i);
+                        if(index >= positions.count)
+                            throw std::runtime_error("failed to load glb, index out of range!");
+                        indices.push_back(vertexBase + index);
+                    }
+                }
+                range.indexCount = static_cast<uint32_t>(accessor.count);
+            } else {
+                for(uint32_t i=0; i<positions.count; ++i)
+                    indices.push_back(vertexBase + i);
+                range.indexCount = static_cast<uint32_t>(positions.count);
+            }
+            submeshes.push_back(range);
+        }
+
+        if(vertices.empty())
+            return result;
+
+        //The sphere around the box is a bit larger than the tightest one, but it doesn't need another pass over the vertices
+        VertexQuantization quantization;
+        auto packed = packVertices(vertices, quantization);
+        BoundingSphere bounds{ (minPos + maxPos) * 0.5f, glm::distance(minPos, maxPos) * 0.5f };
+        TMeshGeometry<PackedVertex> geometry{ packed, mappedIndices.empty()? std::span<const uint32_t>(indices) : mappedIndices, {}, {}, submeshes, bounds, quantization };
+        result.vertexArray = std::make_unique<VertexArray>(vk, commandPool, geometry);
+        return result;
+    }
+
+    static void addInstances(const json& gltf, const json& nodes, const glm::mat4& parent, uint32_t depth, GlbModel& model) {
+        if(depth > GLB_MAX_NODE_DEPTH)
+            throw std::runtime_error("failed to load glb, the node hierarchy is too deep!");
+
+        for(const auto& index: nodes) {
+            const auto& node = gltf.at("nodes").at(index.get<size_t>());
+            glm::mat4 local(1.0f);
+            if(node.contains("matrix")) {
+                auto matrix = node.at("matrix").get<std::vector<float>>();
+                if(matrix.size() == 16)
+                    local = glm::make_mat4(matrix.data());
+            } else {
+                auto t = node.value("translation", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+                auto r = node.value("rotation", std::vector<float>{ 0.0f, 0.0f, 0.0f, 1.0f });
+                auto s = node.value("scale", std::vector<float>{ 1.0f, 1.0f, 1.0f });
+                if(t.size() != 3 || r.size() != 4 || s.size() != 3)
+                    throw std::runtime_error("failed to load glb, bad node transform!");
+
+                local = glm::translate(local, glm::vec3(t[0], t[1], t[2]));
+                local *= glm::mat4_cast(glm::quat(r[3], r[0], r[1], r[2]));
+                local = glm::scale(local, glm::vec3(s[0], s[1], s[2]));
+            }
+
+            glm::mat4 world = parent * local;
+            if(node.contains("mesh")) {
+                uint32_t mesh = node.at("mesh").get<uint32_t>();
+                if(mesh >= model.meshes.size())
+                    throw std::runtime_error("failed to load glb, node with a mesh out of range!");
+                model.instances.push_back({ mesh, world });
+            }
+            addInstances(gltf, getArray(node, "children"), world, depth + 1, model);
+        }
+    }
+
+
+    //LOAD GLB IMPLEMENTATION
+    GlbModel loadGlb(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, const std::filesystem::path& path) {
+        GlbModel model;
+        model.file = MappedFile::open(path);
+        if(!model.file)
+            throw std::runtime_error("failed to open glb file " + path.string() + "!");
+
+        //HEADER and the chunks, the json one always goes first
+        auto data = model.file->getData();
+        if(data.size() < 20 || readRaw<uint32_t>(data.data()) != GLB_MAGIC || readRaw<uint32_t>(data.data() + 4) != 2)
+            throw std::runtime_error("failed to load glb, it isn't binary glTF 2.0!");
+
+        size_t jsonLength = readRaw<uint32_t>(data.data() + 12);
+        if(readRaw<uint32_t>(data.data() + 16) != GLB_CHUNK_JSON || jsonLength > data.size() - 20)
+            throw std::runtime_error("failed to load glb, bad json chunk!");
+        std::string_view jsonText(reinterpret_cast<const char*>(data.data() + 20), jsonLength);
+
+        std::span<const std::byte> bin;
+        size_t binStart = 20 + jsonLength;
+        if(data.size() >= binStart + 8 && readRaw<uint32_t>(data.data() + binStart + 4) == GLB_CHUNK_BIN) {
+            size_t binLength = readRaw<uint32_t>(data.data() + binStart);
+            if(binLength > data.size() - binStart - 8)
+                throw std::runtime_error("failed to load glb, bad binary chunk!");
+            bin = data.subspan(binStart + 8, binLength);
+        }
+
+        try {
+            auto gltf = json::parse(jsonText.begin(), jsonText.end());
+
+            for(const auto& image: getArray(gltf, "images")) {
+                GlbImage result;
+                if(image.contains("bufferView")) {
+                    result.data = getBufferView(gltf, bin, image.at("bufferView").get<size_t>());
+                    result.mimeType = image.value("mimeType", "");
+                }
+                model.images.push_back(std::move(result));
+            }
+
+            for(const auto& mesh: getArray(gltf, "meshes"))
+                model.meshes.push_back(loadMesh(vk, commandPool, gltf, bin, mesh));
+
+            const auto& scenes = getArray(gltf, "scenes");
+            size_t scene = gltf.value("scene", size_t(0));
+            if(scene < scenes.size())
+                addInstances(gltf, getArray(scenes[scene], "nodes"), glm::mat4(1.0f), 0, model);
+        } catch(const json::exception& e) {
+            throw std::runtime_error(std::string("failed to parse glb json, ") + e.what() + "!");
+        }
+
+        return model;
+    }
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "DefaultPipeline.hpp"
+#include "../renderer/MeshCache.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace fly {
+
+    //Each primitive is a submesh of the vertex array, the ones with the same glTF material share the slot
+    struct GlbMesh {
+        std::unique_ptr<VertexArray> vertexArray;
+        std::vector<std::optional<uint32_t>> materialImages; //Base colour of each material slot, in GlbModel::images
+    };
+
+    //Still encoded. The images with an uri instead of a buffer view are empty
+    struct GlbImage {
+        std::span<const std::byte> data; //Points into the mapped file
+        std::string mimeType;
+    };
+
+    struct GlbInstance {
+        uint32_t mesh;
+        glm::mat4 model; //World transform of the node
+    };
+
+    struct GlbModel {
+        std::vector<GlbMesh> meshes;
+        std::vector<GlbImage> images;
+        std::vector<GlbInstance> instances; //Every node with a mesh in the default scene
+        std::unique_ptr<MappedFile> file; //The images point into it
+    };
+
+    /*
+    Loads the meshes of a binary glTF 2.0 from its mapping. The primitives of each mesh share one vertex array and the indices
+    are read straight from the binary chunk when a mesh has a single primitive with 32-bit indices. The vertices are only packed,
+    nothing is merged or simplified, so the exporter should have optimized them. Only the triangle primitives are loaded
+    */
+    GlbModel loadGlb(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, const std::filesystem::path& path);
+
+}
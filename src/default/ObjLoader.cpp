@@ -0,0 +1,409 @@
+#include "ObjLoader.hpp"
+
+#include "../renderer/MeshCache.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+namespace fly {
+
+    //VERTEX TABLE, open addressing with linear probing
+    static uint32_t vertexWord(float f) { return std::bit_cast<uint32_t>(f + 0.0f); } //-0 and 0 are the same vertex
+
+    static uint64_t hashVertex(const Vertex& v) {
+        const float words[8] = { v.pos.x, v.pos.y, v.pos.z, v.normal.x, v.normal.y, v.normal.z, v.texCoord.x, v.texCoord.y };
+        uint64_t hash = 0x9E3779B97F4A7C15ull;
+        for(float w: words) {
+            hash ^= vertexWord(w);
+            hash *= 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 32;
+        }
+        //Finalizer of MurmurHash3, so the low bits depend on every word
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static bool sameVertex(const Vertex& a, const Vertex& b) {
+        return vertexWord(a.pos.x) == vertexWord(b.pos.x) && vertexWord(a.pos.y) == vertexWord(b.pos.y) && vertexWord(a.pos.z) == vertexWord(b.pos.z)
+            && vertexWord(a.normal.x) == vertexWord(b.normal.x) && vertexWord(a.normal.y) == vertexWord(b.normal.y) && vertexWord(a.normal.z) == vertexWord(b.normal.z)
+            && vertexWord(a.texCoord.x) == vertexWord(b.texCoord.x) && vertexWord(a.texCoord.y) == vertexWord(b.texCoord.y);
+    }
+
+    class VertexTable {
+    public:
+        std::vector<Vertex> vertices; //In order of insertion
+
+        explicit VertexTable(size_t expected) {
+            this->vertices.reserve(expected);
+            rehash(std::bit_ceil(std::max<size_t>(expected * 2, 16)));
+        }
+
+        uint32_t insert(const Vertex& vertex) {
+            if((this->vertices.size() + 1) * 2 > this->slots.size())
+                rehash(this->slots.size() * 2);
+
+            uint64_t hash = hashVertex(vertex);
+            size_t mask = this->slots.size() - 1;
+            for(size_t i = hash & mask;; i = (i + 1) & mask) {
+                auto& slot = this->slots[i];
+                if(slot.index == EMPTY) {
+                    slot = { static_cast<uint32_t>(this->vertices.size()), static_cast<uint32_t>(hash >> 32) };
+                    this->vertices.push_back(vertex);
+                    return slot.index;
+                }
+                if(slot.tag == static_cast<uint32_t>(hash >> 32) && sameVertex(this->vertices[slot.index], vertex))
+                    return slot.index;
+            }
+        }
+
+    private:
+        static constexpr uint32_t EMPTY = ~0u;
+
+        struct Slot {
+            uint32_t index = EMPTY;
+            uint32_t tag = 0; //High bits of the hash, most of the different vertices are rejected without reading them
+        };
+        std::vector<Slot> slots;
+
+        void rehash(size_t capacity) {
+            this->slots.assign(capacity, Slot{});
+            size_t mask = capacity - 1;
+            for(uint32_t v=0; v<this->vertices.size(); ++v) {
+                uint64_t hash = hashVertex(this->vertices[v]);
+                size_t i = hash & mask;
+                while(this->slots[i].index != EMPTY)
+                    i = (i + 1) & mask;
+                this->slots[i] = { v, static_cast<uint32_t>(hash >> 32) };
+            }
+        }
+    };
+
+
+    //PARSING
+    struct ObjChunk {
+        std::string_view text; //Whole lines
+
+        //FIRST PASS, the attributes of the chunk and how many come before it
+        std::vector<glm::vec3> positions, normals;
+        std::vector<glm::vec2> texCoords;
+        size_t faceCount = 0;
+        size_t positionBase = 0, normalBase = 0, texCoordBase = 0;
+
+        //SECOND PASS, the triangles with the vertices merged in the chunk
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<std::pair<size_t, std::string_view>> materials; //Index where each usemtl of the chunk starts, the first faces use the one of the chunk before
+        size_t indexBase = 0;
+    };
+
+    enum class ObjLine { POSITION, NORMAL, TEX_COORD, FACE, MATERIAL, OTHER };
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static const char* skipSpaces(const char* p, const char* end) {
+        while(p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    //The keyword is skipped
+    static ObjLine lineType(const char*& p, const char* end) {
+        p = skipSpaces(p, end);
+        if(end - p < 2)
+            return ObjLine::OTHER;
+
+        if(p[0] == 'f' && isSpace(p[1])) {
+            p += 2;
+            return ObjLine::FACE;
+        }
+        if(end - p > 6 && std::string_view(p, 6) == "usemtl" && isSpace(p[6])) {
+            p += 7;
+            return ObjLine::MATERIAL;
+        }
+        if(p[0] != 'v')
+            return ObjLine::OTHER;
+        if(isSpace(p[1])) {
+            p += 2;
+            return ObjLine::POSITION;
+        }
+        if(end - p >= 3 && isSpace(p[2]) && (p[1] == 'n' || p[1] == 't')) {
+            auto type = p[1] == 'n'? ObjLine::NORMAL : ObjLine::TEX_COORD;
+            p += 3;
+            return type;
+        }
+        return ObjLine::OTHER;
+    }
+
+    //The missing components are zero, like in tinyobjloader
+    template<size_t N>
+    static void parseFloats(const char* p, const char* end, float (&values)[N]) {
+        std::fill(std::begin(values), std::end(values), 0.0f);
+        for(auto& value: values) {
+            p = skipSpaces(p, end);
+            if(p < end && *p == '+')
+                p++;
+            auto [next, ec] = std::from_chars(p, end, value);
+            if(ec != std::errc())
+                return;
+            p = next;
+        }
+    }
+
+    template<typename F>
+    static void forEachLine(std::string_view text, F&& f) {
+        const char* p = text.data();
+        const char* end = text.data() + text.size();
+        while(p < end) {
+            const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+            if(!lineEnd)
+                lineEnd = end;
+            f(p, lineEnd);
+            p = lineEnd + 1;
+        }
+    }
+
+    static void parseAttributes(ObjChunk& chunk) {
+        forEachLine(chunk.text, [&](const char* p, const char* end) {
+            float values[3];
+            switch(lineType(p, end)) {
+            case ObjLine::POSITION:
+                parseFloats(p, end, values);
+                chunk.positions.emplace_back(values[0], values[1], values[2]);
+                break;
+            case ObjLine::NORMAL:
+                parseFloats(p, end, values);
+                chunk.normals.emplace_back(values[0], values[1], values[2]);
+                break;
+            case ObjLine::TEX_COORD:
+                parseFloats(p, end, values);
+                chunk.texCoords.emplace_back(values[0], values[1]);
+                break;
+            case ObjLine::FACE:
+                chunk.faceCount++;
+                break;
+            case ObjLine::MATERIAL:
+            case ObjLine::OTHER:
+                break;
+            }
+        });
+    }
+
+    //OBJ indices start at 1, and the negative ones count back from the last attribute defined before the face
+    static int64_t resolveIndex(int64_t index, size_t definedSoFar, size_t total) {
+        int64_t resolved = index > 0? index - 1 : static_cast<int64_t>(definedSoFar) + index;
+        if(index == 0 || resolved < 0 || resolved >= static_cast<int64_t>(total))
+            throw std::runtime_error("failed to parse OBJ face, index out of range!");
+        return resolved;
+    }
+
+    struct ObjAttributes {
+        std::vector<glm::vec3> positions, normals;
+        std::vector<glm::vec2> texCoords;
+    };
+
+    static void parseFaces(ObjChunk& chunk, const ObjAttributes& attributes) {
+        VertexTable table(chunk.faceCount);
+        chunk.indices.reserve(chunk.faceCount * 3);
+
+        size_t positionCount = chunk.positionBase, normalCount = chunk.normalBase, texCoordCount = chunk.texCoordBase;
+        std::vector<uint32_t> polygon;
+        forEachLine(chunk.text, [&](const char* p, const char* end) {
+            switch(lineType(p, end)) {
+            case ObjLine::POSITION: positionCount++; return;
+            case ObjLine::NORMAL: normalCount++; return;
+            case ObjLine::TEX_COORD: texCoordCount++; return;
+            case ObjLine::OTHER: return;
+            case ObjLine::MATERIAL: {
+                p = skipSpaces(p, end);
+                const char* nameEnd = end;
+                while(nameEnd > p && isSpace(nameEnd[-1]))
+                    nameEnd--;
+                chunk.materials.emplace_back(chunk.indices.size(), std::string_view(p, nameEnd - p));
+                return;
+            }
+            case ObjLine::FACE: break;
+            }
+
+            //Each corner is v, v/vt, v//vn or v/vt/vn
+            polygon.clear();
+            while((p = skipSpaces(p, end)) < end) {
+                int64_t v = 0, vt = 0, vn = 0;
+                auto [next, ec] = std::from_chars(p, end, v);
+                if(ec != std::errc())
+                    throw std::runtime_error("failed to parse OBJ face!");
+                p = next;
+                if(p < end && *p == '/') {
+                    p++;
+                    if(p < end && *p != '/')
+                        p = std::from_chars(p, end, vt).ptr;
+                    if(p < end && *p == '/')
+                        p = std::from_chars(p + 1, end, vn).ptr;
+                }
+
+                Vertex vertex{};
+                vertex.pos = attributes.positions[resolveIndex(v, positionCount, attributes.positions.size())];
+                if(vn != 0)
+                    vertex.normal = attributes.normals[resolveIndex(vn, normalCount, attributes.normals.size())];
+                if(vt != 0) {
+                    auto uv = attributes.texCoords[resolveIndex(vt, texCoordCount, attributes.texCoords.size())];
+                    vertex.texCoord = { uv.x, 1.0f - uv.y };
+                }
+                polygon.push_back(table.insert(vertex));
+            }
+
+            for(size_t i=2; i<polygon.size(); ++i)
+                chunk.indices.insert(chunk.indices.end(), { polygon[0], polygon[i - 1], polygon[i] });
+        });
+
+        chunk.vertices = std::move(table.vertices);
+    }
+
+    //Runs f on every chunk at the same time
+    template<typename F>
+    static void forEachChunk(std::vector<ObjChunk>& chunks, F&& f) {
+        std::vector<std::future<void>> tasks;
+        tasks.reserve(chunks.size());
+        for(auto& chunk: chunks)
+            tasks.push_back(std::async(std::launch::async, [&f, &chunk] { f(chunk); }));
+        for(auto& task: tasks)
+            task.get();
+    }
+
+
+    //MATERIALS, the runs of faces with the same material are found in order and then the ones of each material are put together
+    struct ObjRun { size_t firstIndex, indexCount; uint32_t material; };
+
+    static void groupMaterials(ObjMesh& mesh, const std::vector<ObjChunk>& chunks) {
+        std::unordered_map<std::string_view, uint32_t> slots;
+        std::vector<ObjRun> runs;
+        std::string_view current;
+        auto addRun = [&](size_t firstIndex, size_t indexCount) {
+            if(indexCount == 0)
+                return;
+
+            auto [it, inserted] = slots.try_emplace(current, static_cast<uint32_t>(mesh.materials.size()));
+            if(inserted)
+                mesh.materials.emplace_back(current);
+            if(!runs.empty() && runs.back().material == it->second)
+                runs.back().indexCount += indexCount;
+            else
+                runs.push_back({ firstIndex, indexCount, it->second });
+        };
+
+        for(const auto& chunk: chunks) {
+            size_t start = 0;
+            for(auto [index, name]: chunk.materials) {
+                addRun(chunk.indexBase + start, index - start);
+                start = index;
+                current = name;
+            }
+            addRun(chunk.indexBase + start, chunk.indices.size() - start);
+        }
+        if(mesh.materials.size() <= 1)
+            return;
+
+        std::vector<uint32_t> grouped;
+        grouped.reserve(mesh.indices.size());
+        for(uint32_t material=0; material<mesh.materials.size(); ++material) {
+            size_t firstIndex = grouped.size();
+            for(const auto& run: runs) {
+                if(run.material == material)
+                    grouped.insert(grouped.end(), mesh.indices.begin() + run.firstIndex, mesh.indices.begin() + run.firstIndex + run.indexCount);
+            }
+            mesh.submeshes.push_back({ static_cast<uint32_t>(firstIndex), static_cast<uint32_t>(grouped.size() - firstIndex), material });
+        }
+        mesh.indices = std::move(grouped);
+    }
+
+
+    //LOAD OBJ IMPLEMENTATION
+    ObjMesh loadObj(const std::filesystem::path& path) {
+        auto file = MappedFile::open(path);
+        if(!file)
+            throw std::runtime_error("failed to open OBJ file " + path.string() + "!");
+
+        //CHUNKS of whole lines, one per thread
+        auto data = file->getData();
+        std::string_view text(reinterpret_cast<const char*>(data.data()), data.size());
+        size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+        size_t chunkCount = std::clamp<size_t>(text.size() / OBJ_MIN_CHUNK_SIZE, 1, threads);
+
+        std::vector<ObjChunk> chunks(chunkCount);
+        size_t start = 0;
+        for(size_t c=0; c<chunkCount; ++c) {
+            size_t end = text.size();
+            if(c + 1 < chunkCount) {
+                size_t newline = text.find('\n', std::max(start, text.size() * (c + 1) / chunkCount));
+                end = newline == std::string_view::npos? text.size() : newline + 1;
+            }
+            chunks[c].text = text.substr(start, end - start);
+            start = end;
+        }
+
+        //ATTRIBUTES, each chunk knows how many come before it to resolve the indices of its faces
+        forEachChunk(chunks, parseAttributes);
+
+        ObjAttributes attributes;
+        size_t positionCount = 0, normalCount = 0, texCoordCount = 0;
+        for(auto& chunk: chunks) {
+            chunk.positionBase = positionCount;
+            chunk.normalBase = normalCount;
+            chunk.texCoordBase = texCoordCount;
+            positionCount += chunk.positions.size();
+            normalCount += chunk.normals.size();
+            texCoordCount += chunk.texCoords.size();
+        }
+
+        attributes.positions.reserve(positionCount);
+        attributes.normals.reserve(normalCount);
+        attributes.texCoords.reserve(texCoordCount);
+        for(auto& chunk: chunks) {
+            attributes.positions.insert(attributes.positions.end(), chunk.positions.begin(), chunk.positions.end());
+            attributes.normals.insert(attributes.normals.end(), chunk.normals.begin(), chunk.normals.end());
+            attributes.texCoords.insert(attributes.texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+            chunk.positions = {};
+            chunk.normals = {};
+            chunk.texCoords = {};
+        }
+
+        //FACES, merged in each chunk
+        forEachChunk(chunks, [&](ObjChunk& chunk) { parseFaces(chunk, attributes); });
+
+        //MERGE, the vertices of the chunks are merged in order and their indices remapped at the same time
+        size_t localVertices = 0, indexCount = 0;
+        for(auto& chunk: chunks) {
+            chunk.indexBase = indexCount;
+            localVertices += chunk.vertices.size();
+            indexCount += chunk.indices.size();
+        }
+
+        VertexTable table(localVertices);
+        std::vector<std::vector<uint32_t>> remaps(chunkCount);
+        for(size_t c=0; c<chunkCount; ++c) {
+            remaps[c].resize(chunks[c].vertices.size());
+            for(size_t v=0; v<chunks[c].vertices.size(); ++v)
+                remaps[c][v] = table.insert(chunks[c].vertices[v]);
+        }
+
+        ObjMesh mesh;
+        mesh.indices.resize(indexCount);
+        forEachChunk(chunks, [&](ObjChunk& chunk) {
+            const auto& remap = remaps[&chunk - chunks.data()];
+            std::transform(chunk.indices.begin(), chunk.indices.end(), mesh.indices.begin() + chunk.indexBase, [&](uint32_t i) { return remap[i]; });
+        });
+        mesh.vertices = std::move(table.vertices);
+
+        groupMaterials(mesh, chunks);
+        return mesh;
+    }
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "DefaultPipeline.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fly {
+
+    struct ObjMesh {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<Submesh> submeshes; //Empty if every face has the same material
+        std::vector<std::string> materials; //Name in usemtl of each material slot, the faces before any usemtl have an empty one
+    };
+
+    constexpr size_t OBJ_MIN_CHUNK_SIZE = 1 << 20; //Smaller files are parsed by fewer threads
+
+    /*
+    Parses the positions, normals, uvs and faces of an OBJ file from its mapping, in a chunk of lines per thread. The polygons are
+    fanned into triangles and the vertices with the same attributes are merged, first in each chunk and then between them
+    The attributes that a face doesn't have are zero. The faces are grouped by material, numbered in the order they are first used
+    */
+    ObjMesh loadObj(const std::filesystem::path& path);
+
+}
@@ -62,25 +62,6 @@ namespace fly {
 
 
     //VERTEX IMPLEMENTATION
-    VkVertexInputBindingDescription SimpleVertex::getBindingDescription() {
-        VkVertexInputBindingDescription bindingDescription{};
-        bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(SimpleVertex);
-        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-        return bindingDescription;
-    }
-    
-    std::vector<VkVertexInputAttributeDescription> SimpleVertex::getAttributeDescriptions() {
-        std::vector<VkVertexInputAttributeDescription> attributeDescriptions(1);
-        attributeDescriptions[0].binding = 0;
-        attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(SimpleVertex, pos);
-
-        return attributeDescriptions;
-    }
-
     bool SimpleVertex::operator==(const SimpleVertex& other) const {
         return pos == other.pos;
     }
@@ -22,9 +22,9 @@ namespace fly {
     struct SimpleVertex {
         glm::vec3 pos;
     
-        static VkVertexInputBindingDescription getBindingDescription();
+        static constexpr VkVertexInputBindingDescription getBindingDescription() { return makeBindingDescription<SimpleVertex>(); }
     
-        static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+        static constexpr auto getAttributeDescriptions() { return makeAttributeDescriptions({ FLY_VERTEX_ATTRIBUTE(SimpleVertex, pos) }); }
     
         bool operator==(const SimpleVertex& other) const;
     };
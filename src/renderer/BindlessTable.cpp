@@ -0,0 +1,157 @@
+#include "BindlessTable.hpp"
+
+#include <Utils.hpp>
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace fly {
+
+    BindlessTable::BindlessTable(std::shared_ptr<VulkanInstance> vk): vk{vk} {
+        //The update after bind limits can be lower than what an index addresses
+        VkPhysicalDeviceVulkan12Properties properties12{};
+        properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &properties12;
+        vkGetPhysicalDeviceProperties2(vk->physicalDevice, &properties);
+        this->bindings[0].capacity = std::min({ MAX_IMAGES, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages, 
+            properties12.maxDescriptorSetUpdateAfterBindSampledImages });
+        this->bindings[1].capacity = std::min({ MAX_SAMPLERS, properties12.maxPerStageDescriptorUpdateAfterBindSamplers, 
+            properties12.maxDescriptorSetUpdateAfterBindSamplers });
+
+        std::array<VkDescriptorSetLayoutBinding, 2> layoutBindings{};
+        layoutBindings[0].binding = 0;
+        layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        layoutBindings[0].descriptorCount = getImageCapacity();
+        layoutBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        layoutBindings[1].binding = 1;
+        layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+        layoutBindings[1].descriptorCount = getSamplerCapacity();
+        layoutBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        //The slots nobody registered are never read, and the new ones can be written while the set is bound
+        VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+            | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        std::array<VkDescriptorBindingFlags, 2> bindingFlags = { flags, flags };
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+        flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+        flagsInfo.pBindingFlags = bindingFlags.data();
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = &flagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+        layoutInfo.pBindings = layoutBindings.data();
+        if(vkCreateDescriptorSetLayout(vk->device, &layoutInfo, nullptr, &this->setLayout) != VK_SUCCESS)
+            throw std::runtime_error("failed to create bindless descriptor set layout!");
+
+        std::array<VkDescriptorPoolSize, 2> poolSizes = {{
+            {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, getImageCapacity()},
+            {VK_DESCRIPTOR_TYPE_SAMPLER, getSamplerCapacity()}
+        }};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = 1;
+        if(vkCreateDescriptorPool(vk->device, &poolInfo, nullptr, &this->pool) != VK_SUCCESS)
+            throw std::runtime_error("failed to create bindless descriptor pool!");
+
+        //A single set, the frames in flight never read the slots that are written
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = this->pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &this->setLayout;
+        if(vkAllocateDescriptorSets(vk->device, &allocInfo, &this->set) != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate bindless descriptor set!");
+    }
+
+    BindlessTable::~BindlessTable() {
+        vkDestroyDescriptorPool(vk->device, this->pool, nullptr);
+        vkDestroyDescriptorSetLayout(vk->device, this->setLayout, nullptr);
+    }
+
+    uint32_t BindlessTable::registerImage(VkImageView imageView) {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        if(auto it = this->images.find(imageView); it != this->images.end())
+            return it->second;
+
+        uint32_t index = allocateSlot(0);
+        this->images[imageView] = index;
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = imageView;
+        write(0, index, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, imageInfo);
+        return index;
+    }
+
+    uint32_t BindlessTable::registerSampler(VkSampler sampler) {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        if(auto it = this->samplers.find(sampler); it != this->samplers.end())
+            return it->second;
+
+        uint32_t index = allocateSlot(1);
+        this->samplers[sampler] = index;
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.sampler = sampler;
+        write(1, index, VK_DESCRIPTOR_TYPE_SAMPLER, imageInfo);
+        return index;
+    }
+
+    void BindlessTable::releaseImage(VkImageView imageView) {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        if(auto node = this->images.extract(imageView); !node.empty())
+            this->released.push({ 0, node.mapped(), this->currentFrame });
+    }
+
+    void BindlessTable::releaseSampler(VkSampler sampler) {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        if(auto node = this->samplers.extract(sampler); !node.empty())
+            this->released.push({ 1, node.mapped(), this->currentFrame });
+    }
+
+    void BindlessTable::update(uint32_t currentFrame) {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        this->currentFrame = currentFrame;
+        while(!this->released.empty() && this->released.front().frame == currentFrame) {
+            auto slot = this->released.front();
+            this->bindings[slot.binding].free.push_back(slot.index);
+            this->released.pop();
+        }
+    }
+
+    uint32_t BindlessTable::allocateSlot(uint32_t binding) {
+        auto& slots = this->bindings[binding];
+        if(!slots.free.empty()) {
+            uint32_t index = slots.free.back();
+            slots.free.pop_back();
+            return index;
+        }
+
+        if(slots.next >= slots.capacity)
+            throw std::runtime_error(binding == 0? "too many images in the bindless table!" : "too many samplers in the bindless table!");
+        return slots.next++;
+    }
+
+    void BindlessTable::write(uint32_t binding, uint32_t index, VkDescriptorType type, VkDescriptorImageInfo imageInfo) {
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = this->set;
+        descriptorWrite.dstBinding = binding;
+        descriptorWrite.dstArrayElement = index;
+        descriptorWrite.descriptorType = type;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(vk->device, 1, &descriptorWrite, 0, nullptr);
+    }
+
+}
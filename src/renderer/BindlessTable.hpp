@@ -0,0 +1,78 @@
+#pragma once
+
+#include "vulkan/VulkanTypes.h"
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+namespace fly {
+
+    /*
+    One descriptor set with every sampled image and sampler of the engine, bound once by the pipelines with BINDLESS_ENABLED.
+    The images and the samplers are registered once and the shaders find them by index, so the meshes don't need sets of their own
+
+    The arrays are partially bound and updated after bind, so registering doesn't touch the descriptors the frames in flight use.
+    The textures and the samplers release their handles when they are destroyed, and the slot is kept until the frames in flight
+    are done with it. Otherwise a new handle with the same value would get the index of the destroyed one
+    */
+    class BindlessTable {
+    public:
+        //The image index has 16 bits. The arrays are smaller if the device allows fewer descriptors
+        static constexpr uint32_t MAX_IMAGES = 1 << 16, MAX_SAMPLERS = 256;
+
+        BindlessTable(std::shared_ptr<VulkanInstance> vk);
+        ~BindlessTable();
+
+        /*
+        The set, with the update after bind pool flag:
+        - 0: the sampled images
+        - 1: the samplers
+        */
+        VkDescriptorSetLayout getSetLayout() const { return this->setLayout; }
+        VkDescriptorSet getSet() const { return this->set; }
+
+        //The same view or sampler always has the same index until it is released
+        uint32_t registerImage(VkImageView imageView);
+        uint32_t registerSampler(VkSampler sampler);
+        //Called when the handle is destroyed, the ones that were never registered are ignored
+        void releaseImage(VkImageView imageView);
+        void releaseSampler(VkSampler sampler);
+
+        //Frees the slots released on this frame, call it once per frame before recording
+        void update(uint32_t currentFrame);
+
+        uint32_t getImageCapacity() const { return this->bindings[0].capacity; }
+        uint32_t getSamplerCapacity() const { return this->bindings[1].capacity; }
+
+        //What the shaders read: the image in the low 16 bits and the sampler in the high ones
+        static uint32_t packTexture(uint32_t image, uint32_t sampler) { return image | (sampler << 16); }
+        uint32_t registerTexture(VkImageView imageView, VkSampler sampler) { return packTexture(registerImage(imageView), registerSampler(sampler)); }
+
+    private:
+        struct Binding {
+            uint32_t capacity = 0, next = 0;
+            std::vector<uint32_t> free;
+        };
+        struct ReleasedSlot { uint32_t binding, index, frame; };
+
+        std::shared_ptr<VulkanInstance> vk;
+        std::mutex mtx; //Scenes load their textures in another thread
+
+        VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+        VkDescriptorPool pool = VK_NULL_HANDLE;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+
+        std::map<VkImageView, uint32_t> images;
+        std::map<VkSampler, uint32_t> samplers;
+        std::array<Binding, 2> bindings; //The slots of the images and of the samplers
+        std::queue<ReleasedSlot> released;
+        uint32_t currentFrame = 0; //Of the last update, the slots released now are freed when it comes back
+
+        uint32_t allocateSlot(uint32_t binding);
+        void write(uint32_t binding, uint32_t index, VkDescriptorType type, VkDescriptorImageInfo imageInfo);
+    };
+
+}
@@ -8,7 +8,7 @@ namespace fly {
     DeferredShader::~DeferredShader() {
         vkDestroyDescriptorPool(vk->device, this->descriptorPool, nullptr);
         vkDestroyDescriptorSetLayout(vk->device, this->descriptorSetLayout.layout, nullptr);
-        vkDestroyPipeline(vk->device, this->pipeline, nullptr);
+        this->tunedPipeline.reset();
         vkDestroyPipelineLayout(vk->device, this->pipelineLayout, nullptr);
     }
 
@@ -26,7 +26,7 @@ namespace fly {
         );
 
         //Dispatch shader
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+        auto workgroupSize = this->tunedPipeline->bind(commandBuffer, currentFrame);
         vkCmdBindDescriptorSets(
             commandBuffer, 
             VK_PIPELINE_BIND_POINT_COMPUTE, 
@@ -37,21 +37,17 @@ namespace fly {
             0, 
             nullptr
         );
-        uint32_t groupCountX = (vk->swapChainExtent.width + 15) / 16;
-        uint32_t groupCountY = (vk->swapChainExtent.height + 15) / 16;
-        vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+        auto groupCount = workgroupSize.groupCount(vk->renderExtent);
+        vkCmdDispatch(commandBuffer, groupCount.width, groupCount.height, 1);
 
 
-        //Output image from general to transfer dst (the format that the filters expect)
-        transitionImageLayout(
-            commandBuffer, outputTexture->getImage(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        //Output image stays in general, the filters only need to wait for the writes
+        memoryBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
             VK_ACCESS_SHADER_WRITE_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            1, false
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
         );
     }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Texture.hpp"
+#include "WorkgroupTuner.hpp"
 #include "vulkan/VulkanConstants.h"
 
 
@@ -30,7 +31,7 @@ namespace fly {
         DescriptorSetLayout descriptorSetLayout;
         VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
         VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
-        VkPipeline pipeline = VK_NULL_HANDLE;
+        std::unique_ptr<TunedComputePipeline> tunedPipeline; //Tuned as the "deferred" pass
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include "DynamicResolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace fly {
+
+    VkExtent2D DynamicResolution::update(double gpuFrameTime, VkExtent2D fullExtent) {
+        if(!this->enabled) {
+            this->scale = MAX_SCALE;
+        } 
+        else if(gpuFrameTime > 0) {
+            //The cost goes with the pixel count, so with the square of the scale
+            float wanted = this->scale * static_cast<float>(std::sqrt(this->targetFrameTime * HEADROOM / gpuFrameTime));
+            wanted = std::clamp(wanted, MIN_SCALE, MAX_SCALE);
+            if(std::abs(wanted - this->scale) > DEADBAND)
+                this->scale += (wanted - this->scale) * SMOOTHING;
+            else if(wanted == MAX_SCALE || wanted == MIN_SCALE)
+                this->scale = wanted; //The limits are reached exactly, so the quality governor knows when the scale can't help
+        }
+
+        return {
+            std::max(1u, static_cast<uint32_t>(std::ceil(fullExtent.width * this->scale))),
+            std::max(1u, static_cast<uint32_t>(std::ceil(fullExtent.height * this->scale)))
+        };
+    }
+
+}
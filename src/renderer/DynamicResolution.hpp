@@ -0,0 +1,33 @@
+#pragma once
+
+#include "vulkan/VulkanTypes.h"
+
+namespace fly {
+
+    /*
+    Picks the scale of the 3D rendering from the GPU time of the last frames, so the frame stays on budget.
+    Everything up to the tonemapper renders into the top left corner of the attachments, and the tonemapper upscales it
+    */
+    class DynamicResolution {
+    public:
+        static constexpr float MIN_SCALE = 0.5f, MAX_SCALE = 1.0f;
+
+        void setEnabled(bool enabled) { this->enabled = enabled; }
+        bool isEnabled() const { return this->enabled; }
+        void setTargetFrameTime(double ms) { this->targetFrameTime = ms; }
+        float getScale() const { return this->scale; }
+
+        //Takes the GPU time in ms of the last finished frame and returns the render extent of the next one
+        VkExtent2D update(double gpuFrameTime, VkExtent2D fullExtent);
+
+    private:
+        static constexpr float SMOOTHING = 0.1f; //Fraction of the way to the wanted scale done every frame
+        static constexpr float DEADBAND = 0.02f; //Small changes are ignored so the scale doesn't jitter
+        static constexpr double HEADROOM = 0.9; //Aim below the budget so a spike doesn't go over it
+
+        bool enabled = false;
+        double targetFrameTime = 1000.0 / 60.0;
+        float scale = MAX_SCALE;
+    };
+
+}
@@ -11,6 +11,7 @@
 namespace fly {
     
     FilterPipeline::~FilterPipeline() {
+        this->tunedPipeline.reset();
         vkDestroyDescriptorPool(vk->device, this->descriptorPool, nullptr);
         vkDestroyDescriptorSetLayout(vk->device, this->descriptorSetLayout.layout, nullptr);
         vkDestroyPipeline(vk->device, this->pipeline, nullptr);
@@ -21,302 +22,287 @@ namespace fly {
         this->descriptorSetLayout = createDescriptorSetLayout();
         this->descriptorPool = createDescriptorPoolWithLayout(this->descriptorSetLayout, this->vk);
         
-        auto [pip, lay] = createComputePipeline(vk, this->descriptorSetLayout.layout, getShaderCode(), this->pushConstantSize);
-        this->pipeline = pip;
-        this->pipelineLayout = lay;
-        this->descriptorSets = allocateDescriptorSets(vk, this->descriptorSetLayout.layout, this->descriptorPool);
+        this->pipelineLayout = createComputePipelineLayout(vk, this->descriptorSetLayout.layout, this->pushConstantSize);
+        this->tunedPipeline = std::make_unique<TunedComputePipeline>(vk, getPassName(), this->pipelineLayout, getShaderCode(), getSpecializationConstants());
+        for(auto& sets: this->descriptorSets)
+            sets = allocateDescriptorSets(vk, this->descriptorSetLayout.layout, this->descriptorPool);
     }
 
 
-    //GRAYSCALE FILTER IMPLEMENTATION
-    std::vector<char> GrayscaleFilter::getShaderCode() {
-        return readFile(GRAYSCALE_SHADER_SRC);
-    }
-
-    DescriptorSetLayout GrayscaleFilter::createDescriptorSetLayout() {
-        return newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT, {
+    //PIXEL FILTER IMPLEMENTATION
+    DescriptorSetLayout PixelFilter::createDescriptorSetLayout() {
+        return newDescriptorSetBuild(2 * MAX_FRAMES_IN_FLIGHT, {
             {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT},
             {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT}
         }).build(vk);
     }
 
-    void GrayscaleFilter::createResources() {
-        this->computeInputImage = std::make_unique<Texture>(
-            this->vk, 
-            vk->swapChainExtent.width, vk->swapChainExtent.height, 
-            VK_FORMAT_R16G16B16A16_SFLOAT, 
-            VK_SAMPLE_COUNT_1_BIT,
-            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-            VK_IMAGE_ASPECT_COLOR_BIT
-        );
-
-        this->computeOutputImage = std::make_unique<Texture>(
-            this->vk, 
-            vk->swapChainExtent.width, vk->swapChainExtent.height, 
-            VK_FORMAT_R16G16B16A16_SFLOAT, 
-            VK_SAMPLE_COUNT_1_BIT,
-            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-            VK_IMAGE_ASPECT_COLOR_BIT
-        );
-
-        for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
-            VkDescriptorImageInfo inputImageInfo{};
-            inputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            inputImageInfo.imageView = this->computeInputImage->getImageView();
-
-            VkDescriptorImageInfo outputImageInfo{};
-            outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            outputImageInfo.imageView = this->computeOutputImage->getImageView();
-
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = this->descriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pImageInfo = &inputImageInfo;
-
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = this->descriptorSets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &outputImageInfo;
-
-            vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    void PixelFilter::createResources(const HdrImages& hdrImages) {
+        for(int input=0; input<2; ++input) {
+            for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
+                VkDescriptorImageInfo inputImageInfo{};
+                inputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                inputImageInfo.imageView = hdrImages[input]->getImageView();
+
+                VkDescriptorImageInfo outputImageInfo{};
+                outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                outputImageInfo.imageView = hdrImages[1 - input]->getImageView();
+
+                std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+                descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[0].dstSet = this->descriptorSets[input][i];
+                descriptorWrites[0].dstBinding = 0;
+                descriptorWrites[0].dstArrayElement = 0;
+                descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                descriptorWrites[0].descriptorCount = 1;
+                descriptorWrites[0].pImageInfo = &inputImageInfo;
+
+                descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[1].dstSet = this->descriptorSets[input][i];
+                descriptorWrites[1].dstBinding = 1;
+                descriptorWrites[1].dstArrayElement = 0;
+                descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                descriptorWrites[1].descriptorCount = 1;
+                descriptorWrites[1].pImageInfo = &outputImageInfo;
+
+                vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            }
         }
     }
 
-    void GrayscaleFilter::applyFilter(VkCommandBuffer commandBuffer, VkImage image, uint32_t currentFrame) {
-        //swapchain image from transfer dst to transfer src
-        transitionImageLayout(
-            commandBuffer, image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_ACCESS_TRANSFER_READ_BIT,
-            1, false
-        );
-
-        //compute input image from undef to transfer dst
-        transitionImageLayout(
-            commandBuffer, computeInputImage->getImage(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            0,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            1, false
-        );
-
-        // Copy from swapchain to compute input
-        VkImageCopy copyRegion{};
-        copyRegion.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        copyRegion.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        copyRegion.extent = {vk->swapChainExtent.width, vk->swapChainExtent.height, 1};
-
-        vkCmdCopyImage(
-            commandBuffer,
-            image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            computeInputImage->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &copyRegion
-        );
+    void PixelFilter::applyFilter(VkCommandBuffer commandBuffer, uint32_t input, uint32_t currentFrame) {
+        FusedPush constants{};
+        constants.params[0] = getStageParams();
+        dispatch(commandBuffer, *this->tunedPipeline, constants, input, currentFrame);
+    }
 
-        //compute input image from transfer dst to general
-        transitionImageLayout(
-            commandBuffer, computeInputImage->getImage(),
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_ACCESS_SHADER_READ_BIT,
-            1, false
-        );
+    SpecializationConstants PixelFilter::stageConstants(const std::vector<Stage>& stages) {
+        FLY_ASSERT(stages.size() <= MAX_FUSED_STAGES, "Too many stages in a fused filter chain!");
 
-        //compute output image from undef to general
-        transitionImageLayout(
-            commandBuffer, computeOutputImage->getImage(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            0,
-            VK_ACCESS_SHADER_WRITE_BIT,
-            1, false
-        );
+        SpecializationConstants constants;
+        for(uint32_t i=0; i<MAX_FUSED_STAGES; ++i)
+            constants.add(i, i < stages.size()? stages[i] : STAGE_NONE);
+        return constants;
+    }
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+    void PixelFilter::dispatch(
+        VkCommandBuffer commandBuffer, 
+        TunedComputePipeline& pipeline, 
+        const FusedPush& constants, 
+        uint32_t input, 
+        uint32_t currentFrame
+    ) {
+        auto workgroupSize = pipeline.bind(commandBuffer, currentFrame);
         vkCmdBindDescriptorSets(
             commandBuffer, 
             VK_PIPELINE_BIND_POINT_COMPUTE, 
             this->pipelineLayout, 
             0, 
             1, 
-            &this->descriptorSets[currentFrame], 
+            &this->descriptorSets[input][currentFrame], 
             0, 
             nullptr
         );
-        uint32_t groupCountX = (vk->swapChainExtent.width + 15) / 16;
-        uint32_t groupCountY = (vk->swapChainExtent.height + 15) / 16;
-        vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
-
-        //compute output image from general to transfer src
-        transitionImageLayout(
-            commandBuffer, computeOutputImage->getImage(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_ACCESS_SHADER_WRITE_BIT,
-            VK_ACCESS_TRANSFER_READ_BIT,
-            1, false
+        vkCmdPushConstants(
+            commandBuffer, 
+            this->pipelineLayout, 
+            VK_SHADER_STAGE_COMPUTE_BIT, 
+            0, sizeof(FusedPush), 
+            &constants
         );
 
-        //swapchain image from transfer src to transfer dst
-        transitionImageLayout(
-            commandBuffer, image,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_ACCESS_TRANSFER_READ_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            1, false
-        );
+        auto groupCount = workgroupSize.groupCount(vk->renderExtent);
+        vkCmdDispatch(commandBuffer, groupCount.width, groupCount.height, 1);
+    }
 
-        vkCmdCopyImage(
-            commandBuffer,
-            computeOutputImage->getImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &copyRegion
-        );
+
+
+    //FUSED FILTER CHAIN IMPLEMENTATION
+    void FusedFilterChain::allocate() {
+        //The pipelines are built on demand, one per chain signature. They all share the layout
+        this->descriptorSetLayout = createDescriptorSetLayout();
+        this->descriptorPool = createDescriptorPoolWithLayout(this->descriptorSetLayout, this->vk);
+        this->pipelineLayout = createComputePipelineLayout(vk, this->descriptorSetLayout.layout, this->pushConstantSize);
+        for(auto& sets: this->descriptorSets)
+            sets = allocateDescriptorSets(vk, this->descriptorSetLayout.layout, this->descriptorPool);
     }
 
+    void FusedFilterChain::applyChain(VkCommandBuffer commandBuffer, const std::vector<PixelFilter*>& chain, uint32_t input, uint32_t currentFrame) {
+        FLY_ASSERT(chain.size() <= MAX_FUSED_STAGES, "Too many stages in a fused filter chain!");
+
+        //Every stage fits in a byte, so the whole chain fits in the key
+        uint64_t signature = 0;
+        std::vector<Stage> stages;
+        FusedPush constants{};
+        for(size_t i=0; i<chain.size(); ++i) {
+            auto stage = chain[i]->getStage();
+            signature |= static_cast<uint64_t>(stage) << (8 * i);
+            stages.push_back(stage);
+            constants.params[i] = chain[i]->getStageParams();
+        }
+
+        auto it = this->pipelineCache.find(signature);
+        if(it == this->pipelineCache.end()) {
+            auto pipeline = std::make_unique<TunedComputePipeline>(vk, getPassName(), this->pipelineLayout, getShaderCode(), stageConstants(stages));
+            it = this->pipelineCache.emplace(signature, std::move(pipeline)).first;
+        }
+
+        dispatch(commandBuffer, *it->second, constants, input, currentFrame);
+    }
+
+
     
-    
-    //GRAYSCALE FILTER IMPLEMENTATION
+    //FXAA FILTER IMPLEMENTATION
     std::vector<char> FxaaFilter::getShaderCode() {
         return readFile(FXAA_SHADER_SRC);
     }
 
     DescriptorSetLayout FxaaFilter::createDescriptorSetLayout() {
-        return newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT, {
+        return newDescriptorSetBuild(2 * MAX_FRAMES_IN_FLIGHT, {
             {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT},
             {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT}
         }).build(vk);
     }
 
-    void FxaaFilter::createResources() {
-        this->computeInputImage = std::make_unique<Texture>(
-            this->vk, 
-            vk->swapChainExtent.width, vk->swapChainExtent.height, 
-            VK_FORMAT_R16G16B16A16_SFLOAT, 
-            VK_SAMPLE_COUNT_1_BIT,
-            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-            VK_IMAGE_ASPECT_COLOR_BIT
+    void FxaaFilter::createResources(const HdrImages& hdrImages) {
+        this->inputSampler = std::make_unique<TextureSampler>(this->vk, hdrImages[0]->getMipLevels());
+
+        for(int input=0; input<2; ++input) {
+            for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
+                VkDescriptorImageInfo inputSamplerInfo{};
+                inputSamplerInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                inputSamplerInfo.imageView = hdrImages[input]->getImageView();
+                inputSamplerInfo.sampler = this->inputSampler->getSampler();
+
+                VkDescriptorImageInfo outputImageInfo{};
+                outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                outputImageInfo.imageView = hdrImages[1 - input]->getImageView();
+
+                std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+                descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[0].dstSet = this->descriptorSets[input][i];
+                descriptorWrites[0].dstBinding = 0;
+                descriptorWrites[0].dstArrayElement = 0;
+                descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                descriptorWrites[0].descriptorCount = 1;
+                descriptorWrites[0].pImageInfo = &inputSamplerInfo;
+
+                descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[1].dstSet = this->descriptorSets[input][i];
+                descriptorWrites[1].dstBinding = 1;
+                descriptorWrites[1].dstArrayElement = 0;
+                descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                descriptorWrites[1].descriptorCount = 1;
+                descriptorWrites[1].pImageInfo = &outputImageInfo;
+
+                vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            }
+        }
+    }
+
+    void FxaaFilter::applyFilter(VkCommandBuffer commandBuffer, uint32_t input, uint32_t currentFrame) {
+        auto workgroupSize = this->tunedPipeline->bind(commandBuffer, currentFrame);
+        vkCmdBindDescriptorSets(
+            commandBuffer, 
+            VK_PIPELINE_BIND_POINT_COMPUTE, 
+            this->pipelineLayout, 
+            0, 
+            1, 
+            &this->descriptorSets[input][currentFrame], 
+            0, 
+            nullptr
         );
 
-        this->computeOutputImage = std::make_unique<Texture>(
-            this->vk, 
-            vk->swapChainExtent.width, vk->swapChainExtent.height, 
-            VK_FORMAT_R16G16B16A16_SFLOAT, 
-            VK_SAMPLE_COUNT_1_BIT,
-            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-            VK_IMAGE_ASPECT_COLOR_BIT
+        //Only the render extent holds this frame, the samples can't go past its last texel
+        glm::vec2 screenSize(vk->swapChainExtent.width, vk->swapChainExtent.height);
+        glm::vec2 renderSize(vk->renderExtent.width, vk->renderExtent.height);
+        auto preset = PRESETS[getTier()];
+        FxaaPush constants {
+            screenSize,
+            (renderSize - 0.5f) / screenSize,
+            std::min(this->spanMax, preset.spanCap),
+            this->reduceMul,
+            this->reduceMin,
+            preset.edgeThreshold
+        };
+        vkCmdPushConstants(
+            commandBuffer, 
+            this->pipelineLayout, 
+            VK_SHADER_STAGE_COMPUTE_BIT, 
+            0, sizeof(FxaaPush), 
+            &constants
         );
 
-        this->inputSampler = std::make_unique<TextureSampler>(this->vk, this->computeInputImage->getMipLevels());
+        auto groupCount = workgroupSize.groupCount(vk->renderExtent);
+        vkCmdDispatch(commandBuffer, groupCount.width, groupCount.height, 1);
+    }
 
-        for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
-            VkDescriptorImageInfo inputSamplerInfo{};
-            inputSamplerInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            inputSamplerInfo.imageView = this->computeInputImage->getImageView();
-            inputSamplerInfo.sampler = this->inputSampler->getSampler();
-
-            VkDescriptorImageInfo outputImageInfo{};
-            outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            outputImageInfo.imageView = this->computeOutputImage->getImageView();
-
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = this->descriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pImageInfo = &inputSamplerInfo;
-
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = this->descriptorSets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &outputImageInfo;
-
-            vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-        }
+
+
+    //TONEMAP FILTER IMPLEMENTATION
+    Tonemapper::~Tonemapper() {
+        for(auto& l: luts)
+            l.reset();
+
+        vkDestroyDescriptorPool(vk->device, this->lutDescriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(vk->device, this->lutSetLayout.layout, nullptr);
+        vkDestroyPipeline(vk->device, this->lutPipeline, nullptr);
+        vkDestroyPipelineLayout(vk->device, this->lutPipelineLayout, nullptr);
     }
 
-    void FxaaFilter::applyFilter(VkCommandBuffer commandBuffer, VkImage image, uint32_t currentFrame) {
-        //swapchain image from transfer dst to transfer src
-        transitionImageLayout(
-            commandBuffer, image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_ACCESS_TRANSFER_READ_BIT,
-            1, false
-        );
+    DescriptorSetLayout Tonemapper::createDescriptorSetLayout() {
+        return newDescriptorSetBuild(2 * MAX_FRAMES_IN_FLIGHT, {
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT}
+        }).build(vk);
+    }
 
-        //compute input image from undef to transfer dst
-        transitionImageLayout(
-            commandBuffer, computeInputImage->getImage(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            0,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            1, false
-        );
+    void Tonemapper::allocate() {
+        FilterPipeline::allocate();
 
-        // Copy from swapchain to compute input
-        VkImageCopy copyRegion{};
-        copyRegion.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        copyRegion.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        copyRegion.extent = {vk->swapChainExtent.width, vk->swapChainExtent.height, 1};
+        //The lut is tiny and rarely rebuilt, so its pipeline isn't tuned
+        this->lutSetLayout = newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT, {
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT}
+        }).build(vk);
+        this->lutDescriptorPool = createDescriptorPoolWithLayout(this->lutSetLayout, this->vk);
+        this->lutDescriptorSets = allocateDescriptorSets(vk, this->lutSetLayout.layout, this->lutDescriptorPool);
 
-        vkCmdCopyImage(
-            commandBuffer,
-            image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            computeInputImage->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &copyRegion
-        );
+        auto [lPip, lLay] = createComputePipeline(vk, this->lutSetLayout.layout, readFile(LUT_SHADER_SRC), sizeof(LutPush));
+        this->lutPipeline = lPip;
+        this->lutPipelineLayout = lLay;
 
-        //compute input image from transfer dst to general
-        transitionImageLayout(
-            commandBuffer, computeInputImage->getImage(),
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_ACCESS_SHADER_READ_BIT,
-            1, false
-        );
+        this->lutSampler = std::make_unique<TextureSampler>(this->vk, 1);
+        for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
+            this->luts[i] = std::make_unique<Texture>(
+                this->vk, 
+                LUT_SIZE, LUT_SIZE, LUT_SIZE, 
+                VK_FORMAT_R16G16B16A16_SFLOAT, 
+                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+            );
+
+            VkDescriptorImageInfo lutImageInfo{};
+            lutImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            lutImageInfo.imageView = this->luts[i]->getImageView();
+
+            VkWriteDescriptorSet descriptorWrite{};
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet = this->lutDescriptorSets[i];
+            descriptorWrite.dstBinding = 0;
+            descriptorWrite.dstArrayElement = 0;
+            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrite.descriptorCount = 1;
+            descriptorWrite.pImageInfo = &lutImageInfo;
 
-        //compute output image from undef to general
+            vkUpdateDescriptorSets(vk->device, 1, &descriptorWrite, 0, nullptr);
+        }
+        markLutDirty();
+    }
+
+    void Tonemapper::buildLut(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+        //lut from undef to general, the old contents are rebuilt entirely
         transitionImageLayout(
-            commandBuffer, computeOutputImage->getImage(),
+            commandBuffer, this->luts[currentFrame]->getImage(),
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_GENERAL,
             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
@@ -326,138 +312,136 @@ namespace fly {
             1, false
         );
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->lutPipeline);
         vkCmdBindDescriptorSets(
             commandBuffer, 
             VK_PIPELINE_BIND_POINT_COMPUTE, 
-            this->pipelineLayout, 
+            this->lutPipelineLayout, 
             0, 
             1, 
-            &this->descriptorSets[currentFrame], 
+            &this->lutDescriptorSets[currentFrame], 
             0, 
             nullptr
         );
 
-        FxaaPush constants {
-            glm::vec2(vk->swapChainExtent.width, vk->swapChainExtent.height),
-            this->spanMax,
-            this->reduceMul,
-            this->reduceMin
+        LutPush constants = {
+            {this->contrast, this->saturation, this->brightness, this->exposure},
+            {this->colorFilter, 1 / this->gamma}
         };
         vkCmdPushConstants(
             commandBuffer, 
-            this->pipelineLayout, 
+            this->lutPipelineLayout, 
             VK_SHADER_STAGE_COMPUTE_BIT, 
-            0, sizeof(FxaaPush), 
+            0, sizeof(LutPush), 
             &constants
         );
 
-        uint32_t groupCountX = (vk->swapChainExtent.width + 15) / 16;
-        uint32_t groupCountY = (vk->swapChainExtent.height + 15) / 16;
-        vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+        uint32_t groupCount = (LUT_SIZE + LUT_GROUP_SIZE - 1) / LUT_GROUP_SIZE;
+        vkCmdDispatch(commandBuffer, groupCount, groupCount, groupCount);
 
-        //compute output image from general to transfer src
-        transitionImageLayout(
-            commandBuffer, computeOutputImage->getImage(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        memoryBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
             VK_ACCESS_SHADER_WRITE_BIT,
-            VK_ACCESS_TRANSFER_READ_BIT,
-            1, false
-        );
-
-        //swapchain image from transfer src to transfer dst
-        transitionImageLayout(
-            commandBuffer, image,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_ACCESS_TRANSFER_READ_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            1, false
-        );
-
-        vkCmdCopyImage(
-            commandBuffer,
-            computeOutputImage->getImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &copyRegion
+            VK_ACCESS_SHADER_READ_BIT
         );
+        this->lutDirty[currentFrame] = false;
     }
 
-
-
-    //TONEMAP FILTER IMPLEMENTATION
-    DescriptorSetLayout Tonemapper::createDescriptorSetLayout() {
-        return newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT, {
-            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT},
-            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT}
-        }).build(vk);
+    void Tonemapper::createResources(const HdrImages& hdrImages) {
+        //The copy is only needed when the swapchain can't be a storage image
+        this->computeOutputImage.reset();
+        if(vk->swapChainStorageViews.empty()) {
+            this->computeOutputImage = std::make_unique<Texture>(
+                this->vk, 
+                vk->swapChainExtent.width, vk->swapChainExtent.height, 
+                VK_FORMAT_R8G8B8A8_UNORM, 
+                VK_SAMPLE_COUNT_1_BIT,
+                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_IMAGE_ASPECT_COLOR_BIT
+            );
+        }
+        //Sampled so the render extent can be upscaled to the whole output
+        this->inputSampler = std::make_unique<TextureSampler>(this->vk, hdrImages[0]->getMipLevels());
+
+        for(int input=0; input<2; ++input) {
+            for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
+                VkDescriptorImageInfo inputImageInfo{};
+                inputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                inputImageInfo.imageView = hdrImages[input]->getImageView();
+                inputImageInfo.sampler = this->inputSampler->getSampler();
+
+                //The lut of each frame is sampled in general layout, it is left like that after being built
+                VkDescriptorImageInfo lutImageInfo{};
+                lutImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                lutImageInfo.imageView = this->luts[i]->getImageView();
+                lutImageInfo.sampler = this->lutSampler->getSampler();
+
+                std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+                descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[0].dstSet = this->descriptorSets[input][i];
+                descriptorWrites[0].dstBinding = 0;
+                descriptorWrites[0].dstArrayElement = 0;
+                descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                descriptorWrites[0].descriptorCount = 1;
+                descriptorWrites[0].pImageInfo = &inputImageInfo;
+
+                descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[1].dstSet = this->descriptorSets[input][i];
+                descriptorWrites[1].dstBinding = 2;
+                descriptorWrites[1].dstArrayElement = 0;
+                descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                descriptorWrites[1].descriptorCount = 1;
+                descriptorWrites[1].pImageInfo = &lutImageInfo;
+
+                vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+                
+                this->boundOutputs[input][i] = VK_NULL_HANDLE;
+                if(this->computeOutputImage)
+                    bindOutput(this->computeOutputImage->getImageView(), input, i);
+            }
+        }
     }
 
-    void Tonemapper::createResources(std::shared_ptr<Texture> hdrColorTexture) {
-        this->hdrColorTexture = hdrColorTexture;
-        this->computeOutputImage = std::make_unique<Texture>(
-            this->vk, 
-            vk->swapChainExtent.width, vk->swapChainExtent.height, 
-            VK_FORMAT_R8G8B8A8_UNORM, 
-            VK_SAMPLE_COUNT_1_BIT,
-            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-            VK_IMAGE_ASPECT_COLOR_BIT
-        );
-
-        for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
-            VkDescriptorImageInfo inputImageInfo{};
-            inputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            inputImageInfo.imageView = this->hdrColorTexture->getImageView();
-
-            VkDescriptorImageInfo outputImageInfo{};
-            outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            outputImageInfo.imageView = this->computeOutputImage->getImageView();
-
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = this->descriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pImageInfo = &inputImageInfo;
-
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = this->descriptorSets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &outputImageInfo;
-
-            vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-        }
+    void Tonemapper::bindOutput(VkImageView output, uint32_t input, uint32_t currentFrame) {
+        if(this->boundOutputs[input][currentFrame] == output)
+            return;
+
+        VkDescriptorImageInfo outputImageInfo{};
+        outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        outputImageInfo.imageView = output;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = this->descriptorSets[input][currentFrame];
+        descriptorWrite.dstBinding = 1;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &outputImageInfo;
+
+        vkUpdateDescriptorSets(vk->device, 1, &descriptorWrite, 0, nullptr);
+        this->boundOutputs[input][currentFrame] = output;
     }
 
-    void Tonemapper::applyFilter(VkCommandBuffer commandBuffer, VkImage swapchainImage, uint32_t currentFrame) {
-        //input image from transfer dst to general
-        transitionImageLayout(
-            commandBuffer, this->hdrColorTexture->getImage(),
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_ACCESS_SHADER_READ_BIT,
-            1, false
-        );
+    void Tonemapper::applyFilter(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t input, uint32_t currentFrame) {
+        VkImage swapchainImage = vk->swapChainImages[imageIndex];
+        bool direct = this->computeOutputImage == nullptr;
+
+        if(this->lutDirty[currentFrame])
+            buildLut(commandBuffer, currentFrame);
         
-        //compute output image from undef to general
+        //The set of this frame slot isn't in use, its fence was waited before recording
+        if(direct)
+            bindOutput(vk->swapChainStorageViews[imageIndex], input, currentFrame);
+
+        //output image from undef to general, the source stage waits for the acquire semaphore
         transitionImageLayout(
-            commandBuffer, computeOutputImage->getImage(),
+            commandBuffer, direct? swapchainImage : computeOutputImage->getImage(),
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_GENERAL,
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
             0,
             VK_ACCESS_SHADER_WRITE_BIT,
@@ -465,19 +449,21 @@ namespace fly {
         );
 
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+        auto workgroupSize = this->tunedPipeline->bind(commandBuffer, currentFrame);
         vkCmdBindDescriptorSets(
             commandBuffer, 
             VK_PIPELINE_BIND_POINT_COMPUTE, 
             this->pipelineLayout, 
             0, 
             1, 
-            &this->descriptorSets[currentFrame], 
+            &this->descriptorSets[input][currentFrame], 
             0, 
             nullptr
         );
 
-        TonemapPush constants = {this->exposure, 1 / this->gamma};
+        //The whole output is written, reading only the render extent of the input
+        glm::vec2 uvScale = glm::vec2(vk->renderExtent.width, vk->renderExtent.height) / glm::vec2(vk->swapChainExtent.width, vk->swapChainExtent.height);
+        TonemapPush constants = {uvScale};
         vkCmdPushConstants(
             commandBuffer, 
             this->pipelineLayout, 
@@ -486,9 +472,23 @@ namespace fly {
             &constants
         );
 
-        uint32_t groupCountX = (vk->swapChainExtent.width + 15) / 16;
-        uint32_t groupCountY = (vk->swapChainExtent.height + 15) / 16;
-        vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+        auto groupCount = workgroupSize.groupCount(vk->swapChainExtent);
+        vkCmdDispatch(commandBuffer, groupCount.width, groupCount.height, 1);
+
+        if(direct) {
+            //swapchain image from general to color attachment for the ui
+            transitionImageLayout(
+                commandBuffer, swapchainImage,
+                VK_IMAGE_LAYOUT_GENERAL,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_SHADER_WRITE_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                1, false
+            );
+            return;
+        }
 
 
         //compute output image from general to transfer src
@@ -509,7 +509,7 @@ namespace fly {
             commandBuffer, swapchainImage,
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
             VK_PIPELINE_STAGE_TRANSFER_BIT,
             0,
             VK_ACCESS_TRANSFER_WRITE_BIT,
@@ -545,10 +545,7 @@ namespace fly {
 
     //BLOOM IMPLEMENTATION
     BloomFilter::~BloomFilter() {
-        for(auto& s: computeSamplers)
-            s.reset();
-
-        for(auto& i: computeImages)
+        for(auto& i: mipImages)
             i.reset();
 
         vkDestroyPipeline(vk->device, this->upsamplePipeline, nullptr);
@@ -577,168 +574,100 @@ namespace fly {
         this->upsamplePipeline = uPip;
         this->upsamplePipelineLayout = uLay;
         
-        for(int i=1; i<BLOOM_LEVELS; ++i)
-            this->descriptorSetMap[{i-1, i}] = allocateDescriptorSets(vk, this->descriptorSetLayout.layout, this->descriptorPool);
-        
-        for(int i=BLOOM_LEVELS-1; i>0; --i)
-            this->descriptorSetMap[{i, i-1}] = allocateDescriptorSets(vk, this->descriptorSetLayout.layout, this->descriptorPool);
+        //Both passes see the whole pyramid, so one set per input image and frame is enough
+        for(auto& sets: this->descriptorSets)
+            sets = allocateDescriptorSets(vk, this->descriptorSetLayout.layout, this->descriptorPool);
     }
 
-    void BloomFilter::createResources() {
+    void BloomFilter::createResources(const HdrImages& hdrImages) {
+        //Allocated for the whole swapchain, with dynamic resolution only the top left part is used
         int width = vk->swapChainExtent.width, height = vk->swapChainExtent.height;
-        for(int i=0; i<BLOOM_LEVELS; ++i) {
-            auto usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-            if(i == 0)
-                usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-            
-            this->computeImages[i] = std::make_unique<Texture>(
+        for(int i=1; i<BLOOM_LEVELS; ++i) {
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+
+            this->mipImages[i-1] = std::make_unique<Texture>(
                 this->vk, 
                 width, height, 
                 VK_FORMAT_R16G16B16A16_SFLOAT, 
                 VK_SAMPLE_COUNT_1_BIT,
-                usage,
+                VK_IMAGE_USAGE_STORAGE_BIT,
                 VK_IMAGE_ASPECT_COLOR_BIT
             );
-
-            this->computeSamplers[i] = std::make_unique<TextureSampler>(this->vk, computeImages[i]->getMipLevels(), TextureSampler::Filter::LINEAR);
-            this->computeImageSizes[i] = {width, height};
-        
-            width = (width + 1) / 2;
-            height = (height + 1) / 2;
         }
 
-        for(int i=1; i<BLOOM_LEVELS; ++i) {
-            updateDescriptorSet(i-1, i);
-        }
-
-        for(int i=BLOOM_LEVELS-1; i>0; --i) {
-            updateDescriptorSet(i, i-1);
+        for(int input=0; input<2; ++input) {
+            //The shaders filter out of shared memory, so the levels are only bound as storage images
+            std::array<VkDescriptorImageInfo, BLOOM_LEVELS> imageInfos{};
+            for(int i=0; i<BLOOM_LEVELS; ++i) {
+                imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                imageInfos[i].imageView = i == 0? hdrImages[input]->getImageView() : this->mipImages[i-1]->getImageView();
+            }
+
+            for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
+                std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
+                descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[0].dstSet = this->descriptorSets[input][i];
+                descriptorWrites[0].dstBinding = 0;
+                descriptorWrites[0].dstArrayElement = 0;
+                descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                descriptorWrites[0].descriptorCount = BLOOM_LEVELS;
+                descriptorWrites[0].pImageInfo = imageInfos.data();
+
+                vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            }
         }
     }
 
     DescriptorSetLayout BloomFilter::createDescriptorSetLayout() {
-        return newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT * 2 * BLOOM_LEVELS, {
-            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT},
-            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT}
+        return newDescriptorSetBuild(2 * MAX_FRAMES_IN_FLIGHT, {
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, BLOOM_LEVELS}
         }).build(vk);
     }
 
-    void BloomFilter::updateDescriptorSet(int inputLevel, int outputLevel) {
-        for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i) {
-            VkDescriptorImageInfo inputSamplerInfo{};
-            inputSamplerInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            inputSamplerInfo.imageView = this->computeImages[inputLevel]->getImageView();
-            inputSamplerInfo.sampler = this->computeSamplers[inputLevel]->getSampler();
-
-            VkDescriptorImageInfo outputImageInfo{};
-            outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            outputImageInfo.imageView = this->computeImages[outputLevel]->getImageView();
-
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = this->descriptorSetMap[{inputLevel, outputLevel}][i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pImageInfo = &inputSamplerInfo;
-
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = this->descriptorSetMap[{inputLevel, outputLevel}][i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &outputImageInfo;
-
-            vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    void BloomFilter::applyFilter(VkCommandBuffer commandBuffer, uint32_t input, uint32_t currentFrame) {
+        glm::ivec2 baseSize(vk->renderExtent.width, vk->renderExtent.height);
+        glm::ivec2 size = baseSize;
+        for(int i=0; i<BLOOM_LEVELS; ++i) {
+            this->mipImageSizes[i] = glm::vec2(size);
+            size = (size + 1) / 2;
         }
-    }
-
-    void BloomFilter::applyFilter(VkCommandBuffer commandBuffer, VkImage image, uint32_t currentFrame) {
-        //swapchain image from undef to transfer src
-        transitionImageLayout(
-            commandBuffer, image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_ACCESS_TRANSFER_READ_BIT,
-            1, false
-        );
-
-        //compute base image from undef to transfer dst
-        transitionImageLayout(
-            commandBuffer, computeImages[0]->getImage(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            0,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            1, false
-        );
-
-        // Copy from swapchain to compute input
-        VkImageCopy copyRegion{};
-        copyRegion.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        copyRegion.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        copyRegion.extent = {vk->swapChainExtent.width, vk->swapChainExtent.height, 1};
-
-        vkCmdCopyImage(
-            commandBuffer,
-            image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            computeImages[0]->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &copyRegion
-        );
-
-        //compute base image from transfer dst to general
-        transitionImageLayout(
-            commandBuffer, computeImages[0]->getImage(),
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_ACCESS_SHADER_READ_BIT,
-            1, false
-        );
 
-
-        //DOWNSCALING
-        for(int i=1; i<BLOOM_LEVELS; ++i) {
-            //compute output image from undef to general
+        for(int i=0; i<BLOOM_LEVELS-1; ++i) {
+            //mip image from undef to general
             transitionImageLayout(
-                commandBuffer, computeImages[i]->getImage(),
+                commandBuffer, this->mipImages[i]->getImage(),
                 VK_IMAGE_LAYOUT_UNDEFINED,
                 VK_IMAGE_LAYOUT_GENERAL,
                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                 0,
-                VK_ACCESS_SHADER_WRITE_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
                 1, false
             );
-            
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
-            vkCmdBindDescriptorSets(
-                commandBuffer, 
-                VK_PIPELINE_BIND_POINT_COMPUTE, 
-                this->pipelineLayout, 
-                0, 
-                1, 
-                &this->descriptorSetMap[{i-1, i}][currentFrame], 
-                0, 
-                nullptr
-            );
-            
-            auto srcTexelSize = glm::vec2(1.0) / this->computeImageSizes[i-1];
-            auto invNormCurrResolution = glm::vec2(1.0) / (this->computeImageSizes[i] - glm::vec2(1.0));
+        }
+
+        //DOWNSCALING, one dispatch per level so each one can read its whole source level
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+        vkCmdBindDescriptorSets(
+            commandBuffer, 
+            VK_PIPELINE_BIND_POINT_COMPUTE, 
+            this->pipelineLayout, 
+            0, 
+            1, 
+            &this->descriptorSets[input][currentFrame], 
+            0, 
+            nullptr
+        );
+
+        int levels = MIN_BLOOM_LEVELS + static_cast<int>(getTier());
+        for(int i=1; i<levels; ++i) {
+            auto size = this->mipImageSizes[i];
+
             DownsamplePush constants {
-                srcTexelSize, 
-                invNormCurrResolution, 
-                this->bloomThreshold, 
-                i-1
+                this->bloomThreshold,
+                i,
+                baseSize
             };
             vkCmdPushConstants(
                 commandBuffer, 
@@ -747,46 +676,39 @@ namespace fly {
                 0, sizeof(DownsamplePush), 
                 &constants
             );
-            
-            auto size = this->computeImageSizes[i];
-            uint32_t groupCountX = (size.x + 15) / 16;
-            uint32_t groupCountY = (size.y + 15) / 16;
+
+            uint32_t groupCountX = (static_cast<uint32_t>(size.x) + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE;
+            uint32_t groupCountY = (static_cast<uint32_t>(size.y) + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE;
             vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
-            
-            VkMemoryBarrier memoryBarrier{};
-            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-            memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-            memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-                    
-            vkCmdPipelineBarrier(
+
+            memoryBarrier(
                 commandBuffer,
                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                0,
-                1, &memoryBarrier,
-                0, nullptr,
-                0, nullptr
+                VK_ACCESS_SHADER_WRITE_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
             );
         }
 
 
-        //UPSCALING
-        for(int i=BLOOM_LEVELS-1; i>0; --i) {
-            auto size = this->computeImageSizes[i-1];
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->upsamplePipeline);
-            vkCmdBindDescriptorSets(
-                commandBuffer, 
-                VK_PIPELINE_BIND_POINT_COMPUTE, 
-                this->upsamplePipelineLayout, 
-                0, 
-                1, 
-                &this->descriptorSetMap[{i, i-1}][currentFrame], 
-                0, 
-                nullptr
-            );
+        //UPSCALING, the whole pyramid is in the same set so it is only bound once
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->upsamplePipeline);
+        vkCmdBindDescriptorSets(
+            commandBuffer, 
+            VK_PIPELINE_BIND_POINT_COMPUTE, 
+            this->upsamplePipelineLayout, 
+            0, 
+            1, 
+            &this->descriptorSets[input][currentFrame], 
+            0, 
+            nullptr
+        );
+        for(int i=levels-1; i>0; --i) {
+            auto size = this->mipImageSizes[i-1];
             
-            auto invNormCurrResolution = glm::vec2(1.0) / (size - glm::vec2(1.0));
-            UpsamplePush constants{invNormCurrResolution, filterRadius, bloomIntensity};
+            //The radius is given in uv, but the shader works in texels of the level it reads
+            auto radius = glm::min(this->filterRadius * this->mipImageSizes[i], glm::vec2(MAX_UPSAMPLE_RADIUS));
+            UpsamplePush constants{radius, bloomIntensity, i, baseSize};
             vkCmdPushConstants(
                 commandBuffer, 
                 this->upsamplePipelineLayout, 
@@ -795,57 +717,21 @@ namespace fly {
                 &constants
             );
             
-            uint32_t groupCountX = (size.x + 15) / 16;
-            uint32_t groupCountY = (size.y + 15) / 16;
+            uint32_t groupCountX = (static_cast<uint32_t>(size.x) + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE;
+            uint32_t groupCountY = (static_cast<uint32_t>(size.y) + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE;
             vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
 
-            VkMemoryBarrier memoryBarrier{};
-            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-            memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-            memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-            vkCmdPipelineBarrier(
-                commandBuffer,
-                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                0,
-                1, &memoryBarrier,
-                0, nullptr,
-                0, nullptr
-            );
+            //The engine puts the barrier after the last one
+            if(i > 1) {
+                memoryBarrier(
+                    commandBuffer,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_SHADER_WRITE_BIT,
+                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+                );
+            }
         }
-
-
-        //compute base image from general to transfer src
-        transitionImageLayout(
-            commandBuffer, computeImages[0]->getImage(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_ACCESS_SHADER_WRITE_BIT,
-            VK_ACCESS_TRANSFER_READ_BIT,
-            1, false
-        );
-
-        //swapchain image from transfer src to transfer dst
-        transitionImageLayout(
-            commandBuffer, image,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_ACCESS_TRANSFER_READ_BIT,
-            VK_ACCESS_TRANSFER_WRITE_BIT,
-            1, false
-        );
-
-        vkCmdCopyImage(
-            commandBuffer,
-            computeImages[0]->getImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &copyRegion
-        );
     }
 
-}
\ No newline at end of file
+}
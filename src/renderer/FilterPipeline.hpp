@@ -1,19 +1,26 @@
 #pragma once
 
 #include "Utils.hpp"
+#include "WorkgroupTuner.hpp"
 #include "vulkan/VulkanTypes.h"
 #include "vulkan/VulkanConstants.h"
 
 #include <glm/glm.hpp>
 #include <memory>
+#include <algorithm>
 #include <array>
+#include <cstdint>
 #include <map>
+#include <vector>
 
 namespace fly {
 
     class Texture;
     class TextureSampler;
 
+    //The two hdr images owned by the engine, the filter chain ping-pongs between them
+    using HdrImages = std::array<std::shared_ptr<Texture>, 2>;
+
 
     class FilterPipeline {
     public:
@@ -21,41 +28,148 @@ namespace fly {
         virtual ~FilterPipeline();
 
         virtual void allocate(); // Has default implementation, but can be overriden
-        virtual void createResources() = 0;
+        virtual void createResources(const HdrImages& hdrImages) = 0;
         
-        virtual void applyFilter(VkCommandBuffer commandBuffer, VkImage image, uint32_t currentFrame) = 0;
+        //Reads hdrImages[input] and writes the other one, unless the filter works in place. Both images are in general layout
+        virtual void applyFilter(VkCommandBuffer commandBuffer, uint32_t input, uint32_t currentFrame) = 0;
+        virtual bool isInPlace() const { return false; }
+        //Name of the pass for the profiler and the workgroup tuner
+        virtual const char* getPassName() const = 0;
+
+        //Quality tiers, 0 is the cheapest and new filters start at the best one. Changing them doesn't touch the pipelines
+        virtual uint32_t getTierCount() const { return 1; }
+        uint32_t getTier() const { return std::min(this->tier, getTierCount() - 1); }
+        void setTier(uint32_t tier) { this->tier = tier; }
+        //A bypassed filter is skipped by the engine but keeps all its resources
+        bool isBypassed() const { return this->bypassed; }
+        void setBypass(bool bypass) { this->bypassed = bypass; }
 
     protected:
         virtual std::vector<char> getShaderCode() = 0;
-        virtual DescriptorSetLayout createDescriptorSetLayout() = 0;
+        virtual DescriptorSetLayout createDescriptorSetLayout() = 0; //Must have room for 2 * MAX_FRAMES_IN_FLIGHT sets
+        virtual SpecializationConstants getSpecializationConstants() { return {}; }
         
         std::shared_ptr<VulkanInstance> vk;
-        std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> descriptorSets;
+        //One set per input image and frame
+        std::array<std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT>, 2> descriptorSets;
         DescriptorSetLayout descriptorSetLayout;
         VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
         VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
-        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE; //Only for the filters that don't use the tuned pipeline
+        std::unique_ptr<TunedComputePipeline> tunedPipeline;
         size_t pushConstantSize = 0;
 
+    private:
+        uint32_t tier = UINT32_MAX;
+        bool bypassed = false;
+
     };
 
 
 
-    class GrayscaleFilter: public FilterPipeline {
-    private:
-        static constexpr const char* GRAYSCALE_SHADER_SRC = "vulkan-engine/shaders/filters/bin/grayscale.comp.spv";
+    /*
+    A filter that is a pure per pixel colour transform. All of them share the fused shader, so the engine 
+    can run several adjacent ones in a single dispatch with a FusedFilterChain
+    */
+    class PixelFilter: public FilterPipeline {
+    protected:
+        static constexpr const char* FUSED_SHADER_SRC = "vulkan-engine/shaders/filters/bin/fused.comp.spv";
     public:
-        GrayscaleFilter(std::shared_ptr<VulkanInstance> vk): FilterPipeline(vk) {}
+        static constexpr uint32_t MAX_FUSED_STAGES = 8; //Must match MAX_STAGES in the fused shader
+        enum Stage: uint32_t { //Must match the stages in the fused shader
+            STAGE_NONE = 0,
+            STAGE_GRAYSCALE,
+            STAGE_EXPOSURE,
+            STAGE_COLOR_GRADING
+        };
+        struct FusedPush { std::array<glm::vec4, MAX_FUSED_STAGES> params; };
 
-        void createResources() override;
-        void applyFilter(VkCommandBuffer commandBuffer, VkImage image, uint32_t currentFrame) override;
+        PixelFilter(std::shared_ptr<VulkanInstance> vk): FilterPipeline(vk) {
+            this->pushConstantSize = sizeof(FusedPush);
+        }
 
-    private:
-        std::unique_ptr<Texture> computeInputImage, computeOutputImage;  
+        void createResources(const HdrImages& hdrImages) override;
+        void applyFilter(VkCommandBuffer commandBuffer, uint32_t input, uint32_t currentFrame) override;
+        const char* getPassName() const override { return "pixel"; }
+
+        virtual Stage getStage() const = 0;
+        virtual glm::vec4 getStageParams() const { return glm::vec4(0); }
 
     protected:
-        std::vector<char> getShaderCode() override;
+        std::vector<char> getShaderCode() override { return readFile(FUSED_SHADER_SRC); }
         DescriptorSetLayout createDescriptorSetLayout() override;
+        //When it isn't fused it runs as a chain of one stage
+        SpecializationConstants getSpecializationConstants() override { return stageConstants({getStage()}); }
+
+        //The stages of the fused shader, the unused ones are STAGE_NONE
+        static SpecializationConstants stageConstants(const std::vector<Stage>& stages);
+        void dispatch(VkCommandBuffer commandBuffer, TunedComputePipeline& pipeline, const FusedPush& constants, uint32_t input, uint32_t currentFrame);
+
+    };
+
+
+
+    class GrayscaleFilter: public PixelFilter {
+    public:
+        GrayscaleFilter(std::shared_ptr<VulkanInstance> vk): PixelFilter(vk) {}
+
+        Stage getStage() const override { return STAGE_GRAYSCALE; }
+
+    };
+
+
+
+    class ExposureFilter: public PixelFilter {
+    public:
+        ExposureFilter(std::shared_ptr<VulkanInstance> vk): PixelFilter(vk) {}
+
+        Stage getStage() const override { return STAGE_EXPOSURE; }
+        glm::vec4 getStageParams() const override { return glm::vec4(this->stops, 0, 0, 0); }
+
+        void setStops(float stops) { this->stops = stops; }
+
+    private:
+        float stops = 0;
+
+    };
+
+
+
+    class ColorGradingFilter: public PixelFilter {
+    public:
+        ColorGradingFilter(std::shared_ptr<VulkanInstance> vk): PixelFilter(vk) {}
+
+        Stage getStage() const override { return STAGE_COLOR_GRADING; }
+        glm::vec4 getStageParams() const override { return glm::vec4(this->contrast, this->saturation, this->brightness, 0); }
+
+        void setContrast(float contrast) { this->contrast = contrast; }
+        void setSaturation(float saturation) { this->saturation = saturation; }
+        void setBrightness(float brightness) { this->brightness = brightness; }
+
+    private:
+        float contrast = 1.0, saturation = 1.0, brightness = 0.0;
+
+    };
+
+
+
+    /*
+    Controlled by the engine, runs a run of adjacent pixel filters in a single dispatch.
+    There is one pipeline per chain signature, built the first time it is seen and cached after that
+    */
+    class FusedFilterChain: public PixelFilter {
+    public:
+        FusedFilterChain(std::shared_ptr<VulkanInstance> vk): PixelFilter(vk) {}
+
+        void allocate() override;
+        void applyChain(VkCommandBuffer commandBuffer, const std::vector<PixelFilter*>& chain, uint32_t input, uint32_t currentFrame);
+
+        Stage getStage() const override { return STAGE_NONE; }
+
+    private:
+        std::map<uint64_t, std::unique_ptr<TunedComputePipeline>> pipelineCache;
+
+        void applyFilter(VkCommandBuffer, uint32_t, uint32_t) override { FLY_ASSERT(0, "YOU MUST NOT USE THIS METHOD!!"); }
 
     };
 
@@ -66,24 +180,30 @@ namespace fly {
         static constexpr const char* FXAA_SHADER_SRC = "vulkan-engine/shaders/filters/bin/fxaa.comp.spv";
     public:
         struct FxaaPush {
-            glm::vec2 screenSize; 
-            float spanMax, reduceMul, reduceMin;
+            glm::vec2 screenSize, maxUv; 
+            float spanMax, reduceMul, reduceMin, edgeThreshold;
         };
+        enum Tier: uint32_t { TIER_LOW = 0, TIER_MEDIUM, TIER_HIGH, TIER_COUNT };
 
         FxaaFilter(std::shared_ptr<VulkanInstance> vk): FilterPipeline(vk) {
             this->pushConstantSize = sizeof(FxaaPush);
         }
 
-        void createResources() override;
-        void applyFilter(VkCommandBuffer commandBuffer, VkImage image, uint32_t currentFrame) override;
+        void createResources(const HdrImages& hdrImages) override;
+        void applyFilter(VkCommandBuffer commandBuffer, uint32_t input, uint32_t currentFrame) override;
+        const char* getPassName() const override { return "fxaa"; }
+        uint32_t getTierCount() const override { return TIER_COUNT; }
     
         void setSpanMax(float spanMax) { this->spanMax = spanMax; }
         void setReduceMul(float reduceMul) { this->reduceMul = reduceMul; }
         void setReduceMin(float reduceMin) { this->reduceMin = reduceMin; }
 
     private:
+        //The lower presets skip the texels with little contrast and shorten the search
+        struct Preset { float edgeThreshold, spanCap; };
+        static constexpr std::array<Preset, TIER_COUNT> PRESETS = {{ {1.0f/4.0f, 4.0f}, {1.0f/8.0f, 8.0f}, {0.0f, 16.0f} }};
+
         std::unique_ptr<TextureSampler> inputSampler;
-        std::unique_ptr<Texture> computeInputImage, computeOutputImage;  
 
         float spanMax = 8.0, reduceMul = 1.0/8.0, reduceMin = 1.0/128.0;
 
@@ -98,29 +218,36 @@ namespace fly {
     private:
         static constexpr const char* BLOOM_DOWNSAMPLE_SHADER_SRC = "vulkan-engine/shaders/filters/bin/bloom_downsample.comp.spv";
         static constexpr const char* BLOOM_UPSAMPLE_SHADER_SRC = "vulkan-engine/shaders/filters/bin/bloom_upsample.comp.spv";
-        static constexpr int BLOOM_LEVELS = 6;
+        static constexpr int BLOOM_LEVELS = 6; //Must match BLOOM_LEVELS in the bloom shaders, it is the most levels a tier can use
+        static constexpr int MIN_BLOOM_LEVELS = 3;
+        static constexpr int BLOOM_TILE_SIZE = 16; //Must match TILE_SIZE in the bloom shaders
+        static constexpr float MAX_UPSAMPLE_RADIUS = 7; //In texels, bounded by the apron the upsample keeps in shared memory
     public:
-        struct UpsamplePush { glm::vec2 invNormCurrResolution, filterRadius; float bloomIntensity; };
-        struct DownsamplePush { glm::vec2 srcTexelSize, invNormCurrResolution; float bloomThreshold; int srcIndex; };
+        //The base size is the render extent, the shaders derive the size of every level in use from it
+        struct UpsamplePush { glm::vec2 filterRadius; float bloomIntensity; int srcLevel; glm::ivec2 baseSize; };
+        struct DownsamplePush { float bloomThreshold; int dstLevel; glm::ivec2 baseSize; };
 
         BloomFilter(std::shared_ptr<VulkanInstance> vk): FilterPipeline(vk) {}
         ~BloomFilter() override;
 
         void allocate() override;
-        void createResources() override;
-        void applyFilter(VkCommandBuffer commandBuffer, VkImage image, uint32_t currentFrame) override;
+        void createResources(const HdrImages& hdrImages) override;
+        void applyFilter(VkCommandBuffer commandBuffer, uint32_t input, uint32_t currentFrame) override;
+        bool isInPlace() const override { return true; }
+        const char* getPassName() const override { return "bloom"; }
+        //Each tier builds one more level of the pyramid
+        uint32_t getTierCount() const override { return BLOOM_LEVELS - MIN_BLOOM_LEVELS + 1; }
         void setFilterRadius(glm::vec2 radius) { this->filterRadius = radius; }
         void settBloomIntensity(float bloom) { this->bloomIntensity = bloom; }
         void settBloomThreshold(float threshold) { this->bloomThreshold = threshold; }
 
     private:
-        std::array<std::unique_ptr<fly::TextureSampler>, BLOOM_LEVELS> computeSamplers;
-        std::array<std::unique_ptr<Texture>, BLOOM_LEVELS> computeImages;
-        std::array<glm::vec2, BLOOM_LEVELS> computeImageSizes;
+        //Level 0 is the input HDR image itself, the rest are owned by the filter
+        std::array<std::unique_ptr<Texture>, BLOOM_LEVELS - 1> mipImages;
+        std::array<glm::vec2, BLOOM_LEVELS> mipImageSizes; //Used part of every level on this frame
         VkPipelineLayout upsamplePipelineLayout = VK_NULL_HANDLE;
         VkPipeline upsamplePipeline = VK_NULL_HANDLE;
-        
-        std::map<std::pair<int,int>, std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT>> descriptorSetMap;
+
         glm::vec2 filterRadius;
         float bloomIntensity, bloomThreshold = 0;
 
@@ -130,38 +257,68 @@ namespace fly {
         
     private:
         std::vector<char> getUpsampleShaderCode();
-        void updateDescriptorSet(int inputLevel, int outputLevel);    
 
     };
 
 
 
     /*
-    This class doesn't need to follow the interface as it is controlled by the engine, but I wanted it to inherit the FilterPipeline behaviour
+    This class doesn't need to follow the interface as it is controlled by the engine, but I wanted it to inherit the FilterPipeline behaviour.
+    The exposure, the grading and the tone curve are baked in a 3D lookup table that is only rebuilt when they change
     */
     class Tonemapper: public FilterPipeline {
     private:
         static constexpr const char* TONEMAP_SHADER_SRC = "vulkan-engine/shaders/filters/bin/tonemap.comp.spv";
+        static constexpr const char* LUT_SHADER_SRC = "vulkan-engine/shaders/filters/bin/tonemap_lut.comp.spv";
+        static constexpr uint32_t LUT_SIZE = 32;
+        static constexpr uint32_t LUT_GROUP_SIZE = 4; //Must match the local size of the lut shader
     public:
         struct TonemapPush {
-            float exposure, invGamma;
+            glm::vec2 uvScale;
+        };
+        struct LutPush {
+            glm::vec4 grading; //contrast, saturation, brightness, exposure
+            glm::vec4 colorFilter; //rgb multiplier, inverse gamma
         };
 
         Tonemapper(std::shared_ptr<VulkanInstance> vk): FilterPipeline(vk) {
             this->pushConstantSize = sizeof(TonemapPush);
         }
+        ~Tonemapper() override;
 
-        void createResources(std::shared_ptr<Texture> hdrColorTexture);
-        void applyFilter(VkCommandBuffer commandBuffer, VkImage swapchainImage, uint32_t currentFrame) override;
-        void setExposure(float exposure) { this->exposure = exposure; }
-        void setGamma(float gamma) { this->gamma = gamma; }
+        void allocate() override;
+        void createResources(const HdrImages& hdrImages) override;
+        void applyFilter(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t input, uint32_t currentFrame);
+        const char* getPassName() const override { return "tonemap"; }
+        void setExposure(float exposure) { this->exposure = exposure; markLutDirty(); }
+        void setGamma(float gamma) { this->gamma = gamma; markLutDirty(); }
+        //Grading done in linear hdr after the exposure, like the ColorGradingFilter but for free
+        void setContrast(float contrast) { this->contrast = contrast; markLutDirty(); }
+        void setSaturation(float saturation) { this->saturation = saturation; markLutDirty(); }
+        void setBrightness(float brightness) { this->brightness = brightness; markLutDirty(); }
+        void setColorFilter(glm::vec3 colorFilter) { this->colorFilter = colorFilter; markLutDirty(); }
         
         private:
-        std::shared_ptr<Texture> hdrColorTexture;
-        std::unique_ptr<Texture> computeOutputImage;
+        std::unique_ptr<Texture> computeOutputImage; //Only when the swapchain can't be written directly
+        VkImageView boundOutputs[2][MAX_FRAMES_IN_FLIGHT] = {}; //Output view written in each set, to only rewrite it when it changes
+        std::unique_ptr<TextureSampler> inputSampler, lutSampler;
         float exposure = 1.0, gamma = 2.2;
-
-        void createResources() override { FLY_ASSERT(0, "YOU MUST NOT USE THIS METHOD!!"); }
+        float contrast = 1.0, saturation = 1.0, brightness = 0.0;
+        glm::vec3 colorFilter = glm::vec3(1.0);
+
+        //One table per frame in flight, so it can be rebuilt while the last frame still samples its own
+        std::array<std::unique_ptr<Texture>, MAX_FRAMES_IN_FLIGHT> luts;
+        std::array<bool, MAX_FRAMES_IN_FLIGHT> lutDirty{};
+        DescriptorSetLayout lutSetLayout;
+        VkDescriptorPool lutDescriptorPool = VK_NULL_HANDLE;
+        std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> lutDescriptorSets;
+        VkPipelineLayout lutPipelineLayout = VK_NULL_HANDLE;
+        VkPipeline lutPipeline = VK_NULL_HANDLE;
+
+        void applyFilter(VkCommandBuffer, uint32_t, uint32_t) override { FLY_ASSERT(0, "YOU MUST NOT USE THIS METHOD!!"); }
+        void bindOutput(VkImageView output, uint32_t input, uint32_t currentFrame);
+        void markLutDirty() { this->lutDirty.fill(true); }
+        void buildLut(VkCommandBuffer commandBuffer, uint32_t currentFrame);
 
     protected:
         std::vector<char> getShaderCode() override { return readFile(TONEMAP_SHADER_SRC); }
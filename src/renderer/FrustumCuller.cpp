@@ -0,0 +1,116 @@
+#include "FrustumCuller.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define FLY_CULL_SSE
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON)
+    #define FLY_CULL_NEON
+    #include <arm_neon.h>
+#endif
+
+namespace fly {
+
+    BoundingSphere BoundingSphere::transform(const glm::mat4& model) const {
+        //The biggest axis scale keeps the sphere conservative with non uniform scaling
+        float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+        return { glm::vec3(model * glm::vec4(this->center, 1.0f)), this->radius * scale };
+    }
+
+    void FrustumCuller::clear() {
+        this->x.clear();
+        this->y.clear();
+        this->z.clear();
+        this->radius.clear();
+        this->freeSlots.clear();
+    }
+
+    uint32_t FrustumCuller::add(const BoundingSphere& sphere) {
+        uint32_t slot;
+        if(!this->freeSlots.empty()) {
+            slot = this->freeSlots.back();
+            this->freeSlots.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(this->x.size());
+            this->x.push_back(0.0f);
+            this->y.push_back(0.0f);
+            this->z.push_back(0.0f);
+            this->radius.push_back(0.0f);
+        }
+        set(slot, sphere);
+        return slot;
+    }
+
+    void FrustumCuller::set(uint32_t slot, const BoundingSphere& sphere) {
+        this->x[slot] = sphere.center.x;
+        this->y[slot] = sphere.center.y;
+        this->z[slot] = sphere.center.z;
+        this->radius[slot] = sphere.radius;
+    }
+
+    //No distance is under minus infinity, so the slot fails every plane
+    void FrustumCuller::remove(uint32_t slot) {
+        set(slot, { glm::vec3(0.0f), -NEVER_CULLED });
+        this->freeSlots.push_back(slot);
+    }
+
+    void FrustumCuller::cull(const glm::mat4& projView, std::vector<uint8_t>& visible) const {
+        //Planes from the rows of the matrix, the near one is z >= 0 because of the Vulkan depth range
+        glm::vec4 row0 = glm::vec4(projView[0][0], projView[1][0], projView[2][0], projView[3][0]);
+        glm::vec4 row1 = glm::vec4(projView[0][1], projView[1][1], projView[2][1], projView[3][1]);
+        glm::vec4 row2 = glm::vec4(projView[0][2], projView[1][2], projView[2][2], projView[3][2]);
+        glm::vec4 row3 = glm::vec4(projView[0][3], projView[1][3], projView[2][3], projView[3][3]);
+        std::array<glm::vec4, 6> planes = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2 };
+        for(auto& p: planes)
+            p /= glm::length(glm::vec3(p));
+
+        size_t count = this->x.size();
+        visible.resize(count);
+        size_t i = 0;
+
+#if defined(FLY_CULL_SSE)
+        for(; i + 4 <= count; i += 4) {
+            __m128 px = _mm_loadu_ps(&this->x[i]), py = _mm_loadu_ps(&this->y[i]), pz = _mm_loadu_ps(&this->z[i]);
+            __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&this->radius[i]));
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for(const auto& p: planes) {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(p.x)), _mm_mul_ps(py, _mm_set1_ps(p.y))),
+                    _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negRadius));
+            }
+            int mask = _mm_movemask_ps(inside);
+            for(int j=0; j<4; ++j)
+                visible[i + j] = (mask >> j) & 1;
+        }
+#elif defined(FLY_CULL_NEON)
+        for(; i + 4 <= count; i += 4) {
+            float32x4_t px = vld1q_f32(&this->x[i]), py = vld1q_f32(&this->y[i]), pz = vld1q_f32(&this->z[i]);
+            float32x4_t negRadius = vnegq_f32(vld1q_f32(&this->radius[i]));
+            uint32x4_t inside = vdupq_n_u32(~0u);
+            for(const auto& p: planes) {
+                float32x4_t d = vdupq_n_f32(p.w);
+                d = vmlaq_n_f32(d, px, p.x);
+                d = vmlaq_n_f32(d, py, p.y);
+                d = vmlaq_n_f32(d, pz, p.z);
+                inside = vandq_u32(inside, vcgeq_f32(d, negRadius));
+            }
+            visible[i + 0] = vgetq_lane_u32(inside, 0) & 1;
+            visible[i + 1] = vgetq_lane_u32(inside, 1) & 1;
+            visible[i + 2] = vgetq_lane_u32(inside, 2) & 1;
+            visible[i + 3] = vgetq_lane_u32(inside, 3) & 1;
+        }
+#endif
+
+        //The ones that don't fill a vector, or all of them without SIMD
+        for(; i < count; ++i) {
+            bool inside = true;
+            for(const auto& p: planes)
+                inside = inside && (p.x * this->x[i] + p.y * this->y[i] + p.z * this->z[i] + p.w >= -this->radius[i]);
+            visible[i] = inside;
+        }
+    }
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace fly {
+
+    struct BoundingSphere {
+        glm::vec3 center;
+        float radius;
+
+        BoundingSphere transform(const glm::mat4& model) const;
+    };
+
+    /*
+    Culls bounding spheres against the frustum of a Vulkan projection (depth from 0 to 1)
+    The spheres are stored as structure of arrays, so each plane is tested against 4 spheres at once with SSE or NEON
+
+    Each sphere keeps its slot until it is removed, so the arrays are only written when a sphere changes. The removed slots
+    are reused by the next ones and are always culled in between
+    */
+    class FrustumCuller {
+    public:
+        //A sphere with this radius is always visible
+        static constexpr float NEVER_CULLED = std::numeric_limits<float>::infinity();
+
+        void clear();
+        uint32_t add(const BoundingSphere& sphere);
+        void set(uint32_t slot, const BoundingSphere& sphere);
+        void remove(uint32_t slot);
+        glm::vec3 getCenter(uint32_t slot) const { return glm::vec3(this->x[slot], this->y[slot], this->z[slot]); }
+        size_t size() const { return this->x.size(); } //Removed slots included
+
+        //visible[i] is 1 if the sphere of slot i touches the frustum
+        void cull(const glm::mat4& projView, std::vector<uint8_t>& visible) const;
+
+    private:
+        std::vector<float> x, y, z, radius;
+        std::vector<uint32_t> freeSlots;
+    };
+
+}
@@ -0,0 +1,336 @@
+#include "GeometryArena.hpp"
+
+#include "vulkan/VulkanHelpers.hpp"
+
+#include <Utils.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+namespace fly {
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    GeometryArena::GeometryArena(std::shared_ptr<VulkanInstance> vk): vk{vk} {}
+
+    GeometryArena::~GeometryArena() {
+        while(!this->retired.empty()) {
+            auto& r = this->retired.front();
+            vmaDestroyBuffer(vk->allocator, r.buffer, r.alloc);
+            this->retired.pop();
+        }
+
+        vmaDestroyBuffer(vk->allocator, this->vertexBuffer, this->vertexAlloc);
+        vmaDestroyBuffer(vk->allocator, this->indexBuffer, this->indexAlloc);
+    }
+
+    void GeometryArena::createBuffer(VkDeviceSize size, bool indices, VkBuffer& buffer, VmaAllocation& alloc) {
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+        //The compaction and the growth copy from the old buffers to new ones. The meshlet culling reads the indices in a compute shader
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.usage |= indices? VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        if(vmaCreateBuffer(vk->allocator, &bufferInfo, &allocInfo, &buffer, &alloc, nullptr) != VK_SUCCESS)
+            throw std::runtime_error(indices? "failed to create geometry arena index buffer!" : "failed to create geometry arena vertex buffer!");
+    }
+
+    void GeometryArena::retire(VkBuffer buffer, VmaAllocation alloc) {
+        //The frames in flight still draw from the old buffer
+        if(buffer != VK_NULL_HANDLE)
+            this->retired.push({ buffer, alloc, this->currentFrame });
+    }
+
+    std::optional<VkDeviceSize> GeometryArena::allocateRange(VkCommandPool commandPool, bool indices, VkDeviceSize size, VkDeviceSize alignment) {
+        FreeList& ranges = indices? this->indexRanges : this->vertexRanges;
+        auto offset = ranges.allocate(size, alignment);
+        if(offset)
+            return offset;
+
+        //Enough for the range even if the free space at the end is not aligned
+        VkDeviceSize maxCapacity = indices? MAX_INDEX_CAPACITY : MAX_VERTEX_CAPACITY;
+        VkDeviceSize capacity = std::min(alignUp(ranges.capacity + size + alignment, GROWTH_BLOCK), maxCapacity);
+        if(capacity <= ranges.capacity)
+            return std::nullopt;
+
+        VkBuffer& buffer = indices? this->indexBuffer : this->vertexBuffer;
+        VmaAllocation& alloc = indices? this->indexAlloc : this->vertexAlloc;
+        VkBuffer newBuffer;
+        VmaAllocation newAlloc;
+        createBuffer(capacity, indices, newBuffer, newAlloc);
+
+        //The offsets don't change, so the old buffer is copied as a whole
+        if(buffer != VK_NULL_HANDLE) {
+            auto commandBuffer = beginSingleTimeCommands(vk, commandPool);
+            VkBufferCopy region{0, 0, ranges.capacity};
+            vkCmdCopyBuffer(commandBuffer, buffer, newBuffer, 1, &region);
+            endSingleTimeCommands(vk, commandPool, commandBuffer);
+        }
+
+        retire(buffer, alloc);
+        buffer = newBuffer;
+        alloc = newAlloc;
+        ranges.grow(capacity);
+        this->generation++;
+        return ranges.allocate(size, alignment);
+    }
+
+    std::optional<GeometryArena::Handle> GeometryArena::allocate(VkCommandPool commandPool, VkDeviceSize vertexSize, VkDeviceSize vertexStride, VkDeviceSize indexSize, VkDeviceSize indexStride) {
+        std::unique_lock<std::mutex> lock(this->mtx);
+
+        auto vertexOffset = allocateRange(commandPool, false, vertexSize, vertexStride);
+        if(!vertexOffset)
+            return std::nullopt;
+
+        auto indexOffset = allocateRange(commandPool, true, indexSize, indexStride);
+        if(!indexOffset) {
+            this->vertexRanges.free(*vertexOffset, vertexSize);
+            return std::nullopt;
+        }
+
+        Handle handle = this->nextHandle++;
+        this->allocations[handle] = Allocation{ *vertexOffset, vertexSize, vertexStride, *indexOffset, indexSize, indexStride };
+        return handle;
+    }
+
+    void GeometryArena::free(Handle handle) {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        auto node = this->allocations.extract(handle);
+        FLY_ASSERT(!node.empty(), "Geometry range freed twice!");
+
+        const auto& allocation = node.mapped();
+        this->vertexRanges.free(allocation.vertexOffset, allocation.vertexSize);
+        this->indexRanges.free(allocation.indexOffset, allocation.indexSize);
+        this->freedSinceCompaction = true;
+    }
+
+    GeometryArena::Allocation GeometryArena::get(Handle handle) {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        return this->allocations.at(handle);
+    }
+
+    void GeometryArena::upload(VkCommandPool commandPool, Handle handle, const void* vertices, const void* indices) {
+        //Held for the whole copy, so a compaction can't move the range while it is written
+        std::unique_lock<std::mutex> lock(this->mtx);
+        const auto& allocation = this->allocations.at(handle);
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = allocation.vertexSize + allocation.indexSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VkBuffer stagingBuffer;
+        VmaAllocation stagingAlloc;
+        VmaAllocationInfo stagingInfo;
+        if(vmaCreateBuffer(vk->allocator, &bufferInfo, &allocInfo, &stagingBuffer, &stagingAlloc, &stagingInfo) != VK_SUCCESS)
+            throw std::runtime_error("failed to create geometry staging buffer!");
+
+        auto data = static_cast<char*>(stagingInfo.pMappedData);
+        memcpy(data, vertices, allocation.vertexSize);
+        memcpy(data + allocation.vertexSize, indices, allocation.indexSize);
+
+        auto commandBuffer = beginSingleTimeCommands(vk, commandPool);
+
+        VkBufferCopy vertexRegion{0, allocation.vertexOffset, allocation.vertexSize};
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, this->vertexBuffer, 1, &vertexRegion);
+        VkBufferCopy indexRegion{allocation.vertexSize, allocation.indexOffset, allocation.indexSize};
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, this->indexBuffer, 1, &indexRegion);
+
+        endSingleTimeCommands(vk, commandPool, commandBuffer);
+        vmaDestroyBuffer(vk->allocator, stagingBuffer, stagingAlloc);
+    }
+
+    void GeometryArena::update(uint32_t currentFrame, VkCommandPool commandPool) {
+        //Only worth checking after something was detached
+        bool needsCompaction = false;
+        {
+            //The arena can grow while a scene loads in another thread, its buffers are retired on the last frame updated
+            std::unique_lock<std::mutex> lock(this->mtx);
+            this->currentFrame = currentFrame;
+            while(!this->retired.empty()) {
+                auto& r = this->retired.front();
+                if(r.frame != currentFrame)
+                    break;
+                vmaDestroyBuffer(vk->allocator, r.buffer, r.alloc);
+                this->retired.pop();
+            }
+
+            if(this->freedSinceCompaction) {
+                this->freedSinceCompaction = false;
+                VkDeviceSize holes = this->vertexRanges.getHoleBytes() + this->indexRanges.getHoleBytes();
+                VkDeviceSize used = this->vertexRanges.used + this->indexRanges.used;
+                needsCompaction = holes >= MIN_COMPACTION_BYTES && holes > COMPACTION_RATIO * used;
+            }
+        }
+
+        if(needsCompaction)
+            compact(currentFrame, commandPool);
+    }
+
+    void GeometryArena::compact(uint32_t currentFrame, VkCommandPool commandPool) {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        this->currentFrame = currentFrame;
+
+        //The ranges keep their order, so they only move towards the start
+        std::vector<std::pair<VkDeviceSize, Handle>> byVertex, byIndex;
+        for(const auto& [handle, allocation]: this->allocations) {
+            byVertex.emplace_back(allocation.vertexOffset, handle);
+            byIndex.emplace_back(allocation.indexOffset, handle);
+        }
+        std::sort(byVertex.begin(), byVertex.end());
+        std::sort(byIndex.begin(), byIndex.end());
+
+        std::vector<VkBufferCopy> vertexCopies, indexCopies;
+        VkDeviceSize vertexEnd = 0, indexEnd = 0;
+        for(auto [offset, handle]: byVertex) {
+            auto& allocation = this->allocations.at(handle);
+            VkDeviceSize aligned = alignUp(vertexEnd, allocation.vertexStride);
+            vertexCopies.push_back({offset, aligned, allocation.vertexSize});
+            allocation.vertexOffset = aligned;
+            vertexEnd = aligned + allocation.vertexSize;
+        }
+        for(auto [offset, handle]: byIndex) {
+            auto& allocation = this->allocations.at(handle);
+            VkDeviceSize aligned = alignUp(indexEnd, allocation.indexStride);
+            indexCopies.push_back({offset, aligned, allocation.indexSize});
+            allocation.indexOffset = aligned;
+            indexEnd = aligned + allocation.indexSize;
+        }
+
+        //The new buffers only keep the blocks in use, they are not created when the arena is empty
+        VkDeviceSize vertexCapacity = alignUp(vertexEnd, GROWTH_BLOCK), indexCapacity = alignUp(indexEnd, GROWTH_BLOCK);
+        VkBuffer newVertexBuffer = VK_NULL_HANDLE, newIndexBuffer = VK_NULL_HANDLE;
+        VmaAllocation newVertexAlloc = VK_NULL_HANDLE, newIndexAlloc = VK_NULL_HANDLE;
+        if(!vertexCopies.empty()) {
+            createBuffer(vertexCapacity, false, newVertexBuffer, newVertexAlloc);
+            createBuffer(indexCapacity, true, newIndexBuffer, newIndexAlloc);
+
+            auto commandBuffer = beginSingleTimeCommands(vk, commandPool);
+            vkCmdCopyBuffer(commandBuffer, this->vertexBuffer, newVertexBuffer, static_cast<uint32_t>(vertexCopies.size()), vertexCopies.data());
+            vkCmdCopyBuffer(commandBuffer, this->indexBuffer, newIndexBuffer, static_cast<uint32_t>(indexCopies.size()), indexCopies.data());
+            endSingleTimeCommands(vk, commandPool, commandBuffer);
+        }
+
+        retire(this->vertexBuffer, this->vertexAlloc);
+        retire(this->indexBuffer, this->indexAlloc);
+        this->vertexBuffer = newVertexBuffer;
+        this->indexBuffer = newIndexBuffer;
+        this->vertexAlloc = newVertexAlloc;
+        this->indexAlloc = newIndexAlloc;
+
+        this->vertexRanges.reset(vertexEnd, vertexCapacity);
+        this->indexRanges.reset(indexEnd, indexCapacity);
+        this->generation++;
+    }
+
+
+    std::optional<VkDeviceSize> GeometryArena::FreeList::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+        //The smallest range that fits once its offset is aligned. Any range of size + alignment - 1 fits, so the search stops there
+        auto best = this->bySize.lower_bound(size);
+        for(; best != this->bySize.end(); ++best) {
+            auto [rangeSize, offset] = *best;
+            if(alignUp(offset, alignment) + size <= offset + rangeSize)
+                break;
+        }
+        if(best == this->bySize.end())
+            return std::nullopt;
+
+        auto it = this->ranges.find(best->second);
+        auto [offset, rangeSize] = *it;
+        VkDeviceSize aligned = alignUp(offset, alignment);
+
+        //The padding before and the rest after stay free
+        erase(it);
+        if(aligned > offset)
+            insert(offset, aligned - offset);
+        if(aligned + size < offset + rangeSize)
+            insert(aligned + size, offset + rangeSize - aligned - size);
+
+        this->used += size;
+        return aligned;
+    }
+
+    void GeometryArena::FreeList::free(VkDeviceSize offset, VkDeviceSize size) {
+        this->used -= size;
+
+        auto next = this->ranges.lower_bound(offset);
+        FLY_ASSERT(next == this->ranges.end() || next->first >= offset + size, "Geometry range freed twice!");
+        if(next != this->ranges.end() && offset + size == next->first) {
+            size += next->second;
+            next = std::next(next);
+            erase(std::prev(next));
+        }
+        if(next != this->ranges.begin()) {
+            auto prev = std::prev(next);
+            if(prev->first + prev->second == offset) {
+                offset = prev->first;
+                size += prev->second;
+                erase(prev);
+            }
+        }
+        insert(offset, size);
+    }
+
+    void GeometryArena::FreeList::grow(VkDeviceSize newCapacity) {
+        //The new space is merged with the free range at the end, if there is one
+        VkDeviceSize offset = this->capacity, size = newCapacity - this->capacity;
+        if(!this->ranges.empty()) {
+            auto last = std::prev(this->ranges.end());
+            if(last->first + last->second == this->capacity) {
+                offset = last->first;
+                size += last->second;
+                erase(last);
+            }
+        }
+        this->capacity = newCapacity;
+        insert(offset, size);
+    }
+
+    void GeometryArena::FreeList::reset(VkDeviceSize end, VkDeviceSize newCapacity) {
+        this->capacity = newCapacity;
+        this->ranges.clear();
+        this->bySize.clear();
+        if(end < this->capacity)
+            insert(end, this->capacity - end);
+    }
+
+    VkDeviceSize GeometryArena::FreeList::getHoleBytes() const {
+        VkDeviceSize freeBytes = this->capacity - this->used;
+        if(!this->ranges.empty()) {
+            auto last = std::prev(this->ranges.end());
+            if(last->first + last->second == this->capacity)
+                freeBytes -= last->second;
+        }
+        return freeBytes;
+    }
+
+    void GeometryArena::FreeList::insert(VkDeviceSize offset, VkDeviceSize size) {
+        this->ranges[offset] = size;
+        this->bySize.emplace(size, offset);
+    }
+
+    void GeometryArena::FreeList::erase(std::map<VkDeviceSize, VkDeviceSize>::iterator it) {
+        auto [first, last] = this->bySize.equal_range(it->second);
+        for(; first != last; ++first) {
+            if(first->second == it->first) {
+                this->bySize.erase(first);
+                break;
+            }
+        }
+        this->ranges.erase(it);
+    }
+
+}
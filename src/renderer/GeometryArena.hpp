@@ -0,0 +1,123 @@
+#pragma once
+
+#include "vulkan/VulkanTypes.h"
+
+#include <map>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <unordered_map>
+
+namespace fly {
+
+    /*
+    One big vertex buffer and one big index buffer shared by all the static meshes, so a pipeline
+    can bind them once and draw every mesh with a single indirect call. Ranges are handed out best fit
+
+    The meshes only keep a handle, because compaction moves their ranges when the holes left by detached meshes
+    grow too much. The old buffers are destroyed once the frames in flight are done with them
+
+    The buffers are created on the first allocation and grow by blocks when a mesh doesn't fit, up to the max capacity.
+    Growing keeps the offsets, the contents are copied to the bigger buffer. Compaction shrinks them back to the used blocks
+
+    The index buffer holds 16 and 32 bit ranges, each mesh binds it with its own index type. Only the meshes drawn one by one can
+    use 16 bits, the indirect draws bind it once as 32 bit indices and the meshlet culling reads them as such
+    */
+    class GeometryArena {
+    public:
+        static constexpr VkDeviceSize MAX_VERTEX_CAPACITY = 64 << 20, MAX_INDEX_CAPACITY = 64 << 20; //In bytes
+        static constexpr VkDeviceSize GROWTH_BLOCK = 4 << 20;
+        //Compact when the holes are bigger than this part of the used bytes
+        static constexpr double COMPACTION_RATIO = 0.25;
+        static constexpr VkDeviceSize MIN_COMPACTION_BYTES = 1 << 20;
+
+        using Handle = uint32_t;
+        struct Allocation {
+            VkDeviceSize vertexOffset, vertexSize, vertexStride; //Vertex offset is a multiple of the vertex stride
+            VkDeviceSize indexOffset, indexSize, indexStride; //Index offset is a multiple of the index stride, 2 or 4 bytes
+        };
+
+        GeometryArena(std::shared_ptr<VulkanInstance> vk);
+        ~GeometryArena();
+
+        //Returns nothing if there is no room left, the mesh must use its own buffers then. The pool records the copy when it grows
+        std::optional<Handle> allocate(VkCommandPool commandPool, VkDeviceSize vertexSize, VkDeviceSize vertexStride, VkDeviceSize indexSize, VkDeviceSize indexStride);
+        //Must not be used by the frames in flight anymore
+        void free(Handle handle);
+        void upload(VkCommandPool commandPool, Handle handle, const void* vertices, const void* indices);
+        Allocation get(Handle handle);
+
+        //Destroys the buffers retired on this frame and compacts if needed, call it once per frame before recording
+        void update(uint32_t currentFrame, VkCommandPool commandPool);
+        void compact(uint32_t currentFrame, VkCommandPool commandPool);
+
+        //Both change after a compaction or when the arena grows, they are null until something is allocated
+        VkBuffer getVertexBuffer() const { 
+            std::unique_lock<std::mutex> lock(this->mtx);
+            return this->vertexBuffer; 
+        }
+        VkBuffer getIndexBuffer() const { 
+            std::unique_lock<std::mutex> lock(this->mtx);
+            return this->indexBuffer; 
+        }
+        //Increased on each compaction and growth, the offsets of the meshes and the buffers have to be read again
+        uint64_t getGeneration() const { 
+            std::unique_lock<std::mutex> lock(this->mtx);
+            return this->generation; 
+        }
+
+        VkDeviceSize getUsedBytes() const { 
+            std::unique_lock<std::mutex> lock(this->mtx);
+            return this->vertexRanges.used + this->indexRanges.used; 
+        }
+        VkDeviceSize getCapacity() const { 
+            std::unique_lock<std::mutex> lock(this->mtx);
+            return this->vertexRanges.capacity + this->indexRanges.capacity; 
+        }
+
+    private:
+        //Free ranges by offset, neighbours are merged when freed. The size index finds the best fit in O(log n)
+        struct FreeList {
+            std::map<VkDeviceSize, VkDeviceSize> ranges;
+            std::multimap<VkDeviceSize, VkDeviceSize> bySize;
+            VkDeviceSize capacity = 0, used = 0;
+
+            std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment);
+            void free(VkDeviceSize offset, VkDeviceSize size);
+            void grow(VkDeviceSize newCapacity);
+            void reset(VkDeviceSize end, VkDeviceSize newCapacity); //Everything before end is in use
+            //Free bytes that are not at the end of the buffer
+            VkDeviceSize getHoleBytes() const;
+
+        private:
+            void insert(VkDeviceSize offset, VkDeviceSize size);
+            void erase(std::map<VkDeviceSize, VkDeviceSize>::iterator it);
+        };
+
+        struct RetiredBuffer {
+            VkBuffer buffer;
+            VmaAllocation alloc;
+            uint32_t frame;
+        };
+
+        std::shared_ptr<VulkanInstance> vk;
+        mutable std::mutex mtx; //Scenes load their meshes in another thread
+
+        VkBuffer vertexBuffer = VK_NULL_HANDLE, indexBuffer = VK_NULL_HANDLE;
+        VmaAllocation vertexAlloc = VK_NULL_HANDLE, indexAlloc = VK_NULL_HANDLE;
+        FreeList vertexRanges, indexRanges;
+
+        std::unordered_map<Handle, Allocation> allocations;
+        Handle nextHandle = 0;
+        uint64_t generation = 0;
+        bool freedSinceCompaction = false;
+        uint32_t currentFrame = 0; //Of the last update, the meshes can be loaded in between
+        std::queue<RetiredBuffer> retired;
+
+        void createBuffer(VkDeviceSize size, bool indices, VkBuffer& buffer, VmaAllocation& alloc);
+        //Grows the buffer when the range doesn't fit, returns nothing past the max capacity
+        std::optional<VkDeviceSize> allocateRange(VkCommandPool commandPool, bool indices, VkDeviceSize size, VkDeviceSize alignment);
+        void retire(VkBuffer buffer, VmaAllocation alloc);
+    };
+
+}
@@ -0,0 +1,111 @@
+#include "GpuProfiler.hpp"
+
+#include <Utils.hpp>
+
+#include <stdexcept>
+
+namespace fly {
+
+    GpuProfiler::GpuProfiler(std::shared_ptr<VulkanInstance> vk): vk{vk} {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(vk->physicalDevice, &properties);
+
+        this->supported = properties.limits.timestampComputeAndGraphics == VK_TRUE;
+        this->timestampPeriod = properties.limits.timestampPeriod;
+        if(!this->supported)
+            return;
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = MAX_TIMESTAMPS;
+
+        for(auto& pool: this->queryPools) {
+            if(vkCreateQueryPool(vk->device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+                throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+
+    GpuProfiler::~GpuProfiler() {
+        for(auto pool: this->queryPools)
+            vkDestroyQueryPool(vk->device, pool, nullptr);
+    }
+
+    void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+        this->currentFrame = currentFrame;
+        this->passOpen = false;
+        if(!this->supported)
+            return;
+
+        readResults(currentFrame);
+
+        vkCmdResetQueryPool(commandBuffer, this->queryPools[currentFrame], 0, MAX_TIMESTAMPS);
+        this->passQueries[currentFrame].clear();
+        this->queryCounts[currentFrame] = 0;
+
+        uint32_t query;
+        writeTimestamp(commandBuffer, query);
+    }
+
+    void GpuProfiler::endFrame(VkCommandBuffer commandBuffer) {
+        FLY_ASSERT(!this->passOpen, "A GPU pass wasn't ended!");
+        uint32_t query;
+        writeTimestamp(commandBuffer, query);
+    }
+
+    void GpuProfiler::beginPass(VkCommandBuffer commandBuffer, const std::string& name) {
+        FLY_ASSERT(!this->passOpen, "GPU passes can't be nested!");
+        
+        PassQuery pass{name, 0, 0};
+        if(writeTimestamp(commandBuffer, pass.begin)) {
+            this->passQueries[this->currentFrame].push_back(pass);
+            this->passOpen = true;
+        }
+    }
+
+    void GpuProfiler::endPass(VkCommandBuffer commandBuffer) {
+        if(!this->passOpen)
+            return;
+
+        this->passOpen = false;
+        if(!writeTimestamp(commandBuffer, this->passQueries[this->currentFrame].back().end))
+            this->passQueries[this->currentFrame].pop_back();
+    }
+
+    bool GpuProfiler::writeTimestamp(VkCommandBuffer commandBuffer, uint32_t& query) {
+        auto& count = this->queryCounts[this->currentFrame];
+        if(!this->supported || count == MAX_TIMESTAMPS)
+            return false;
+
+        query = count++;
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->queryPools[this->currentFrame], query);
+        return true;
+    }
+
+    void GpuProfiler::readResults(uint32_t frame) {
+        this->passTimes.clear();
+        
+        uint32_t count = this->queryCounts[frame];
+        if(count < 2) 
+            return;
+
+        std::array<uint64_t, MAX_TIMESTAMPS> timestamps;
+        auto result = vkGetQueryPoolResults(
+            vk->device, this->queryPools[frame], 
+            0, count, 
+            count * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), 
+            VK_QUERY_RESULT_64_BIT
+        );
+        if(result != VK_SUCCESS)
+            return;
+
+        auto toMs = [&](uint64_t begin, uint64_t end) {
+            return (end - begin) * this->timestampPeriod / 1e6;
+        };
+
+        for(auto& pass: this->passQueries[frame])
+            this->passTimes[pass.name] += toMs(timestamps[pass.begin], timestamps[pass.end]);
+        this->frameTime = toMs(timestamps[0], timestamps[count - 1]);
+    }
+
+}
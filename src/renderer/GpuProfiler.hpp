@@ -0,0 +1,56 @@
+#pragma once
+
+#include "vulkan/VulkanTypes.h"
+#include "vulkan/VulkanConstants.h"
+
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fly {
+
+    /*
+    Timestamps around the passes of a frame. The results of a frame slot are read the next time 
+    the slot is recorded, when its fence has already been waited, so reading them never stalls
+    */
+    class GpuProfiler {
+    private:
+        static constexpr uint32_t MAX_TIMESTAMPS = 64;
+    public:
+        GpuProfiler(std::shared_ptr<VulkanInstance> vk);
+        ~GpuProfiler();
+
+        void beginFrame(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+        void endFrame(VkCommandBuffer commandBuffer);
+
+        //Passes can't be nested, and passes with the same name in a frame are added up
+        void beginPass(VkCommandBuffer commandBuffer, const std::string& name);
+        void endPass(VkCommandBuffer commandBuffer);
+
+        bool isSupported() const { return this->supported; }
+        //Times in ms of the last finished frame recorded on the current slot
+        const std::map<std::string, double>& getPassTimes() const { return this->passTimes; }
+        double getFrameTime() const { return this->frameTime; }
+
+    private:
+        struct PassQuery { std::string name; uint32_t begin, end; };
+
+        std::shared_ptr<VulkanInstance> vk;
+        bool supported = false;
+        double timestampPeriod = 1; //ns per tick
+
+        std::array<VkQueryPool, MAX_FRAMES_IN_FLIGHT> queryPools{};
+        std::array<std::vector<PassQuery>, MAX_FRAMES_IN_FLIGHT> passQueries;
+        std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> queryCounts{};
+        uint32_t currentFrame = 0;
+        bool passOpen = false;
+
+        std::map<std::string, double> passTimes;
+        double frameTime = 0;
+
+        bool writeTimestamp(VkCommandBuffer commandBuffer, uint32_t& query);
+        void readResults(uint32_t frame);
+    };
+
+}
@@ -0,0 +1,209 @@
+#include "MeshCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+    #define NOMINMAX
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace fly {
+
+    //MAPPED FILE IMPLEMENTATION
+    std::unique_ptr<MappedFile> MappedFile::open(const std::filesystem::path& path) {
+        std::unique_ptr<MappedFile> mapped(new MappedFile());
+#ifdef _WIN32
+        mapped->file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(mapped->file == INVALID_HANDLE_VALUE) {
+            mapped->file = nullptr;
+            return nullptr;
+        }
+
+        LARGE_INTEGER size{};
+        if(!GetFileSizeEx(mapped->file, &size) || size.QuadPart <= 0)
+            return nullptr;
+
+        mapped->mapping = CreateFileMappingW(mapped->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(!mapped->mapping)
+            return nullptr;
+
+        void* view = MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!view)
+            return nullptr;
+        mapped->size = static_cast<size_t>(size.QuadPart);
+#else
+        mapped->fd = ::open(path.c_str(), O_RDONLY);
+        if(mapped->fd < 0)
+            return nullptr;
+
+        struct stat status{};
+        if(fstat(mapped->fd, &status) != 0 || status.st_size <= 0)
+            return nullptr;
+
+        void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, mapped->fd, 0);
+        if(view == MAP_FAILED)
+            return nullptr;
+        mapped->size = static_cast<size_t>(status.st_size);
+#endif
+        mapped->data = static_cast<const std::byte*>(view);
+        return mapped;
+    }
+
+    MappedFile::~MappedFile() {
+#ifdef _WIN32
+        if(this->data)
+            UnmapViewOfFile(this->data);
+        if(this->mapping)
+            CloseHandle(this->mapping);
+        if(this->file)
+            CloseHandle(this->file);
+#else
+        if(this->data)
+            munmap(const_cast<std::byte*>(this->data), this->size);
+        if(this->fd >= 0)
+            close(this->fd);
+#endif
+    }
+
+
+    //MESH CACHE IMPLEMENTATION
+    static constexpr char MESH_CACHE_MAGIC[4] = { 'F', 'L', 'Y', 'M' };
+
+    //FNV-1a, it only has to notice that the source changed
+    static uint64_t hashBytes(std::span<const std::byte> bytes) {
+        uint64_t hash = 14695981039346656037ull;
+        for(auto b: bytes) {
+            hash ^= static_cast<uint64_t>(b);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t alignSection(uint64_t offset) { return (offset + 15) & ~uint64_t(15); }
+
+    static bool sectionFits(uint64_t offset, uint64_t count, uint64_t stride, size_t fileSize) {
+        return offset % 16 == 0 && offset <= fileSize && count * stride <= fileSize - offset;
+    }
+
+    static int64_t getSourceTime(const std::filesystem::file_time_type& time) {
+        return static_cast<int64_t>(time.time_since_epoch().count());
+    }
+
+    std::filesystem::path MeshCache::getPath(const std::filesystem::path& source) {
+        std::error_code ec;
+        auto absolute = std::filesystem::absolute(source, ec);
+        auto key = (ec? source : absolute).generic_string();
+        auto name = std::format("{}-{:016x}.mesh", source.stem().string(), hashBytes(std::as_bytes(std::span(key))));
+        return std::filesystem::path(MESH_CACHE_DIR) / name;
+    }
+
+    std::unique_ptr<MeshCache> MeshCache::open(const std::filesystem::path& source) {
+        std::error_code ec;
+        auto sourceSize = std::filesystem::file_size(source, ec);
+        if(ec)
+            return nullptr;
+        auto sourceTime = std::filesystem::last_write_time(source, ec);
+        if(ec)
+            return nullptr;
+
+        auto file = MappedFile::open(getPath(source));
+        if(!file)
+            return nullptr;
+
+        auto data = file->getData();
+        if(data.size() < sizeof(Header))
+            return nullptr;
+
+        const auto* header = reinterpret_cast<const Header*>(data.data());
+        if(memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 || header->version != MESH_CACHE_VERSION)
+            return nullptr;
+
+        if(!sectionFits(header->vertexOffset, header->vertexCount, header->vertexStride, data.size())
+            || !sectionFits(header->indexOffset, header->indexCount, sizeof(uint32_t), data.size())
+            || !sectionFits(header->lodOffset, header->lodCount, sizeof(MeshLod), data.size())
+            || !sectionFits(header->meshletOffset, header->meshletCount, sizeof(Meshlet), data.size())
+            || !sectionFits(header->submeshOffset, header->submeshCount, sizeof(Submesh), data.size()))
+            return nullptr;
+
+        //A checkout or a copy changes the time but not the content, so only then the source is hashed
+        if(header->sourceSize != sourceSize)
+            return nullptr;
+        if(header->sourceTime != getSourceTime(sourceTime)) {
+            auto sourceFile = MappedFile::open(source);
+            if(!sourceFile || hashBytes(sourceFile->getData()) != header->sourceHash)
+                return nullptr;
+        }
+
+        std::unique_ptr<MeshCache> cache(new MeshCache());
+        cache->file = std::move(file);
+        cache->header = header;
+        return cache;
+    }
+
+    bool MeshCache::writeSections(const std::filesystem::path& source, const Sections& sections) {
+        std::error_code ec;
+        auto sourceTime = std::filesystem::last_write_time(source, ec);
+        if(ec)
+            return false;
+        auto sourceFile = MappedFile::open(source);
+        if(!sourceFile)
+            return false;
+
+        Header header{};
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+        header.version = MESH_CACHE_VERSION;
+        header.sourceSize = sourceFile->getData().size();
+        header.sourceTime = getSourceTime(sourceTime);
+        header.sourceHash = hashBytes(sourceFile->getData());
+
+        header.vertexStride = sections.vertexStride;
+        header.vertexCount = static_cast<uint32_t>(sections.vertices.size() / sections.vertexStride);
+        header.indexCount = static_cast<uint32_t>(sections.indices.size());
+        header.lodCount = static_cast<uint32_t>(sections.lods.size());
+        header.meshletCount = static_cast<uint32_t>(sections.meshlets.size());
+        header.submeshCount = static_cast<uint32_t>(sections.submeshes.size());
+        header.bounds = sections.bounds;
+        header.quantization = sections.quantization;
+
+        header.vertexOffset = alignSection(sizeof(Header));
+        header.indexOffset = alignSection(header.vertexOffset + sections.vertices.size_bytes());
+        header.lodOffset = alignSection(header.indexOffset + sections.indices.size_bytes());
+        header.meshletOffset = alignSection(header.lodOffset + sections.lods.size_bytes());
+        header.submeshOffset = alignSection(header.meshletOffset + sections.meshlets.size_bytes());
+
+        std::vector<std::byte> bytes(header.submeshOffset + sections.submeshes.size_bytes());
+        memcpy(bytes.data(), &header, sizeof(Header));
+        std::ranges::copy(sections.vertices, bytes.begin() + header.vertexOffset);
+        std::ranges::copy(std::as_bytes(sections.indices), bytes.begin() + header.indexOffset);
+        std::ranges::copy(std::as_bytes(sections.lods), bytes.begin() + header.lodOffset);
+        std::ranges::copy(std::as_bytes(sections.meshlets), bytes.begin() + header.meshletOffset);
+        std::ranges::copy(std::as_bytes(sections.submeshes), bytes.begin() + header.submeshOffset);
+
+        //Written next to it and renamed, so a crash never leaves half a file with a valid header
+        auto path = getPath(source);
+        auto temporary = path;
+        temporary += ".tmp";
+        std::filesystem::create_directories(path.parent_path(), ec);
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            if(!file)
+                return false;
+        }
+
+        std::filesystem::rename(temporary, path, ec);
+        return !ec;
+    }
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "TVertexArray.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+
+namespace fly {
+
+    constexpr const char* MESH_CACHE_DIR = "mesh_cache";
+    //Bump it when the layout of the file, the vertices or the processing of the meshes changes, so the old files are built again
+    constexpr uint32_t MESH_CACHE_VERSION = 4;
+
+    //A read only file mapped in memory
+    class MappedFile {
+    public:
+        //Null if the file can't be opened or is empty
+        static std::unique_ptr<MappedFile> open(const std::filesystem::path& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::span<const std::byte> getData() const { return { this->data, this->size }; }
+
+    private:
+        MappedFile() = default;
+
+        const std::byte* data = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        void* file = nullptr;
+        void* mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+    };
+
+    /*
+    The processed geometry of a model, written on the first load and mapped on the next ones so nothing is parsed again
+    It is valid while the source has the same size and modification time, or the same content hash when only the time changed
+    */
+    class MeshCache {
+    public:
+        //The file of each source is named after its absolute path
+        static std::filesystem::path getPath(const std::filesystem::path& source);
+
+        //Null if there is no cache for the source or it is stale, from another version or truncated
+        static std::unique_ptr<MeshCache> open(const std::filesystem::path& source);
+
+        template<typename Vertex_t>
+        static bool write(const std::filesystem::path& source, const TMeshGeometry<Vertex_t>& geometry) {
+            Sections sections{
+                std::as_bytes(geometry.vertices), sizeof(Vertex_t),
+                geometry.indices, geometry.lods, geometry.meshlets, geometry.submeshes,
+                geometry.bounds, geometry.quantization
+            };
+            return writeSections(source, sections);
+        }
+
+        //Points into the mapped file, so it is only valid while the cache is alive. Empty if the vertex doesn't have the stride of the file
+        template<typename Vertex_t>
+        std::optional<TMeshGeometry<Vertex_t>> getGeometry() const {
+            if(this->header->vertexStride != sizeof(Vertex_t))
+                return std::nullopt;
+
+            return TMeshGeometry<Vertex_t>{
+                section<Vertex_t>(this->header->vertexOffset, this->header->vertexCount),
+                section<uint32_t>(this->header->indexOffset, this->header->indexCount),
+                section<MeshLod>(this->header->lodOffset, this->header->lodCount),
+                section<Meshlet>(this->header->meshletOffset, this->header->meshletCount),
+                section<Submesh>(this->header->submeshOffset, this->header->submeshCount),
+                this->header->bounds,
+                this->header->quantization
+            };
+        }
+
+    private:
+        //Every section starts at a multiple of 16 bytes from the start of the file
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint64_t sourceSize;
+            int64_t sourceTime;
+            uint64_t sourceHash;
+
+            uint32_t vertexStride, vertexCount, indexCount, lodCount, meshletCount, submeshCount;
+            uint64_t vertexOffset, indexOffset, lodOffset, meshletOffset, submeshOffset;
+            BoundingSphere bounds;
+            VertexQuantization quantization;
+        };
+
+        struct Sections {
+            std::span<const std::byte> vertices;
+            uint32_t vertexStride;
+            std::span<const uint32_t> indices;
+            std::span<const MeshLod> lods;
+            std::span<const Meshlet> meshlets;
+            std::span<const Submesh> submeshes;
+            BoundingSphere bounds;
+            VertexQuantization quantization;
+        };
+
+        std::unique_ptr<MappedFile> file;
+        const Header* header = nullptr;
+
+        MeshCache() = default;
+
+        static bool writeSections(const std::filesystem::path& source, const Sections& sections);
+
+        template<typename T>
+        std::span<const T> section(uint64_t offset, uint32_t count) const {
+            return { reinterpret_cast<const T*>(this->file->getData().data() + offset), count };
+        }
+    };
+
+}
@@ -0,0 +1,328 @@
+#include "MeshLods.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+namespace fly {
+
+    //Sum of the squared distances to some planes, as a symmetric 4x4 matrix
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0, c = 0;
+
+        void addPlane(const glm::vec3& n, float d) {
+            a00 += n.x * n.x; a01 += n.x * n.y; a02 += n.x * n.z;
+            a11 += n.y * n.y; a12 += n.y * n.z; a22 += n.z * n.z;
+            b0 += n.x * d; b1 += n.y * d; b2 += n.z * d;
+            c += double(d) * d;
+        }
+
+        void add(const Quadric& q) {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02;
+            a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+        }
+
+        double evaluate(const glm::vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double result = a00*x*x + a11*y*y + a22*z*z + 2.0 * (a01*x*y + a02*x*z + a12*y*z)
+                + 2.0 * (b0*x + b1*y + b2*z) + c;
+            return std::max(result, 0.0);
+        }
+    };
+
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const {
+            //Adding zero turns -0 into 0, they are equal so they must hash the same
+            uint32_t x = std::bit_cast<uint32_t>(p.x + 0.0f), y = std::bit_cast<uint32_t>(p.y + 0.0f), z = std::bit_cast<uint32_t>(p.z + 0.0f);
+            return (x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u);
+        }
+    };
+
+    struct Collapse {
+        uint32_t from, to; //Welded vertices, from is moved onto to
+        double cost;
+    };
+
+    //A collapse can't flip the triangles that are left around the vertex
+    static bool canCollapse(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& weld, const std::vector<uint32_t>& triangles,
+        const std::vector<uint8_t>& dead, const uint32_t* adjacent, uint32_t adjacentCount, uint32_t from, uint32_t to) {
+        for(uint32_t i=0; i<adjacentCount; ++i) {
+            uint32_t t = adjacent[i];
+            if(dead[t])
+                continue;
+
+            uint32_t w[3] = { weld[triangles[3*t]], weld[triangles[3*t + 1]], weld[triangles[3*t + 2]] };
+            if(w[0] == to || w[1] == to || w[2] == to)
+                continue; //It is removed
+
+            uint32_t k = w[0] == from? 0 : w[1] == from? 1 : 2;
+            glm::vec3 a = positions[w[(k + 1) % 3]], b = positions[w[(k + 2) % 3]];
+            glm::vec3 before = glm::cross(a - positions[from], b - positions[from]);
+            glm::vec3 after = glm::cross(a - positions[to], b - positions[to]);
+            float lengthBefore = glm::length(before), lengthAfter = glm::length(after);
+            if(lengthBefore > 0.0f && (lengthAfter == 0.0f || glm::dot(before, after) < 0.25f * lengthBefore * lengthAfter))
+                return false;
+        }
+        return true;
+    }
+
+    struct SimplifiedLevel {
+        std::vector<uint32_t> indices;
+        float error;
+    };
+
+    //The simplified levels of a range, until one doesn't remove enough triangles. The pinned vertices are never collapsed
+    static std::vector<SimplifiedLevel> simplifyRange(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, 
+        const std::vector<uint8_t>& pinned) {
+        uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+        uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+
+        std::vector<SimplifiedLevel> levels;
+        if(triangleCount < LOD_MIN_TRIANGLES)
+            return levels;
+
+        //WELD, every vertex points to the first one with its position, so the seams of the normals and uvs don't tear
+        std::vector<uint32_t> weld(vertexCount);
+        {
+            std::unordered_map<glm::vec3, uint32_t, PositionHash> unique;
+            unique.reserve(vertexCount);
+            for(uint32_t v=0; v<vertexCount; ++v)
+                weld[v] = unique.try_emplace(positions[v], v).first->second;
+        }
+
+        //QUADRICS of the planes of the triangles. The triangles degenerated by the weld lock their vertices
+        std::vector<Quadric> quadrics(vertexCount);
+        std::vector<uint8_t> locked(vertexCount, 0);
+        for(uint32_t v=0; v<vertexCount; ++v)
+            locked[weld[v]] |= pinned[v];
+        std::unordered_map<uint64_t, uint32_t> edgeUses;
+        edgeUses.reserve(triangleCount * 3);
+        for(uint32_t t=0; t<triangleCount; ++t) {
+            uint32_t w[3] = { weld[indices[3*t]], weld[indices[3*t + 1]], weld[indices[3*t + 2]] };
+            if(w[0] == w[1] || w[1] == w[2] || w[0] == w[2]) {
+                locked[w[0]] = locked[w[1]] = locked[w[2]] = 1;
+                continue;
+            }
+
+            glm::vec3 normal = glm::cross(positions[w[1]] - positions[w[0]], positions[w[2]] - positions[w[0]]);
+            float length = glm::length(normal);
+            if(length > 0.0f) {
+                normal /= length;
+                float d = -glm::dot(normal, positions[w[0]]);
+                for(uint32_t k=0; k<3; ++k)
+                    quadrics[w[k]].addPlane(normal, d);
+            }
+
+            for(uint32_t k=0; k<3; ++k) {
+                uint32_t a = std::min(w[k], w[(k + 1) % 3]), b = std::max(w[k], w[(k + 1) % 3]);
+                edgeUses[(uint64_t(a) << 32) | b]++;
+            }
+        }
+
+        //BORDERS, and the edges of more than two triangles, are locked so the mesh keeps its outline
+        for(auto [edge, uses]: edgeUses) {
+            if(uses != 2) {
+                locked[edge >> 32] = 1;
+                locked[edge & 0xFFFFFFFF] = 1;
+            }
+        }
+
+        std::vector<uint32_t> triangles(indices.begin(), indices.begin() + triangleCount * 3);
+        std::vector<uint32_t> adjacencyOffsets, adjacency, fill;
+        std::vector<uint8_t> touched, dead;
+        std::vector<Collapse> collapses;
+        std::vector<std::pair<uint32_t, uint32_t>> remap;
+        double maxCost = 0.0;
+
+        uint32_t target = triangleCount, previous = triangleCount;
+        for(uint32_t level=1; level<LOD_MAX_LEVELS; ++level) {
+            target /= 2;
+            uint32_t current = static_cast<uint32_t>(triangles.size() / 3);
+
+            while(current > target) {
+                //ADJACENCY of the welded vertices, built again in every pass
+                adjacencyOffsets.assign(vertexCount + 1, 0);
+                for(auto i: triangles)
+                    adjacencyOffsets[weld[i] + 1]++;
+                for(uint32_t v=0; v<vertexCount; ++v)
+                    adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+                adjacency.resize(triangles.size());
+                fill.assign(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+                for(uint32_t i=0; i<triangles.size(); ++i)
+                    adjacency[fill[weld[triangles[i]]]++] = i / 3;
+
+                //CANDIDATES, both directions of every edge from the cheapest
+                collapses.clear();
+                for(uint32_t i=0; i<triangles.size(); ++i) {
+                    uint32_t u = weld[triangles[i]], v = weld[triangles[i - i % 3 + (i % 3 + 1) % 3]];
+                    double cost = quadrics[u].evaluate(positions[v]) + quadrics[v].evaluate(positions[v]);
+                    if(!locked[u] && u != v)
+                        collapses.push_back({ u, v, cost });
+                }
+                std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+                //Each vertex is only collapsed or collapsed into once per pass, so the costs don't go stale
+                touched.assign(vertexCount, 0);
+                dead.assign(current, 0);
+                uint32_t collapsed = 0;
+                for(const auto& collapse: collapses) {
+                    if(current <= target)
+                        break;
+
+                    auto [from, to, cost] = collapse;
+                    const uint32_t* adjacent = adjacency.data() + adjacencyOffsets[from];
+                    uint32_t adjacentCount = adjacencyOffsets[from + 1] - adjacencyOffsets[from];
+                    if(touched[from] || touched[to] || !canCollapse(positions, weld, triangles, dead, adjacent, adjacentCount, from, to))
+                        continue;
+
+                    //The triangles on the edge are removed, and the corners that stay take the vertex of their side of a seam
+                    remap.clear();
+                    for(uint32_t i=0; i<adjacentCount; ++i) {
+                        uint32_t t = adjacent[i];
+                        if(dead[t])
+                            continue;
+
+                        uint32_t corner = 3, other = 3;
+                        for(uint32_t k=0; k<3; ++k) {
+                            if(weld[triangles[3*t + k]] == from) corner = k;
+                            if(weld[triangles[3*t + k]] == to) other = k;
+                        }
+                        if(other < 3) {
+                            remap.emplace_back(triangles[3*t + corner], triangles[3*t + other]);
+                            dead[t] = 1;
+                            current--;
+                        }
+                    }
+
+                    for(uint32_t i=0; i<adjacentCount; ++i) {
+                        uint32_t t = adjacent[i];
+                        if(dead[t])
+                            continue;
+
+                        for(uint32_t k=0; k<3; ++k) {
+                            uint32_t& index = triangles[3*t + k];
+                            if(weld[index] != from)
+                                continue;
+
+                            auto it = std::find_if(remap.begin(), remap.end(), [&](const auto& r) { return r.first == index; });
+                            index = it != remap.end()? it->second : to;
+                        }
+                    }
+
+                    quadrics[to].add(quadrics[from]);
+                    touched[from] = touched[to] = 1;
+                    maxCost = std::max(maxCost, cost);
+                    collapsed++;
+                }
+
+                if(collapsed == 0)
+                    break;
+
+                uint32_t kept = 0;
+                for(uint32_t t=0; t<dead.size(); ++t) {
+                    if(dead[t])
+                        continue;
+                    for(uint32_t k=0; k<3; ++k)
+                        triangles[3*kept + k] = triangles[3*t + k];
+                    kept++;
+                }
+                triangles.resize(kept * 3);
+            }
+
+            //A level that barely removes triangles isn't worth it, and the next ones wouldn't either
+            uint32_t count = static_cast<uint32_t>(triangles.size() / 3);
+            if(count == 0 || count * 10 > previous * 9)
+                break;
+
+            levels.push_back({ triangles, static_cast<float>(std::sqrt(maxCost)) });
+            target = previous = count;
+        }
+
+        return levels;
+    }
+
+    std::vector<MeshLod> buildLods(const std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices, std::vector<Submesh>& submeshes) {
+        std::vector<MeshLod> lods = { { 0, static_cast<uint32_t>(indices.size()), 0.0f } };
+        if(indices.size() / 3 < LOD_MIN_TRIANGLES)
+            return lods;
+
+        std::vector<Submesh> ranges = submeshes;
+        if(ranges.empty())
+            ranges.push_back({ 0, static_cast<uint32_t>(indices.size()), 0 });
+
+        //SEAMS, the positions used by more than one submesh. They stay in place so the submeshes don't open cracks between them
+        constexpr uint32_t SHARED = std::numeric_limits<uint32_t>::max();
+        std::unordered_map<glm::vec3, uint32_t, PositionHash> owners;
+        if(ranges.size() > 1) {
+            for(uint32_t r=0; r<ranges.size(); ++r) {
+                for(uint32_t i=ranges[r].firstIndex; i<ranges[r].firstIndex + ranges[r].indexCount; ++i) {
+                    auto [it, inserted] = owners.try_emplace(positions[indices[i]], r);
+                    if(!inserted && it->second != r)
+                        it->second = SHARED;
+                }
+            }
+        }
+
+        //RANGES, each one is simplified alone with its vertices numbered from 0, in the order they have in the mesh
+        std::vector<std::vector<SimplifiedLevel>> rangeLevels(ranges.size());
+        std::vector<uint32_t> local(positions.size()), vertices;
+        for(size_t r=0; r<ranges.size(); ++r) {
+            auto begin = indices.begin() + ranges[r].firstIndex, end = begin + ranges[r].indexCount;
+            vertices.assign(begin, end);
+            std::sort(vertices.begin(), vertices.end());
+            vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+            std::vector<glm::vec3> rangePositions(vertices.size());
+            std::vector<uint8_t> pinned(vertices.size(), 0);
+            for(uint32_t v=0; v<vertices.size(); ++v) {
+                local[vertices[v]] = v;
+                rangePositions[v] = positions[vertices[v]];
+                pinned[v] = ranges.size() > 1 && owners.at(rangePositions[v]) == SHARED;
+            }
+
+            std::vector<uint32_t> rangeIndices(begin, end);
+            for(auto& i: rangeIndices)
+                i = local[i];
+
+            rangeLevels[r].push_back({ std::vector<uint32_t>(begin, end), 0.0f });
+            for(auto& level: simplifyRange(rangePositions, rangeIndices, pinned)) {
+                for(auto& i: level.indices)
+                    i = vertices[i];
+                rangeLevels[r].push_back(std::move(level));
+            }
+        }
+
+        //LEVELS, with a range per submesh. The ones that can't be simplified anymore repeat their last level
+        for(uint32_t level=1; level<LOD_MAX_LEVELS; ++level) {
+            uint32_t count = 0;
+            float error = 0.0f;
+            bool simplified = false;
+            for(const auto& levels: rangeLevels) {
+                const auto& range = levels[std::min<size_t>(level, levels.size() - 1)];
+                count += static_cast<uint32_t>(range.indices.size() / 3);
+                error = std::max(error, range.error);
+                simplified |= level < levels.size();
+            }
+            if(!simplified || count * 10 > lods.back().indexCount / 3 * 9)
+                break;
+
+            lods.push_back({ static_cast<uint32_t>(indices.size()), count * 3, error });
+            for(size_t r=0; r<ranges.size(); ++r) {
+                const auto& range = rangeLevels[r][std::min<size_t>(level, rangeLevels[r].size() - 1)];
+                if(!submeshes.empty())
+                    submeshes.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(range.indices.size()), ranges[r].material });
+                indices.insert(indices.end(), range.indices.begin(), range.indices.end());
+            }
+        }
+
+        return lods;
+    }
+
+}
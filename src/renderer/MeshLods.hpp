@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace fly {
+
+    //A level of detail is a range of the index buffer of the mesh, all of them use the same vertices
+    struct MeshLod {
+        uint32_t firstIndex, indexCount; //Relative to the first index of the mesh
+        float error; //Farthest the simplified surface can be from the original, in model space
+    };
+
+    //A range of a level drawn with its own material. Every level has a range per submesh, in the same order
+    struct Submesh {
+        uint32_t firstIndex, indexCount; //Relative to the first index of the mesh
+        uint32_t material; //Slot of the material in the mesh, they are numbered from 0
+    };
+
+    constexpr uint32_t LOD_MAX_LEVELS = 5; //Each level has about half the triangles of the one before
+    constexpr uint32_t LOD_MIN_TRIANGLES = 256; //Smaller meshes only have the full level
+    constexpr float LOD_PIXEL_ERROR = 1.0f; //Coarsest error allowed on screen
+    constexpr float LOD_HYSTERESIS = 0.75f; //A coarser level must be this far under the limit, so the levels don't pop back and forth
+
+    /*
+    Simplifies the mesh with quadric error metrics and appends the indices of each level after the full one, which is level 0
+    The edges are collapsed into one of their vertices, so no vertex is added. The vertices with the same position are welded,
+    and the borders of the mesh are locked so it doesn't open holes
+
+    Each submesh is simplified alone so the materials don't mix, and the positions on the seams between them never move.
+    The ranges of every level are appended to the submeshes, after the ones of the full level
+    */
+    std::vector<MeshLod> buildLods(const std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices, std::vector<Submesh>& submeshes);
+
+}
@@ -0,0 +1,221 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace fly {
+
+    //A FIFO cache, a vertex is in it if fewer than cacheSize vertices were transformed after it
+    struct CacheSimulator {
+        std::vector<uint32_t> stamps;
+        uint32_t time, cacheSize;
+
+        CacheSimulator(uint32_t vertexCount, uint32_t cacheSize): stamps(vertexCount, 0), time(cacheSize + 1), cacheSize(cacheSize) {}
+
+        bool access(uint32_t v) {
+            if(this->time - this->stamps[v] <= this->cacheSize)
+                return false;
+            this->stamps[v] = this->time++;
+            return true;
+        }
+
+        void reset() { this->time += this->cacheSize + 1; }
+    };
+
+    VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize) {
+        CacheSimulator cache(vertexCount, cacheSize);
+        std::vector<uint8_t> used(vertexCount, 0);
+        uint32_t transformed = 0, unique = 0;
+        for(size_t i=0; i<indexCount; ++i) {
+            transformed += cache.access(indices[i]);
+            unique += !used[indices[i]];
+            used[indices[i]] = 1;
+        }
+
+        VertexCacheStats stats{};
+        stats.acmr = indexCount >= 3? static_cast<float>(transformed) / static_cast<float>(indexCount / 3) : 0.0f;
+        stats.atvr = unique > 0? static_cast<float>(transformed) / static_cast<float>(unique) : 0.0f;
+        return stats;
+    }
+
+    //Tipsify, from Sander et al. 2007. Returns the first triangle of each cluster, a new one starts at every dead end
+    static std::vector<uint32_t> tipsify(uint32_t* indices, uint32_t triangleCount, uint32_t vertexCount, uint32_t cacheSize) {
+        //TRIANGLES OF EACH VERTEX, packed one after the other
+        std::vector<uint32_t> offsets(vertexCount + 1, 0), adjacency(triangleCount * 3);
+        for(uint32_t i=0; i<triangleCount * 3; ++i)
+            offsets[indices[i] + 1]++;
+        for(uint32_t v=0; v<vertexCount; ++v)
+            offsets[v + 1] += offsets[v];
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for(uint32_t i=0; i<triangleCount * 3; ++i)
+            adjacency[fill[indices[i]]++] = i / 3;
+
+        std::vector<uint32_t> live(vertexCount), stamps(vertexCount, 0), deadEnds, candidates, clusters, output;
+        for(uint32_t v=0; v<vertexCount; ++v)
+            live[v] = offsets[v + 1] - offsets[v];
+        std::vector<uint8_t> emitted(triangleCount, 0);
+        output.reserve(triangleCount * 3);
+
+        constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        uint32_t time = cacheSize + 1, cursor = 0, fan = 0;
+        while(cursor < vertexCount && live[cursor] == 0)
+            cursor++;
+        fan = cursor < vertexCount? cursor : NONE;
+        if(fan != NONE)
+            clusters.push_back(0);
+
+        while(fan != NONE) {
+            //FAN, every triangle left around the vertex
+            candidates.clear();
+            for(uint32_t a=offsets[fan]; a<offsets[fan + 1]; ++a) {
+                uint32_t t = adjacency[a];
+                if(emitted[t])
+                    continue;
+
+                for(uint32_t k=0; k<3; ++k) {
+                    uint32_t v = indices[3*t + k];
+                    output.push_back(v);
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if(time - stamps[v] > cacheSize)
+                        stamps[v] = time++;
+                }
+                emitted[t] = 1;
+            }
+
+            //NEXT VERTEX, the one that stays longer in the cache after its fan
+            uint32_t next = NONE;
+            int64_t bestPriority = -1;
+            for(uint32_t v: candidates) {
+                if(live[v] == 0)
+                    continue;
+
+                int64_t priority = 0;
+                if(time - stamps[v] + 2 * live[v] <= cacheSize)
+                    priority = time - stamps[v];
+                if(priority > bestPriority) {
+                    bestPriority = priority;
+                    next = v;
+                }
+            }
+
+            if(next == NONE) {
+                while(!deadEnds.empty() && next == NONE) {
+                    uint32_t v = deadEnds.back();
+                    deadEnds.pop_back();
+                    if(live[v] > 0)
+                        next = v;
+                }
+                while(next == NONE && cursor < vertexCount) {
+                    if(live[cursor] > 0)
+                        next = cursor;
+                    cursor++;
+                }
+                if(next != NONE)
+                    clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+            }
+            fan = next;
+        }
+
+        std::copy(output.begin(), output.end(), indices);
+        return clusters;
+    }
+
+    //The clusters are split again where their own ACMR reaches the one of the mesh, so they stay small enough to sort
+    static std::vector<uint32_t> splitClusters(const uint32_t* indices, uint32_t triangleCount, uint32_t vertexCount, const std::vector<uint32_t>& clusters, float acmrLimit) {
+        CacheSimulator cache(vertexCount, VERTEX_CACHE_SIZE);
+        std::vector<uint32_t> split;
+        for(size_t c=0; c<clusters.size(); ++c) {
+            uint32_t end = c + 1 < clusters.size()? clusters[c + 1] : triangleCount;
+            uint32_t start = clusters[c], transformed = 0;
+            split.push_back(start);
+            cache.reset();
+
+            for(uint32_t t=clusters[c]; t<end; ++t) {
+                for(uint32_t k=0; k<3; ++k)
+                    transformed += cache.access(indices[3*t + k]);
+
+                if(t + 1 < end && static_cast<float>(transformed) <= acmrLimit * static_cast<float>(t + 1 - start)) {
+                    start = t + 1;
+                    transformed = 0;
+                    split.push_back(start);
+                    cache.reset();
+                }
+            }
+        }
+        return split;
+    }
+
+    void optimizeVertexCache(uint32_t* indices, size_t indexCount, const std::vector<glm::vec3>& positions, bool sortOverdraw) {
+        uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+        uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+        if(triangleCount == 0)
+            return;
+
+        auto clusters = tipsify(indices, triangleCount, vertexCount, VERTEX_CACHE_SIZE);
+        if(!sortOverdraw)
+            return;
+
+        float acmr = analyzeVertexCache(indices, triangleCount * 3, vertexCount).acmr;
+        clusters = splitClusters(indices, triangleCount, vertexCount, clusters, acmr * OVERDRAW_THRESHOLD);
+
+        //OVERDRAW, the clusters that face away from the center of the mesh are the ones in front, so they go first
+        std::vector<glm::vec3> centers(clusters.size()), normals(clusters.size());
+        glm::vec3 meshCenter(0.0f);
+        float meshArea = 0.0f;
+        for(size_t c=0; c<clusters.size(); ++c) {
+            uint32_t end = c + 1 < clusters.size()? clusters[c + 1] : triangleCount;
+            glm::vec3 center(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for(uint32_t t=clusters[c]; t<end; ++t) {
+                glm::vec3 p0 = positions[indices[3*t]], p1 = positions[indices[3*t + 1]], p2 = positions[indices[3*t + 2]];
+                glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                float triangleArea = glm::length(n);
+                center += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                normal += n;
+                area += triangleArea;
+            }
+
+            meshCenter += center;
+            meshArea += area;
+            float normalLength = glm::length(normal);
+            centers[c] = area > 0.0f? center / area : center;
+            normals[c] = normalLength > 0.0f? normal / normalLength : glm::vec3(0.0f);
+        }
+        if(meshArea > 0.0f)
+            meshCenter /= meshArea;
+
+        std::vector<float> facing(clusters.size());
+        for(size_t c=0; c<clusters.size(); ++c)
+            facing[c] = glm::dot(centers[c] - meshCenter, normals[c]);
+
+        std::vector<uint32_t> order(clusters.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return facing[a] > facing[b]; });
+
+        std::vector<uint32_t> sorted;
+        sorted.reserve(triangleCount * 3);
+        for(uint32_t c: order) {
+            uint32_t end = c + 1 < clusters.size()? clusters[c + 1] : triangleCount;
+            sorted.insert(sorted.end(), indices + 3 * clusters[c], indices + 3 * end);
+        }
+        std::copy(sorted.begin(), sorted.end(), indices);
+    }
+
+    std::vector<uint32_t> buildVertexFetchOrder(std::vector<uint32_t>& indices, uint32_t vertexCount) {
+        constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> remap(vertexCount, NONE), order;
+        order.reserve(vertexCount);
+        for(auto& index: indices) {
+            if(remap[index] == NONE) {
+                remap[index] = static_cast<uint32_t>(order.size());
+                order.push_back(index);
+            }
+            index = remap[index];
+        }
+        return order;
+    }
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "MeshLods.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace fly {
+
+    constexpr uint32_t VERTEX_CACHE_SIZE = 16; //Of the simulated FIFO post-transform cache
+    constexpr float OVERDRAW_THRESHOLD = 1.05f; //How much the clusters can raise the ACMR to reduce overdraw
+
+    struct VertexCacheStats {
+        float acmr; //Transformed vertices per triangle, 0.5 is the best possible and 3 the worst
+        float atvr; //Transformed vertices per vertex used, 1 is the best possible
+    };
+
+    VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+    /*
+    Reorders the triangles for the post-transform cache with Tipsify, which fans around the vertices in the cache and jumps to
+    a dead end when there isn't any. Then the clusters are sorted so the ones facing out of the mesh are drawn first, so the
+    depth test rejects the fragments behind them. Without sortOverdraw the Tipsify order is kept as is
+    */
+    void optimizeVertexCache(uint32_t* indices, size_t indexCount, const std::vector<glm::vec3>& positions, bool sortOverdraw = true);
+
+    //Rewrites the indices so the vertices are numbered in the order they are first used. Returns the old index of each new vertex
+    std::vector<uint32_t> buildVertexFetchOrder(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+    //The vertices that aren't used are removed
+    template<typename Vertex_t>
+    void optimizeVertexFetch(std::vector<Vertex_t>& vertices, std::vector<uint32_t>& indices) {
+        auto order = buildVertexFetchOrder(indices, static_cast<uint32_t>(vertices.size()));
+        std::vector<Vertex_t> reordered(order.size());
+        for(size_t i=0; i<order.size(); ++i)
+            reordered[i] = vertices[order[i]];
+        vertices = std::move(reordered);
+    }
+
+    //Every pass on a mesh with positions, the triangles don't leave their submesh. Returns the stats before and after
+    template<typename Vertex_t>
+    std::pair<VertexCacheStats, VertexCacheStats> optimizeMesh(std::vector<Vertex_t>& vertices, std::vector<uint32_t>& indices, const std::vector<Submesh>& submeshes = {}) {
+        uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+        auto before = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+        std::vector<glm::vec3> positions(vertexCount);
+        for(uint32_t v=0; v<vertexCount; ++v)
+            positions[v] = vertices[v].pos;
+        if(submeshes.empty())
+            optimizeVertexCache(indices.data(), indices.size(), positions);
+        for(const auto& submesh: submeshes)
+            optimizeVertexCache(indices.data() + submesh.firstIndex, submesh.indexCount, positions);
+        optimizeVertexFetch(vertices, indices);
+
+        auto after = analyzeVertexCache(indices.data(), indices.size(), static_cast<uint32_t>(vertices.size()));
+        return { before, after };
+    }
+
+}
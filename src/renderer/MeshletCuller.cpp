@@ -0,0 +1,50 @@
+#include "MeshletCuller.hpp"
+
+#include "vulkan/VulkanHelpers.hpp"
+
+#include <Utils.hpp>
+
+#include <algorithm>
+
+static const char* const MESHLET_CULL_SHADER_SRC = "vulkan-engine/shaders/bin/meshlet_cull.comp.spv";
+
+namespace fly {
+
+    MeshletCuller::MeshletCuller(std::shared_ptr<VulkanInstance> vk): vk{vk} {
+        //The pipelines allocate a set per frame in flight
+        this->setLayout = newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT, {
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT}
+        }).build(vk);
+
+        auto [pipeline, layout] = createComputePipeline(vk, this->setLayout.layout, readFile(MESHLET_CULL_SHADER_SRC), sizeof(CullPush));
+        this->pipeline = pipeline;
+        this->layout = layout;
+    }
+
+    MeshletCuller::~MeshletCuller() {
+        vkDestroyPipeline(vk->device, this->pipeline, nullptr);
+        vkDestroyPipelineLayout(vk->device, this->layout, nullptr);
+        vkDestroyDescriptorSetLayout(vk->device, this->setLayout.layout, nullptr);
+    }
+
+    void MeshletCuller::cull(VkCommandBuffer commandBuffer, VkDescriptorSet set, uint32_t meshletCount, const glm::mat4& projView, const glm::vec3& cameraPos, bool backFaceCulling) {
+        if(meshletCount == 0)
+            return;
+
+        //A workgroup per meshlet
+        CullPush push{};
+        push.projView = projView;
+        push.cameraPos = glm::vec4(cameraPos, backFaceCulling? 1.0f : 0.0f);
+        push.meshletCount = meshletCount;
+        push.groupsX = std::min(meshletCount, MAX_GROUPS_X);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->layout, 0, 1, &set, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, this->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPush), &push);
+        vkCmdDispatch(commandBuffer, push.groupsX, (meshletCount + push.groupsX - 1) / push.groupsX, 1);
+    }
+
+}
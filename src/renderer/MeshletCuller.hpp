@@ -0,0 +1,60 @@
+#pragma once
+
+#include "vulkan/VulkanTypes.h"
+#include "vulkan/Descriptors.hpp"
+
+#include <glm/glm.hpp>
+
+#include <memory>
+
+namespace fly {
+
+    //One per meshlet, the bounds and the cone are in world space
+    struct MeshletRecord {
+        glm::vec4 sphere; //Center and radius
+        glm::vec4 cone; //Axis and cutoff
+        uint32_t firstIndex; //In the geometry arena
+        uint32_t indexCount;
+        uint32_t command; //Indirect command its triangles are added to
+        uint32_t pad;
+    };
+
+    /*
+    Culls the meshlets of a pipeline against the frustum and their normal cone, and copies the indices of the visible ones
+    into a compacted index buffer. Each command of the meshes must start with zero indices, the shader adds the visible ones
+    It only uses compute and indirect draws, so it doesn't need mesh shaders
+    */
+    class MeshletCuller {
+    public:
+        static constexpr uint32_t GROUP_SIZE = 64; //Must match the local size of the shader
+        static constexpr uint32_t MAX_GROUPS_X = 65535; //The smallest maxComputeWorkGroupCount allowed, more meshlets go in y
+
+        MeshletCuller(std::shared_ptr<VulkanInstance> vk);
+        ~MeshletCuller();
+
+        /*
+        The set of the meshlets of a pipeline:
+        - 0: the meshlet records
+        - 1: the index buffer of the geometry arena
+        - 2: the indirect commands
+        - 3: the compacted indices
+        */
+        const DescriptorSetLayout& getSetLayout() const { return this->setLayout; }
+
+        void cull(VkCommandBuffer commandBuffer, VkDescriptorSet set, uint32_t meshletCount, const glm::mat4& projView, const glm::vec3& cameraPos, bool backFaceCulling);
+
+    private:
+        struct CullPush {
+            glm::mat4 projView;
+            glm::vec4 cameraPos; //The w is 1 if the cones are tested
+            uint32_t meshletCount, groupsX;
+        };
+
+        std::shared_ptr<VulkanInstance> vk;
+
+        DescriptorSetLayout setLayout;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+    };
+
+}
@@ -0,0 +1,185 @@
+#include "Meshlets.hpp"
+
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace fly {
+
+    static Meshlet computeMeshlet(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount) {
+        Meshlet meshlet{};
+        meshlet.firstIndex = firstIndex;
+        meshlet.indexCount = indexCount;
+
+        //BOUNDS
+        glm::vec3 min = positions[indices[firstIndex]], max = min;
+        for(uint32_t i=firstIndex; i<firstIndex + indexCount; ++i) {
+            min = glm::min(min, positions[indices[i]]);
+            max = glm::max(max, positions[indices[i]]);
+        }
+        meshlet.bounds = { (min + max) * 0.5f, 0.0f };
+        for(uint32_t i=firstIndex; i<firstIndex + indexCount; ++i)
+            meshlet.bounds.radius = std::max(meshlet.bounds.radius, glm::distance(meshlet.bounds.center, positions[indices[i]]));
+
+        //CONE, the average normal and the widest angle from it
+        auto triangleNormal = [&](uint32_t i) {
+            glm::vec3 a = positions[indices[i]], b = positions[indices[i + 1]], c = positions[indices[i + 2]];
+            return glm::cross(b - a, c - a);
+        };
+
+        glm::vec3 axis(0.0f);
+        for(uint32_t i=firstIndex; i<firstIndex + indexCount; i += 3) {
+            glm::vec3 n = triangleNormal(i);
+            float length = glm::length(n);
+            if(length > 0.0f)
+                axis += n / length;
+        }
+
+        meshlet.coneAxis = glm::vec3(0.0f);
+        meshlet.coneCutoff = 1.0f;
+        float axisLength = glm::length(axis);
+        if(axisLength == 0.0f)
+            return meshlet;
+
+        axis /= axisLength;
+        float minDot = 1.0f;
+        for(uint32_t i=firstIndex; i<firstIndex + indexCount; i += 3) {
+            glm::vec3 n = triangleNormal(i);
+            float length = glm::length(n);
+            if(length > 0.0f)
+                minDot = std::min(minDot, glm::dot(n / length, axis));
+        }
+
+        meshlet.coneAxis = axis;
+        //Almost a half sphere, it would never be culled
+        if(minDot > 0.1f)
+            meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        return meshlet;
+    }
+
+    //The triangles are reordered for the vertex cache like a mesh of their own, with the vertices numbered from 0 so it doesn't cost
+    //the size of the whole mesh. The overdraw sort is left out, a meshlet is too small for it and it breaks the fans
+    //localVertex has every vertex of the mesh set to NONE, and is left like that
+    static void optimizeMeshlet(const std::vector<glm::vec3>& positions, uint32_t* indices, uint32_t indexCount, std::vector<uint32_t>& localVertex) {
+        constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> local(indexCount), meshVertex;
+        std::vector<glm::vec3> localPositions;
+        for(uint32_t i=0; i<indexCount; ++i) {
+            uint32_t v = indices[i];
+            if(localVertex[v] == NONE) {
+                localVertex[v] = static_cast<uint32_t>(meshVertex.size());
+                meshVertex.push_back(v);
+                localPositions.push_back(positions[v]);
+            }
+            local[i] = localVertex[v];
+        }
+
+        optimizeVertexCache(local.data(), indexCount, localPositions, false);
+        for(uint32_t i=0; i<indexCount; ++i)
+            indices[i] = meshVertex[local[i]];
+        for(uint32_t v: meshVertex)
+            localVertex[v] = NONE;
+    }
+
+    std::vector<Meshlet> buildMeshlets(const std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices) {
+        constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+        uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+
+        std::vector<Meshlet> meshlets;
+        if(triangleCount == 0)
+            return meshlets;
+
+        //TRIANGLES OF EACH VERTEX, packed one after the other
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0), adjacency(triangleCount * 3);
+        for(uint32_t i=0; i<triangleCount * 3; ++i)
+            adjacencyOffsets[indices[i] + 1]++;
+        for(uint32_t v=0; v<vertexCount; ++v)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for(uint32_t i=0; i<triangleCount * 3; ++i)
+            adjacency[fill[indices[i]]++] = i / 3;
+
+        //GREEDY GROWTH
+        std::vector<uint8_t> emitted(triangleCount, 0);
+        std::vector<uint32_t> vertexMeshlet(vertexCount, NONE); //Last meshlet that has each vertex
+        std::vector<uint32_t> localVertex(vertexCount, NONE);
+        std::vector<uint32_t> reordered, candidates;
+        reordered.reserve(triangleCount * 3);
+
+        uint32_t meshletId = 0, meshletVertices = 0, meshletTriangles = 0, meshletStart = 0, seed = 0;
+        auto newVertices = [&](uint32_t t) {
+            uint32_t count = 0;
+            for(uint32_t k=0; k<3; ++k)
+                count += vertexMeshlet[indices[3*t + k]] != meshletId;
+            return count;
+        };
+        auto finishMeshlet = [&]() {
+            optimizeMeshlet(positions, reordered.data() + meshletStart, static_cast<uint32_t>(reordered.size()) - meshletStart, localVertex);
+            meshlets.push_back(computeMeshlet(positions, reordered, meshletStart, static_cast<uint32_t>(reordered.size()) - meshletStart));
+            meshletId++;
+            meshletVertices = meshletTriangles = 0;
+            meshletStart = static_cast<uint32_t>(reordered.size());
+            candidates.clear();
+        };
+
+        for(uint32_t emittedCount=0; emittedCount<triangleCount; ++emittedCount) {
+            //The neighbour that adds the fewest vertices
+            uint32_t best = NONE, bestCost = 4;
+            for(size_t c=0; c<candidates.size();) {
+                uint32_t t = candidates[c];
+                if(emitted[t]) {
+                    candidates[c] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+
+                uint32_t cost = newVertices(t);
+                if(cost < bestCost) {
+                    best = t;
+                    bestCost = cost;
+                    if(cost == 0)
+                        break;
+                }
+                ++c;
+            }
+
+            //Without a neighbour that fits, a new meshlet starts from the next triangle left
+            if(best == NONE || meshletVertices + bestCost > MESHLET_MAX_VERTICES) {
+                if(meshletTriangles > 0)
+                    finishMeshlet();
+                while(emitted[seed])
+                    seed++;
+                best = seed;
+            }
+
+            emitted[best] = 1;
+            for(uint32_t k=0; k<3; ++k) {
+                uint32_t v = indices[3*best + k];
+                if(vertexMeshlet[v] != meshletId) {
+                    vertexMeshlet[v] = meshletId;
+                    meshletVertices++;
+                }
+                reordered.push_back(v);
+
+                for(uint32_t a=adjacencyOffsets[v]; a<adjacencyOffsets[v + 1]; ++a)
+                    if(!emitted[adjacency[a]])
+                        candidates.push_back(adjacency[a]);
+            }
+
+            if(++meshletTriangles == MESHLET_MAX_TRIANGLES)
+                finishMeshlet();
+        }
+        if(meshletTriangles > 0)
+            finishMeshlet();
+
+        //An incomplete triangle is kept, so the count doesn't change
+        reordered.insert(reordered.end(), indices.begin() + triangleCount * 3, indices.end());
+        indices = std::move(reordered);
+        return meshlets;
+    }
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "FrustumCuller.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace fly {
+
+    /*
+    A small cluster of triangles that is culled on its own. The normal cone has every normal of the cluster inside,
+    so it faces away from the camera when the camera is in the back cone
+    */
+    struct Meshlet {
+        BoundingSphere bounds; //In model space
+        glm::vec3 coneAxis;
+        float coneCutoff; //Sine of the cone angle, 1 or more if it can't be back face culled
+        uint32_t firstIndex, indexCount; //In the index buffer reordered by buildMeshlets
+    };
+
+    constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+    constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+    /*
+    Groups the triangles into meshlets of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles and reorders
+    the indices so each meshlet is contiguous. Each meshlet grows with the neighbour that adds the fewest vertices, so they stay compact
+
+    A new meshlet starts from the first triangle left in the input order, so the meshlets keep the overdraw order optimizeVertexCache
+    gave the mesh. The triangles of each one are then reordered for the vertex cache with Tipsify
+    */
+    std::vector<Meshlet> buildMeshlets(const std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices);
+
+}
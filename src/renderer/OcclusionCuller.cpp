@@ -0,0 +1,269 @@
+#include "OcclusionCuller.hpp"
+
+#include "Texture.hpp"
+#include "vulkan/VulkanHelpers.hpp"
+#include "vulkan/Descriptors.hpp"
+
+#include <Utils.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <vector>
+
+static const char* const HIZ_REDUCE_SHADER_SRC = "vulkan-engine/shaders/bin/hiz_reduce.comp.spv";
+static const char* const OCCLUSION_CULL_SHADER_SRC = "vulkan-engine/shaders/bin/occlusion_cull.comp.spv";
+
+namespace fly {
+
+    static constexpr uint32_t REDUCE_GROUP_SIZE = 8; //Must match the local size of the reduce shader
+
+    OcclusionCuller::OcclusionCuller(std::shared_ptr<VulkanInstance> vk): vk{vk} {
+        this->sampler = std::make_unique<TextureSampler>(vk, MAX_LEVELS, TextureSampler::Filter::NEAREST);
+
+        //REDUCTION
+        this->reduceSetLayout = newDescriptorSetBuild(MAX_LEVELS, {
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT}
+        }).build(vk);
+        this->reducePool = createDescriptorPoolWithLayout(this->reduceSetLayout, vk);
+
+        std::vector<VkDescriptorSetLayout> layouts(MAX_LEVELS, this->reduceSetLayout.layout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = this->reducePool;
+        allocInfo.descriptorSetCount = MAX_LEVELS;
+        allocInfo.pSetLayouts = layouts.data();
+        if(vkAllocateDescriptorSets(vk->device, &allocInfo, this->reduceSets.data()) != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate hi-z descriptor sets!");
+
+        auto [rPip, rLay] = createComputePipeline(vk, this->reduceSetLayout.layout, readFile(HIZ_REDUCE_SHADER_SRC), sizeof(ReducePush));
+        this->reducePipeline = rPip;
+        this->reduceLayout = rLay;
+
+        //CULLING
+        this->pyramidSetLayout = newDescriptorSetBuild(1, {
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT}
+        }).build(vk);
+        this->pyramidPool = createDescriptorPoolWithLayout(this->pyramidSetLayout, vk);
+        allocInfo.descriptorPool = this->pyramidPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &this->pyramidSetLayout.layout;
+        if(vkAllocateDescriptorSets(vk->device, &allocInfo, &this->pyramidSet) != VK_SUCCESS)
+            throw std::runtime_error("failed to allocate hi-z descriptor sets!");
+
+        //The pipelines allocate a set per frame in flight
+        this->drawSetLayout = newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT, {
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT}
+        }).build(vk);
+
+        std::array<VkDescriptorSetLayout, 2> cullSetLayouts = { this->pyramidSetLayout.layout, this->drawSetLayout.layout };
+        VkPushConstantRange pushConstant{};
+        pushConstant.offset = 0;
+        pushConstant.size = sizeof(CullPush);
+        pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(cullSetLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = cullSetLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+        if(vkCreatePipelineLayout(vk->device, &pipelineLayoutInfo, nullptr, &this->cullLayout) != VK_SUCCESS)
+            throw std::runtime_error("failed to create pipeline layout!");
+
+        this->cullPipeline = createSpecializedComputePipeline(vk, this->cullLayout, readFile(OCCLUSION_CULL_SHADER_SRC), nullptr);
+    }
+
+    OcclusionCuller::~OcclusionCuller() {
+        destroyPyramid();
+
+        vkDestroyPipeline(vk->device, this->cullPipeline, nullptr);
+        vkDestroyPipelineLayout(vk->device, this->cullLayout, nullptr);
+        vkDestroyDescriptorPool(vk->device, this->pyramidPool, nullptr);
+        vkDestroyDescriptorSetLayout(vk->device, this->pyramidSetLayout.layout, nullptr);
+        vkDestroyDescriptorSetLayout(vk->device, this->drawSetLayout.layout, nullptr);
+
+        vkDestroyPipeline(vk->device, this->reducePipeline, nullptr);
+        vkDestroyPipelineLayout(vk->device, this->reduceLayout, nullptr);
+        vkDestroyDescriptorPool(vk->device, this->reducePool, nullptr);
+        vkDestroyDescriptorSetLayout(vk->device, this->reduceSetLayout.layout, nullptr);
+
+        this->sampler.reset();
+    }
+
+    void OcclusionCuller::destroyPyramid() {
+        for(uint32_t i=0; i<this->levelCount; ++i)
+            vkDestroyImageView(vk->device, this->levelViews[i], nullptr);
+        if(this->pyramidView)
+            vkDestroyImageView(vk->device, this->pyramidView, nullptr);
+        if(this->pyramid)
+            vmaDestroyImage(vk->allocator, this->pyramid, this->pyramidAlloc);
+
+        this->pyramid = VK_NULL_HANDLE;
+        this->pyramidView = VK_NULL_HANDLE;
+        this->levelCount = 0;
+    }
+
+    void OcclusionCuller::createResources(std::shared_ptr<Texture> depthTexture) {
+        destroyPyramid();
+        this->depthTexture = depthTexture;
+
+        //The first level is half the attachments, rounded up to a power of two so every level of any render extent fits
+        uint32_t width = std::bit_ceil((vk->swapChainExtent.width + 1) / 2);
+        uint32_t height = std::bit_ceil((vk->swapChainExtent.height + 1) / 2);
+        this->levelCount = std::min<uint32_t>(std::bit_width(std::max(width, height)), MAX_LEVELS);
+
+        createImage(
+            vk, width, height, this->levelCount,
+            VK_SAMPLE_COUNT_1_BIT,
+            VK_FORMAT_R32_SFLOAT,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            0,
+            &this->pyramid, &this->pyramidAlloc,
+            false
+        );
+        this->pyramidView = createImageView(vk, this->pyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, this->levelCount, false);
+
+        for(uint32_t i=0; i<this->levelCount; ++i) {
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = this->pyramid;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = VK_FORMAT_R32_SFLOAT;
+            viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            viewInfo.subresourceRange.baseMipLevel = i;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = 1;
+            if(vkCreateImageView(vk->device, &viewInfo, nullptr, &this->levelViews[i]) != VK_SUCCESS)
+                throw std::runtime_error("failed to create hi-z level view!");
+        }
+        this->pyramidUndefined = true;
+        this->pyramidValid = false;
+
+        //Level 0 reads the depth, the rest read the level before
+        std::vector<VkDescriptorImageInfo> srcInfos(this->levelCount), dstInfos(this->levelCount);
+        std::vector<VkWriteDescriptorSet> descriptorWrites;
+        for(uint32_t i=0; i<this->levelCount; ++i) {
+            srcInfos[i].sampler = this->sampler->getSampler();
+            srcInfos[i].imageView = i == 0? depthTexture->getImageView() : this->pyramidView;
+            srcInfos[i].imageLayout = i == 0? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+            dstInfos[i].imageView = this->levelViews[i];
+            dstInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = this->reduceSets[i];
+            write.dstArrayElement = 0;
+            write.descriptorCount = 1;
+
+            write.dstBinding = 0;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.pImageInfo = &srcInfos[i];
+            descriptorWrites.push_back(write);
+
+            write.dstBinding = 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write.pImageInfo = &dstInfos[i];
+            descriptorWrites.push_back(write);
+        }
+
+        VkDescriptorImageInfo pyramidInfo{};
+        pyramidInfo.sampler = this->sampler->getSampler();
+        pyramidInfo.imageView = this->pyramidView;
+        pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet pyramidWrite{};
+        pyramidWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        pyramidWrite.dstSet = this->pyramidSet;
+        pyramidWrite.dstBinding = 0;
+        pyramidWrite.dstArrayElement = 0;
+        pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pyramidWrite.descriptorCount = 1;
+        pyramidWrite.pImageInfo = &pyramidInfo;
+        descriptorWrites.push_back(pyramidWrite);
+
+        vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    void OcclusionCuller::beginFrame(VkCommandBuffer commandBuffer) {
+        if(this->pyramidUndefined) {
+            //Its content isn't used until it is built
+            transitionImageLayout(
+                commandBuffer, this->pyramid,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_GENERAL,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                this->levelCount, false
+            );
+            this->pyramidUndefined = false;
+            return;
+        }
+
+        //The pyramid of the last frame must be written before it is read
+        memoryBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_WRITE_BIT,
+            VK_ACCESS_SHADER_READ_BIT
+        );
+    }
+
+    void OcclusionCuller::buildPyramid(VkCommandBuffer commandBuffer) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->reducePipeline);
+
+        glm::ivec2 srcSize = glm::ivec2(vk->renderExtent.width, vk->renderExtent.height);
+        for(uint32_t i=0; i<this->levelCount; ++i) {
+            glm::ivec2 dstSize = (srcSize + 1) / 2;
+            ReducePush push{ srcSize, dstSize, i == 0? 0 : static_cast<int32_t>(i) - 1 };
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->reduceLayout, 0, 1, &this->reduceSets[i], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, this->reduceLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ReducePush), &push);
+            vkCmdDispatch(commandBuffer, (dstSize.x + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, (dstSize.y + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, 1);
+
+            memoryBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_WRITE_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+            );
+            srcSize = dstSize;
+        }
+
+        this->pyramidExtent = vk->renderExtent;
+        this->pyramidValid = true;
+    }
+
+    void OcclusionCuller::cull(VkCommandBuffer commandBuffer, VkDescriptorSet drawSet, uint32_t drawCount, uint32_t outputOffset, uint32_t phase, const glm::mat4& projView) {
+        if(drawCount == 0)
+            return;
+
+        CullPush push{};
+        push.projView = projView;
+        push.renderSize = glm::vec2(this->pyramidExtent.width, this->pyramidExtent.height);
+        push.drawCount = drawCount;
+        push.outputOffset = outputOffset;
+        push.phase = phase;
+        //Without a pyramid only the frustum is tested
+        push.levels = this->pyramidValid? this->levelCount : 0;
+
+        std::array<VkDescriptorSet, 2> sets = { this->pyramidSet, drawSet };
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullLayout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+        vkCmdPushConstants(commandBuffer, this->cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPush), &push);
+        vkCmdDispatch(commandBuffer, (drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    }
+
+}
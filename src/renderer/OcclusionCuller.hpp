@@ -0,0 +1,89 @@
+#pragma once
+
+#include "vulkan/VulkanTypes.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <memory>
+
+namespace fly {
+
+    class Texture;
+    class TextureSampler;
+
+    /*
+    Two phase occlusion culling with a hierarchical depth pyramid. Each texel of the pyramid has the farthest depth it covers
+
+    In the first phase the draws are tested against the pyramid of the last frame and the visible ones are drawn. Then the pyramid
+    is built from that depth and the rejected draws are tested again, so the ones that became visible are drawn in a second pass
+
+    The pipelines own their draw buffers, this class has the pyramid and the compute pipelines
+    */
+    class OcclusionCuller {
+    public:
+        static constexpr uint32_t MAX_LEVELS = 16;
+        static constexpr uint32_t CULL_GROUP_SIZE = 64; //Must match the local size of the cull shader
+
+        OcclusionCuller(std::shared_ptr<VulkanInstance> vk);
+        ~OcclusionCuller();
+
+        //Called again when the swapchain is recreated, the depth texture must be sampleable
+        void createResources(std::shared_ptr<Texture> depthTexture);
+
+        //Before any culling of the frame
+        void beginFrame(VkCommandBuffer commandBuffer);
+        //Reduces the depth of the first phase into the pyramid, the depth must be in depth stencil read only layout
+        void buildPyramid(VkCommandBuffer commandBuffer);
+        //Writes the visible commands of a pipeline with the layout of getDrawSetLayout. Phase 0 uses the last pyramid, phase 1 the new one
+        void cull(VkCommandBuffer commandBuffer, VkDescriptorSet drawSet, uint32_t drawCount, uint32_t outputOffset, uint32_t phase, const glm::mat4& projView);
+
+        /*
+        The set of the draws of a pipeline:
+        - 0: world bounding spheres, one vec4 per draw. A negative radius is never culled
+        - 1: all the indirect commands
+        - 2: the visible commands, written from outputOffset
+        - 3: the two visible counts, one per phase. They must be zero before the first phase
+        - 4: one uint per draw, the rejected ones of the first phase
+        */
+        const DescriptorSetLayout& getDrawSetLayout() const { return this->drawSetLayout; }
+
+    private:
+        struct ReducePush { glm::ivec2 srcSize, dstSize; int32_t srcLod; };
+        struct CullPush {
+            glm::mat4 projView;
+            glm::vec2 renderSize;
+            uint32_t drawCount, outputOffset, phase, levels;
+        };
+
+        std::shared_ptr<VulkanInstance> vk;
+        std::shared_ptr<Texture> depthTexture;
+        std::unique_ptr<TextureSampler> sampler;
+
+        //PYRAMID, always in general layout
+        VkImage pyramid = VK_NULL_HANDLE;
+        VmaAllocation pyramidAlloc = VK_NULL_HANDLE;
+        VkImageView pyramidView = VK_NULL_HANDLE; //All the levels, for sampling
+        std::array<VkImageView, MAX_LEVELS> levelViews{}; //One per level, for storing
+        uint32_t levelCount = 0;
+        bool pyramidUndefined = true, pyramidValid = false;
+        VkExtent2D pyramidExtent{}; //Render extent it was built from
+
+        //REDUCTION, one set per level
+        DescriptorSetLayout reduceSetLayout;
+        VkDescriptorPool reducePool = VK_NULL_HANDLE;
+        std::array<VkDescriptorSet, MAX_LEVELS> reduceSets;
+        VkPipelineLayout reduceLayout = VK_NULL_HANDLE;
+        VkPipeline reducePipeline = VK_NULL_HANDLE;
+
+        //CULLING, set 0 is the pyramid and set 1 the draws
+        DescriptorSetLayout pyramidSetLayout, drawSetLayout;
+        VkDescriptorPool pyramidPool = VK_NULL_HANDLE;
+        VkDescriptorSet pyramidSet = VK_NULL_HANDLE;
+        VkPipelineLayout cullLayout = VK_NULL_HANDLE;
+        VkPipeline cullPipeline = VK_NULL_HANDLE;
+
+        void destroyPyramid();
+    };
+
+}
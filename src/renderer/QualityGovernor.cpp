@@ -0,0 +1,78 @@
+#include "QualityGovernor.hpp"
+
+namespace fly {
+
+    void QualityGovernor::update(
+        double gpuFrameTime, 
+        const std::map<std::string, double>& passTimes, 
+        const std::map<uint64_t, std::unique_ptr<FilterPipeline>>& filters,
+        bool canLower, bool canRaise
+    ) {
+        if(!this->enabled) {
+            restore(filters);
+            return;
+        }
+        if(gpuFrameTime <= 0)
+            return;
+
+        bool over = gpuFrameTime > this->targetFrameTime;
+        bool under = gpuFrameTime < this->targetFrameTime * RAISE_MARGIN;
+        this->overFrames = over && canLower? this->overFrames + 1 : 0;
+        this->underFrames = under && canRaise? this->underFrames + 1 : 0;
+
+        if(this->overFrames >= PATIENCE_FRAMES) {
+            lower(passTimes, filters);
+            this->overFrames = 0;
+        }
+        else if(this->underFrames >= PATIENCE_FRAMES) {
+            raise(filters);
+            this->underFrames = 0;
+        }
+    }
+
+    bool QualityGovernor::lower(const std::map<std::string, double>& passTimes, const std::map<uint64_t, std::unique_ptr<FilterPipeline>>& filters) {
+        //The filter with room to go down whose pass takes the longest
+        uint64_t best = 0;
+        double bestTime = -1;
+        for(auto& [id, f]: filters) {
+            if(f->isBypassed() || f->getTier() == 0)
+                continue;
+
+            auto it = passTimes.find(f->getPassName());
+            if(it != passTimes.end() && it->second > bestTime) {
+                best = id;
+                bestTime = it->second;
+            }
+        }
+
+        if(bestTime < 0)
+            return false;
+
+        auto& f = filters.at(best);
+        f->setTier(f->getTier() - 1);
+        this->lowered.push_back(best);
+        return true;
+    }
+
+    bool QualityGovernor::raise(const std::map<uint64_t, std::unique_ptr<FilterPipeline>>& filters) {
+        while(!this->lowered.empty()) {
+            auto id = this->lowered.back();
+            this->lowered.pop_back();
+
+            //The filter may have been removed since
+            auto it = filters.find(id);
+            if(it == filters.end())
+                continue;
+
+            it->second->setTier(it->second->getTier() + 1);
+            return true;
+        }
+        return false;
+    }
+
+    void QualityGovernor::restore(const std::map<uint64_t, std::unique_ptr<FilterPipeline>>& filters) {
+        while(raise(filters)) {}
+        this->overFrames = this->underFrames = 0;
+    }
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "FilterPipeline.hpp"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fly {
+
+    /*
+    Keeps the post-processing on budget by moving the filters between their quality tiers.
+    When the frame is too slow the filter of the most expensive pass goes one tier down, 
+    and when there is room again the lowered filters go back up in the reverse order
+    */
+    class QualityGovernor {
+    public:
+        void setEnabled(bool enabled) { this->enabled = enabled; }
+        bool isEnabled() const { return this->enabled; }
+        void setTargetFrameTime(double ms) { this->targetFrameTime = ms; }
+        uint32_t getLoweredSteps() const { return static_cast<uint32_t>(this->lowered.size()); }
+
+        //Takes the GPU times in ms of the last finished frame. The engine says when lowering or raising makes sense, e.g. the resolution scale goes first
+        void update(
+            double gpuFrameTime, 
+            const std::map<std::string, double>& passTimes, 
+            const std::map<uint64_t, std::unique_ptr<FilterPipeline>>& filters,
+            bool canLower, bool canRaise
+        );
+
+    private:
+        static constexpr uint32_t PATIENCE_FRAMES = 30; //Frames in a row out of budget before a step, also lets the timings of the last step arrive
+        static constexpr double RAISE_MARGIN = 0.75; //Fraction of the budget under which there is room for a better tier
+
+        bool enabled = false;
+        double targetFrameTime = 1000.0 / 60.0;
+        uint32_t overFrames = 0, underFrames = 0;
+        std::vector<uint64_t> lowered; //Filter ids, one per step down
+
+        bool lower(const std::map<std::string, double>& passTimes, const std::map<uint64_t, std::unique_ptr<FilterPipeline>>& filters);
+        bool raise(const std::map<uint64_t, std::unique_ptr<FilterPipeline>>& filters);
+        void restore(const std::map<uint64_t, std::unique_ptr<FilterPipeline>>& filters);
+    };
+
+}
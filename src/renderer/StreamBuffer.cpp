@@ -0,0 +1,119 @@
+#include "StreamBuffer.hpp"
+
+#include "vulkan/VulkanHelpers.hpp"
+
+#include <Utils.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+namespace fly {
+
+    StreamBuffer::~StreamBuffer() {
+        for(auto& r: this->retired) {
+            vmaDestroyBuffer(vk->allocator, r.buffer, r.alloc);
+            vmaDestroyBuffer(vk->allocator, r.stagingBuffer, r.stagingAlloc);
+        }
+
+        if(this->buffer)
+            vmaDestroyBuffer(vk->allocator, this->buffer, this->alloc);
+        if(this->stagingBuffer)
+            vmaDestroyBuffer(vk->allocator, this->stagingBuffer, this->stagingAlloc);
+    }
+
+    void StreamBuffer::resize(VkDeviceSize size) {
+        if(size > this->capacity)
+            grow(size);
+        this->contents.resize(size);
+        markDirty(this->size, size); //The new bytes are zeros until they are written
+        this->size = size;
+        this->dirtyEnd = std::min(this->dirtyEnd, size);
+        this->dirtyBegin = std::min(this->dirtyBegin, this->dirtyEnd);
+    }
+
+    void StreamBuffer::write(VkDeviceSize offset, std::span<const std::byte> data) {
+        if(data.empty())
+            return;
+        if(offset + data.size() > this->size)
+            resize(offset + data.size());
+
+        //Only the range between the first and the last byte that changed
+        auto old = this->contents.begin() + offset;
+        auto first = std::mismatch(data.begin(), data.end(), old).first;
+        if(first == data.end())
+            return;
+        auto last = std::mismatch(data.rbegin(), data.rend(), std::make_reverse_iterator(old + data.size())).first;
+
+        VkDeviceSize begin = offset + (first - data.begin()), end = offset + data.size() - (last - data.rbegin());
+        std::copy(data.begin() + (begin - offset), data.begin() + (end - offset), this->contents.begin() + begin);
+        markDirty(begin, end);
+    }
+
+    void StreamBuffer::recordUpload(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+        std::erase_if(this->retired, [&](RetiredBuffer& r) {
+            if(--r.framesLeft > 0)
+                return false;
+            vmaDestroyBuffer(vk->allocator, r.buffer, r.alloc);
+            vmaDestroyBuffer(vk->allocator, r.stagingBuffer, r.stagingAlloc);
+            return true;
+        });
+
+        if(!isDirty())
+            return;
+
+        //At the same offset in the region of the frame, so a single copy is enough
+        VkDeviceSize regionOffset = this->capacity * currentFrame;
+        auto region = static_cast<std::byte*>(this->stagingInfo.pMappedData) + regionOffset;
+        memcpy(region + this->dirtyBegin, this->contents.data() + this->dirtyBegin, this->dirtyEnd - this->dirtyBegin);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = regionOffset + this->dirtyBegin;
+        copyRegion.dstOffset = this->dirtyBegin;
+        copyRegion.size = this->dirtyEnd - this->dirtyBegin;
+        vkCmdCopyBuffer(commandBuffer, this->stagingBuffer, this->buffer, 1, &copyRegion);
+
+        this->dirtyBegin = this->dirtyEnd = 0;
+    }
+
+    void StreamBuffer::grow(VkDeviceSize minCapacity) {
+        //The frames in flight may still use the old ones
+        if(this->buffer)
+            this->retired.push_back({ this->buffer, this->stagingBuffer, this->alloc, this->stagingAlloc, MAX_FRAMES_IN_FLIGHT });
+
+        this->capacity = std::bit_ceil(minCapacity);
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = this->capacity;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | this->usage;
+
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        if(vmaCreateBuffer(vk->allocator, &bufferInfo, &allocInfo, &this->buffer, &this->alloc, nullptr) != VK_SUCCESS)
+            throw std::runtime_error("failed to create stream buffer!");
+
+        bufferInfo.size = this->capacity * MAX_FRAMES_IN_FLIGHT;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        if(vmaCreateBuffer(vk->allocator, &bufferInfo, &allocInfo, &this->stagingBuffer, &this->stagingAlloc, &this->stagingInfo) != VK_SUCCESS)
+            throw std::runtime_error("failed to create stream staging buffer!");
+
+        //The new buffer is empty, everything is uploaded again
+        markDirty(0, this->size);
+    }
+
+    void StreamBuffer::markDirty(VkDeviceSize begin, VkDeviceSize end) {
+        if(begin >= end)
+            return;
+        if(!isDirty()) {
+            this->dirtyBegin = begin;
+            this->dirtyEnd = end;
+            return;
+        }
+        this->dirtyBegin = std::min(this->dirtyBegin, begin);
+        this->dirtyEnd = std::max(this->dirtyEnd, end);
+    }
+
+}
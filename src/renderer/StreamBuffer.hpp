@@ -0,0 +1,64 @@
+#pragma once
+
+#include "vulkan/VulkanTypes.h"
+#include "vulkan/VulkanConstants.h"
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace fly {
+
+    /*
+    A device local buffer written every frame without waiting for the GPU. The CPU keeps a copy of the contents, and only the
+    bytes that changed since the last upload are copied, from the staging region of the frame being recorded. Each frame in flight
+    has its own region, so a write never touches what the GPU may still be reading
+
+    The copy is recorded in the frame command buffer, before any render pass. When the buffer grows the old one is destroyed
+    once the frames in flight are done with it
+    */
+    class StreamBuffer {
+    public:
+        StreamBuffer(std::shared_ptr<VulkanInstance> vk, VkBufferUsageFlags usage): vk{vk}, usage{usage} {}
+        ~StreamBuffer();
+
+        StreamBuffer(const StreamBuffer&) = delete;
+        StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+        //Shrinking keeps the capacity, the new bytes are zeros
+        void resize(VkDeviceSize size);
+        //Grows the buffer if it doesn't fit. Only the bytes different from the ones already there are uploaded
+        void write(VkDeviceSize offset, std::span<const std::byte> data);
+
+        //Call it once per frame, after the fence of the frame was waited. It also destroys the retired buffers
+        void recordUpload(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+
+        bool isDirty() const { return this->dirtyBegin < this->dirtyEnd; }
+        VkBuffer getBuffer() const { return this->buffer; } //Changes when it grows
+        VkDeviceSize getSize() const { return this->size; }
+
+    private:
+        struct RetiredBuffer {
+            VkBuffer buffer, stagingBuffer;
+            VmaAllocation alloc, stagingAlloc;
+            uint32_t framesLeft;
+        };
+
+        std::shared_ptr<VulkanInstance> vk;
+        VkBufferUsageFlags usage;
+
+        VkBuffer buffer = VK_NULL_HANDLE, stagingBuffer = VK_NULL_HANDLE;
+        VmaAllocation alloc = VK_NULL_HANDLE, stagingAlloc = VK_NULL_HANDLE;
+        VmaAllocationInfo stagingInfo{};
+        VkDeviceSize size = 0, capacity = 0; //The staging buffer has a region of the capacity for each frame in flight
+
+        std::vector<std::byte> contents; //What the device buffer has after the pending upload
+        VkDeviceSize dirtyBegin = 0, dirtyEnd = 0;
+        std::vector<RetiredBuffer> retired;
+
+        void grow(VkDeviceSize minCapacity);
+        void markDirty(VkDeviceSize begin, VkDeviceSize end);
+    };
+
+}
@@ -3,12 +3,25 @@
 #include "vulkan/VulkanConstants.h"
 #include "vulkan/VulkanTypes.h"
 #include "vulkan/VulkanHelpers.hpp"
+#include "vulkan/Descriptors.hpp"
+#include "GeometryArena.hpp"
+#include "FrustumCuller.hpp"
+#include "OcclusionCuller.hpp"
+#include "MeshletCuller.hpp"
+#include "MeshLods.hpp"
+#include "BindlessTable.hpp"
 #include <Utils.hpp>
 
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <bit>
 #include <cstdint>
+#include <cstring>
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <optional>
 #include <queue>
 #include <stdexcept>
 
@@ -23,30 +36,73 @@ namespace fly {
         virtual void allocate(const VkRenderPass renderPass) = 0;
         virtual void recordOnCommandBuffer(VkCommandBuffer commandBuffer, uint32_t currentFrame) = 0;
         virtual void update(uint32_t currentFrame) = 0;
+        //Called when the fence of the frame has been waited and before anything is recorded, so the buffers of the frame can be written
+        virtual void prepareFrame([[maybe_unused]] uint32_t currentFrame) {}
+        //Copies the streamed geometry written since the last frame, recorded before any render pass
+        virtual void recordTransfers([[maybe_unused]] VkCommandBuffer commandBuffer, [[maybe_unused]] uint32_t currentFrame) {}
+        //The culling on the GPU. Phase 0 is recorded before the render pass and phase 1, only for occlusion culling, after the depth pyramid is built
+        virtual void recordCulling([[maybe_unused]] VkCommandBuffer commandBuffer, [[maybe_unused]] uint32_t currentFrame, [[maybe_unused]] uint32_t phase) {}
+        //Draws what the second phase found visible, in a render pass that loads the attachments
+        virtual void recordLateOnCommandBuffer([[maybe_unused]] VkCommandBuffer commandBuffer, [[maybe_unused]] uint32_t currentFrame) {}
         virtual ~IGraphicsPipeline() {}
     };
 
     constexpr uint32_t DEPTH_TEST_ENABLED = 0x01;
     constexpr uint32_t DEFERRED_ENABLED = 0x02;
     constexpr uint32_t BACK_CULLING_ENABLED = 0x04;
+    constexpr uint32_t INDIRECT_DRAW_ENABLED = 0x08; //Ignored if the device doesn't support it
+    constexpr uint32_t OCCLUSION_CULLING_ENABLED = 0x10; //Needs INDIRECT_DRAW_ENABLED and drawIndirectCount
+    constexpr uint32_t MESHLET_CULLING_ENABLED = 0x20; //Needs INDIRECT_DRAW_ENABLED
+    constexpr uint32_t BINDLESS_ENABLED = 0x40; //Ignored if the device doesn't support descriptor indexing
+
+
+    //Per draw data of the indirect path, read in the shaders with gl_BaseInstance. Padded like a std430 struct with vec4 members
+    //The direct path with the bindless table pushes it as its push constant
+    template<typename T>
+    struct alignas(16) TDrawData {
+        T data;
+        uint32_t textureIndex;
+    };
+    template<>
+    struct TDrawData<void> {
+        uint32_t textureIndex;
+    };
 
 
     template<typename Vertex_t, typename T>
     struct TMeshData {
         std::unique_ptr<TVertexArray<Vertex_t>> vertexArray;
         VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
-        std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> descriptorSets;
+        std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> descriptorSets; //Of the first material, the indirect path only has them with createOwnDescriptorSets
+        std::vector<std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT>> materialSets; //Of the other materials, from the same pool
         int instanceCount;
+        std::vector<uint32_t> textureIndices; //Of each material, only used by the indirect and bindless paths
+        uint32_t lod = 0; //Level of detail drawn, chosen with the camera
+        uint32_t cullSlot = 0; //Of its sphere in the frustum culler, kept while it is attached
+        bool placed = false; //It has a model matrix, the center of its sphere is where it is sorted
 
         T pushConstant;
+
+        VkDescriptorSet getDescriptorSet(uint32_t material, uint32_t currentFrame) const { 
+            return material == 0? this->descriptorSets[currentFrame] : this->materialSets[material - 1][currentFrame]; 
+        }
     };
     //Idk what this language is about anymore
     template<typename Vertex_t>
     struct TMeshData<Vertex_t, void> {
         std::unique_ptr<TVertexArray<Vertex_t>> vertexArray;
         VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
-        std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> descriptorSets;
+        std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> descriptorSets; //Of the first material, the indirect path only has them with createOwnDescriptorSets
+        std::vector<std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT>> materialSets; //Of the other materials, from the same pool
         int instanceCount;
+        std::vector<uint32_t> textureIndices; //Of each material, only used by the indirect and bindless paths
+        uint32_t lod = 0; //Level of detail drawn, chosen with the camera
+        uint32_t cullSlot = 0; //Of its sphere in the frustum culler, kept while it is attached
+        bool placed = false; //It has a model matrix, the center of its sphere is where it is sorted
+
+        VkDescriptorSet getDescriptorSet(uint32_t material, uint32_t currentFrame) const { 
+            return material == 0? this->descriptorSets[currentFrame] : this->materialSets[material - 1][currentFrame]; 
+        }
     };
 
 
@@ -57,11 +113,38 @@ namespace fly {
 
     To use this, you should first call allocate, then attach the models and then populate the descriptor sets with functions created by the child of this abstract class
 
+    With INDIRECT_DRAW_ENABLED the meshes in the geometry arena are drawn with a single vkCmdDrawIndexedIndirect. The push constants 
+    of every mesh go to a storage buffer in set 1, and set 0 is shared by all the meshes, so the child must use other shaders in that mode
+
+    With OCCLUSION_CULLING_ENABLED the arena draws are culled on the GPU against the depth pyramid instead of on the CPU
+
+    With MESHLET_CULLING_ENABLED the big meshes in the arena are culled by meshlet on the GPU, and only the triangles
+    of the visible meshlets are drawn. These meshes aren't occlusion culled
+
+    The meshes with levels of detail draw the coarsest one whose error is under a pixel on screen, this needs getModelMatrix
+
+    The submeshes of a mesh are drawn from the same buffers, only the set of their material changes between them. In the indirect 
+    path each one is a draw with its own texture index
+
+    The streamed meshes are drawn like the ones out of the arena, their writes are copied in recordTransfers
+
+    A mesh of the indirect path can get a set 0 of its own with createOwnDescriptorSets, when what it needs doesn't fit in the
+    shared one. It is drawn by itself after the other draws, with its own set bound
+
+    With BINDLESS_ENABLED the meshes don't have sets of their own. Set 0 is shared like in the indirect path and the set of the
+    bindless table goes after the other ones, so the textures are found by the index of each material. The direct path pushes
+    a TDrawData with the push constant and that index, for the vertex and fragment stages
+
     */
     template<typename Vertex_t, typename PushConstants_t = void>
     class TGraphicsPipeline : public IGraphicsPipeline {
     public:
-        TGraphicsPipeline(std::shared_ptr<VulkanInstance> vk, uint32_t flags): flags(flags), vk{vk} {}
+        TGraphicsPipeline(std::shared_ptr<VulkanInstance> vk, uint32_t flags): flags(flags), vk{vk} {
+            this->indirect = (flags & INDIRECT_DRAW_ENABLED) && vk->indirectDrawSupported;
+            this->occlusion = this->indirect && (flags & OCCLUSION_CULLING_ENABLED) && vk->occlusionCuller;
+            this->meshletCulling = this->indirect && (flags & MESHLET_CULLING_ENABLED) && vk->meshletCuller;
+            this->bindless = (flags & BINDLESS_ENABLED) && vk->bindlessTable;
+        }
         virtual ~TGraphicsPipeline() {
             std::vector<unsigned> keys;
             keys.reserve(this->meshes.size());
@@ -83,6 +166,16 @@ namespace fly {
                 this->pendingDetach.pop();
             }
 
+            for(auto& frame: this->indirectFrames) {
+                destroyDrawBuffers(frame);
+                destroyMeshletBuffers(frame);
+            }
+            vkDestroyDescriptorPool(vk->device, this->sharedDescriptorPool, nullptr);
+            vkDestroyDescriptorPool(vk->device, this->cullDescriptorPool, nullptr);
+            vkDestroyDescriptorPool(vk->device, this->meshletDescriptorPool, nullptr);
+            vkDestroyDescriptorPool(vk->device, this->drawDescriptorPool, nullptr);
+            vkDestroyDescriptorSetLayout(vk->device, this->drawSetLayout.layout, nullptr);
+
             vkDestroyDescriptorSetLayout(vk->device, this->descriptorSetLayout.layout, nullptr);
             vkDestroyPipeline(vk->device, this->graphicsPipeline, nullptr);
             vkDestroyPipelineLayout(vk->device, this->pipelineLayout, nullptr);
@@ -90,10 +183,49 @@ namespace fly {
 
         void allocate(const VkRenderPass renderPass) override {
             this->descriptorSetLayout = createDescriptorSetLayout();
+            std::vector<VkDescriptorSetLayout> setLayouts = { this->descriptorSetLayout.layout };
+
+            //Set 0 is shared by all the meshes
+            if(this->indirect || this->bindless) {
+                this->sharedDescriptorPool = createDescriptorPoolWithLayout(this->descriptorSetLayout, this->vk);
+                this->sharedDescriptorSets = allocateDescriptorSets(this->vk, this->descriptorSetLayout.layout, this->sharedDescriptorPool);
+            }
+
+            //Set 1 has the draw data
+            if(this->indirect) {
+                this->drawSetLayout = newDescriptorSetBuild(MAX_FRAMES_IN_FLIGHT, {
+                    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT}
+                }).build(vk);
+                this->drawDescriptorPool = createDescriptorPoolWithLayout(this->drawSetLayout, this->vk);
+                auto drawSets = allocateDescriptorSets(this->vk, this->drawSetLayout.layout, this->drawDescriptorPool);
+                for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i)
+                    this->indirectFrames[i].drawSet = drawSets[i];
+
+                setLayouts.push_back(this->drawSetLayout.layout);
+            }
+
+            if(this->bindless)
+                setLayouts.push_back(vk->bindlessTable->getSetLayout());
+
+            if(this->occlusion) {
+                const auto& cullSetLayout = vk->occlusionCuller->getDrawSetLayout();
+                this->cullDescriptorPool = createDescriptorPoolWithLayout(cullSetLayout, this->vk);
+                auto cullSets = allocateDescriptorSets(this->vk, cullSetLayout.layout, this->cullDescriptorPool);
+                for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i)
+                    this->indirectFrames[i].cullSet = cullSets[i];
+            }
+
+            if(this->meshletCulling) {
+                const auto& meshletSetLayout = vk->meshletCuller->getSetLayout();
+                this->meshletDescriptorPool = createDescriptorPoolWithLayout(meshletSetLayout, this->vk);
+                auto meshletSets = allocateDescriptorSets(this->vk, meshletSetLayout.layout, this->meshletDescriptorPool);
+                for(int i=0; i<MAX_FRAMES_IN_FLIGHT; ++i)
+                    this->indirectFrames[i].meshletSet = meshletSets[i];
+            }
             
             auto [pipeline, layout] = createGraphicsPipeline(
                 this->vk, this->getVertShaderCode(), this->getFragShaderCode(), 
-                renderPass, this->descriptorSetLayout.layout, this->flags
+                renderPass, setLayouts, this->flags, !this->indirect, this->bindless
             );
             this->graphicsPipeline = pipeline;
             this->pipelineLayout = layout;
@@ -102,11 +234,28 @@ namespace fly {
         unsigned attachModel(std::unique_ptr<TVertexArray<Vertex_t>> vertexArray, int instanceCount = 1) {
             MeshData data;
             data.vertexArray = std::move(vertexArray);
-            data.descriptorPool = createDescriptorPoolWithLayout(this->descriptorSetLayout, this->vk);
-            data.descriptorSets = allocateDescriptorSets(this->vk, this->descriptorSetLayout.layout, data.descriptorPool);
+            uint32_t materialCount = data.vertexArray->getMaterialCount();
+            if(!this->indirect && !this->bindless) {
+                //One pool with room for the sets of every material
+                auto poolLayout = this->descriptorSetLayout;
+                poolLayout.descriptorCount *= materialCount;
+                for(auto& size: poolLayout.poolSizes)
+                    size.descriptorCount *= materialCount;
+
+                data.descriptorPool = createDescriptorPoolWithLayout(poolLayout, this->vk);
+                data.descriptorSets = allocateDescriptorSets(this->vk, this->descriptorSetLayout.layout, data.descriptorPool);
+                for(uint32_t i=1; i<materialCount; ++i)
+                    data.materialSets.push_back(allocateDescriptorSets(this->vk, this->descriptorSetLayout.layout, data.descriptorPool));
+            }
+            data.textureIndices.assign(materialCount, 0);
             data.instanceCount = instanceCount;
+            data.cullSlot = this->culler.add({ glm::vec3(0.0f), FrustumCuller::NEVER_CULLED });
+            if(data.vertexArray->isStreaming())
+                this->streamedMeshes.push_back(globalId);
     
             meshes[globalId] = std::move(data);
+            updateCullSphere(globalId);
+            markDrawsDirty();
             return globalId++;
         }
 
@@ -123,33 +272,176 @@ namespace fly {
         }
 
         void detachModel(unsigned id, uint32_t currentFrame) {
+            FLY_ASSERT(meshes.contains(id), "Invalid mesh");
+            modelDetached(id, this->meshes.at(id));
+
             ModelDetachInfo info;
             info.data = std::move( this->meshes.extract(id).mapped() );
             info.currentFrame = currentFrame;
+            this->culler.remove(info.data.cullSlot);
+            std::erase(this->streamedMeshes, id);
 
             this->pendingDetach.push(std::move(info));
+            markDrawsDirty();
+        }
+
+        void recordTransfers(VkCommandBuffer commandBuffer, uint32_t currentFrame) override {
+            bool pending = std::any_of(this->streamedMeshes.begin(), this->streamedMeshes.end(), [&](unsigned id) {
+                return this->meshes.at(id).vertexArray->hasPendingUpload();
+            });
+
+            //The last frame may still be drawing from the buffers, and copying to them too
+            if(pending) {
+                memoryBarrier(
+                    commandBuffer,
+                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT
+                );
+            }
+
+            //Every frame, so the outgrown buffers are destroyed
+            for(auto id: this->streamedMeshes)
+                this->meshes.at(id).vertexArray->recordUpload(commandBuffer, currentFrame);
+
+            if(pending) {
+                memoryBarrier(
+                    commandBuffer,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT
+                );
+                //The counts, the buffers and the bounds may have changed
+                for(auto id: this->streamedMeshes)
+                    updateCullSphere(id);
+                markDrawsDirty();
+            }
+        }
+
+        void recordCulling(VkCommandBuffer commandBuffer, uint32_t currentFrame, uint32_t phase) override {
+            if(!this->indirect)
+                return;
+
+            auto& frame = this->indirectFrames[currentFrame];
+            if(phase == 0) {
+                if(isStale(frame))
+                    writeDraws(frame);
+                recordMeshletCulling(commandBuffer, frame);
+            }
+            if(!this->occlusion)
+                return;
+
+            auto& occlusionCuller = *vk->occlusionCuller;
+            if(phase == 0) {
+                if(frame.arenaDrawCount == 0)
+                    return;
+
+                vkCmdFillBuffer(commandBuffer, frame.countBuffer, 0, VK_WHOLE_SIZE, 0);
+                memoryBarrier(
+                    commandBuffer,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+                );
+
+                //The pyramid is the depth of the last frame, so it is tested with the camera it was drawn with
+                occlusionCuller.cull(commandBuffer, frame.cullSet, frame.arenaDrawCount, 0, 0, this->hasLastProjView? this->lastProjView : this->cameraProjView);
+                frame.culled = true;
+            } else if(frame.culled) {
+                occlusionCuller.cull(commandBuffer, frame.cullSet, frame.arenaDrawCount, static_cast<uint32_t>(frame.capacity), 1, this->cameraProjView);
+            }
+        }
+
+        void recordLateOnCommandBuffer(VkCommandBuffer commandBuffer, uint32_t currentFrame) override {
+            auto& frame = this->indirectFrames[currentFrame];
+            if(!this->occlusion || !frame.culled)
+                return;
+
+            frame.culled = false;
+            if(frame.arenaDrawCount == 0)
+                return;
+
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->graphicsPipeline);
+            bindSharedSets(commandBuffer, currentFrame);
+
+            VkDeviceSize offsets[] = {0};
+            VkBuffer vBuffer = vk->geometryArena->getVertexBuffer();
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vBuffer, offsets);
+            vkCmdBindIndexBuffer(commandBuffer, vk->geometryArena->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+            vkCmdDrawIndexedIndirectCount(
+                commandBuffer,
+                frame.culledBuffer, sizeof(VkDrawIndexedIndirectCommand) * frame.capacity,
+                frame.countBuffer, sizeof(uint32_t),
+                frame.arenaDrawCount, sizeof(VkDrawIndexedIndirectCommand)
+            );
         }
 
         void recordOnCommandBuffer(VkCommandBuffer commandBuffer, uint32_t currentFrame) override {
             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->graphicsPipeline);
+            if(this->indirect) {
+                recordIndirect(commandBuffer, currentFrame);
+                if(this->occlusion) {
+                    this->lastProjView = this->cameraProjView;
+                    this->hasLastProjView = true;
+                }
+                return;
+            }
     
+            //Only the state that changes between consecutive draws is bound
             VkDeviceSize offsets[] = {0};
-            for(const auto& [k, mesh]: this->meshes) {
-                if(mesh.vertexArray->getVertexCount() == 0 || mesh.vertexArray->getIndexCount() == 0 || mesh.instanceCount < 1)
-                    continue;
+            VkBuffer lastVertexBuffer = VK_NULL_HANDLE, lastIndexBuffer = VK_NULL_HANDLE;
+            VkIndexType lastIndexType = VK_INDEX_TYPE_MAX_ENUM;
+            VkDescriptorSet lastSet = VK_NULL_HANDLE;
+            if(this->bindless)
+                bindSharedSets(commandBuffer, currentFrame);
+            buildDrawOrder();
+            for(auto [key, id]: this->drawOrder) {
+                const auto& mesh = this->meshes.at(id);
 
                 VkBuffer vBuffer = mesh.vertexArray->getVertexBuffer();
-                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vBuffer, offsets);
+                if(vBuffer != lastVertexBuffer) {
+                    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vBuffer, offsets);
+                    lastVertexBuffer = vBuffer;
+                }
     
-                vkCmdBindIndexBuffer(commandBuffer, mesh.vertexArray->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+                //The meshes in the arena share the index buffer, but not always the index type
+                VkBuffer iBuffer = mesh.vertexArray->getIndexBuffer();
+                VkIndexType indexType = mesh.vertexArray->getIndexType();
+                if(iBuffer != lastIndexBuffer || indexType != lastIndexType) {
+                    vkCmdBindIndexBuffer(commandBuffer, iBuffer, 0, indexType);
+                    lastIndexBuffer = iBuffer;
+                    lastIndexType = indexType;
+                }
     
-                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, 1, &mesh.descriptorSets[currentFrame], 0, nullptr);
+                if constexpr (fly::not_void<PushConstants_t>) {
+                    if(!this->bindless)
+                        vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants_t), &mesh.pushConstant);
+                }
 
-                if constexpr (fly::not_void<PushConstants_t>)
-                    vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants_t), &mesh.pushConstant);
+                //The submeshes only change the set of their material, or its texture index without sets
+                for(uint32_t i=0; i<mesh.vertexArray->getSubmeshCount(); ++i) {
+                    auto submesh = mesh.vertexArray->getSubmesh(mesh.lod, i);
+                    if(this->bindless) {
+                        DrawData data{};
+                        if constexpr (fly::not_void<PushConstants_t>)
+                            data.data = mesh.pushConstant;
+                        data.textureIndex = mesh.textureIndices[submesh.material];
+                        vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(DrawData), &data);
+                        vkCmdDrawIndexed(commandBuffer, submesh.indexCount, mesh.instanceCount, mesh.vertexArray->getFirstIndex() + submesh.firstIndex, mesh.vertexArray->getVertexOffset(), 0);
+                        continue;
+                    }
+
+                    VkDescriptorSet set = mesh.getDescriptorSet(submesh.material, currentFrame);
+                    if(set != lastSet) {
+                        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, 1, &set, 0, nullptr);
+                        lastSet = set;
+                    }
 
-                vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh.vertexArray->getIndexCount()),
-                    mesh.instanceCount, 0, 0, 0); 
+                    vkCmdDrawIndexed(commandBuffer, submesh.indexCount, mesh.instanceCount, mesh.vertexArray->getFirstIndex() + submesh.firstIndex, mesh.vertexArray->getVertexOffset(), 0); 
+                }
             }
         }
 
@@ -158,6 +450,8 @@ namespace fly {
             FLY_ASSERT(instanceCount >= 0, "Instance count must be greater than 0");
 
             meshes.at(meshIndex).instanceCount = instanceCount;
+            updateCullSphere(meshIndex);
+            markDrawsDirty();
         }
 
         
@@ -165,6 +459,23 @@ namespace fly {
         void setPushConstant(unsigned meshIndex, const T& pc) requires fly::not_void<T> {
             FLY_ASSERT(meshes.contains(meshIndex), "Invalid mesh");
             meshes.at(meshIndex).pushConstant = pc;
+            updateCullSphere(meshIndex);
+            markDrawsDirty();
+        }
+
+        //The meshes out of this view are culled and the rest are drawn front to back, so the depth test rejects more fragments
+        void setCamera(const glm::vec3& eye, const glm::mat4& projView) {
+            //The indirect commands have to be culled and sorted again. With occlusion culling the GPU does it every frame
+            bool changed = !this->hasCamera || projView != this->cameraProjView || eye != this->cameraPos;
+            if(this->indirect && changed && (!this->occlusion || !this->hasCamera))
+                markDrawsDirty();
+
+            this->cameraPos = eye;
+            this->cameraProjView = projView;
+            this->hasCamera = true;
+
+            if(selectLods())
+                markDrawsDirty();
         }
 
         TVertexArray<Vertex_t>& getVertexData(unsigned meshIndex) {
@@ -183,16 +494,626 @@ namespace fly {
 
         struct ModelDetachInfo { MeshData data; uint32_t currentFrame; };
         std::queue<ModelDetachInfo> pendingDetach;
+        std::vector<unsigned> streamedMeshes;
 
         virtual std::vector<char> getVertShaderCode() = 0;
         virtual std::vector<char> getFragShaderCode() = 0;
 
         virtual DescriptorSetLayout createDescriptorSetLayout() = 0;
+
+        bool isIndirect() const { return this->indirect; }
+
+        //Where the mesh is in the world, to cull and sort the draws. Without it they're never culled and only grouped by geometry buffer
+        //It is read again by setInstanceCount, setPushConstant and modelMoved, so call one of them when it changes
+        virtual std::optional<glm::mat4> getModelMatrix([[maybe_unused]] unsigned meshIndex, [[maybe_unused]] const MeshData& mesh) const { return std::nullopt; }
+
+        void modelMoved(unsigned meshIndex) {
+            FLY_ASSERT(meshes.contains(meshIndex), "Invalid mesh");
+            updateCullSphere(meshIndex);
+            markDrawsDirty();
+        }
+
+        //Called by detachModel before the mesh is gone, so the child can free what it kept for it
+        virtual void modelDetached([[maybe_unused]] unsigned meshIndex, [[maybe_unused]] const MeshData& mesh) {}
+
+        const glm::mat4& getCameraProjView() const { return this->cameraProjView; }
+
+        bool isBindless() const { return this->bindless; }
+
+        //Only write it in prepareFrame, when its frame isn't in flight
+        VkDescriptorSet getSharedDescriptorSet(uint32_t currentFrame) const {
+            FLY_ASSERT(this->indirect || this->bindless, "Only the indirect and bindless paths have a shared descriptor set");
+            return this->sharedDescriptorSets[currentFrame];
+        }
+
+        //A set 0 for each frame only used by this mesh, the child writes them like the shared ones. The mesh is drawn by itself from now on
+        void createOwnDescriptorSets(unsigned meshIndex) {
+            FLY_ASSERT(this->indirect && !this->bindless, "Only the indirect path without the bindless table shares its set 0");
+            FLY_ASSERT(meshes.contains(meshIndex), "Invalid mesh");
+            auto& mesh = meshes.at(meshIndex);
+            if(hasOwnDescriptorSets(mesh))
+                return;
+
+            mesh.descriptorPool = createDescriptorPoolWithLayout(this->descriptorSetLayout, this->vk);
+            mesh.descriptorSets = allocateDescriptorSets(this->vk, this->descriptorSetLayout.layout, mesh.descriptorPool);
+            updateCullSphere(meshIndex); //It isn't culled by the GPU anymore
+            markDrawsDirty();
+        }
+
+        //Always true in the direct path
+        bool hasOwnDescriptorSets(const MeshData& mesh) const { return mesh.descriptorPool != VK_NULL_HANDLE; }
+
+        void setTextureIndex(unsigned meshIndex, uint32_t textureIndex, uint32_t material = 0) {
+            FLY_ASSERT(meshes.contains(meshIndex), "Invalid mesh");
+            FLY_ASSERT(material < meshes.at(meshIndex).textureIndices.size(), "Invalid material");
+            meshes.at(meshIndex).textureIndices[material] = textureIndex;
+            markDrawsDirty();
+        }
+
+        //The shared set may be in use by the frames in flight, so the write is done to each set when its frame is recorded again
+        void writeSharedImage(uint32_t binding, uint32_t arrayElement, VkDescriptorType type, VkDescriptorImageInfo imageInfo) {
+            FLY_ASSERT(this->indirect, "Only the indirect path has a shared descriptor set");
+            for(auto& frame: this->indirectFrames)
+                frame.pendingImageWrites.push_back({binding, arrayElement, type, imageInfo});
+        }
     
     private:
         DescriptorSetLayout descriptorSetLayout;
         VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
         VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+
+        //DRAW SORTING
+        struct DrawKey { uint64_t key; unsigned id; };
+        std::vector<DrawKey> drawOrder;
+        glm::vec3 cameraPos{0};
+        glm::mat4 cameraProjView{1};
+        bool hasCamera = false;
+        glm::mat4 lastProjView{1}; //The camera of the last frame, the one of the depth pyramid
+        bool hasLastProjView = false;
+
+        //FRUSTUM CULLING, every mesh has a sphere in the culler and it is only written when the mesh changes
+        FrustumCuller culler;
+        std::vector<uint8_t> cullVisible;
+
+        //Meshes in the arena share their buffers, so they go first and together, the ones culled by meshlet after them. Then front to back
+        //In the indirect path the ones with their own sets are drawn one by one, like the meshes out of the arena
+        void pushDrawKey(unsigned id, const MeshData& mesh, const glm::vec3& position) {
+            glm::vec3 d = position - this->cameraPos;
+            //Positive floats sort like their bits
+            uint64_t depth = std::bit_cast<uint32_t>(glm::dot(d, d));
+            uint64_t group = !drawnWithArena(mesh)? 2 : usesMeshlets(id, mesh)? 1 : 0;
+            this->drawOrder.push_back({ (group << 32) | depth, id });
+        }
+
+        //A mesh of a single meshlet is culled as well as a whole. The meshlets are of the full level
+        bool usesMeshlets(unsigned id, const MeshData& mesh) const {
+            return this->meshletCulling && this->hasCamera && drawnWithArena(mesh) && mesh.vertexArray->getMeshlets().size() > 1
+                && mesh.instanceCount == 1 && mesh.lod == 0 && getModelMatrix(id, mesh).has_value();
+        }
+
+        bool drawnWithArena(const MeshData& mesh) const {
+            return mesh.vertexArray->isInArena() && !(this->indirect && hasOwnDescriptorSets(mesh));
+        }
+
+        //LEVEL OF DETAIL, the error of each level projected to pixels. Returns true if a mesh changed its level
+        bool selectLods() {
+            //The y row of a perspective projView is the y row of the view scaled by the focal length, and w is the depth
+            const auto& m = this->cameraProjView;
+            float focal = glm::length(glm::vec3(m[0][1], m[1][1], m[2][1]));
+            float pixelsPerUnit = focal * 0.5f * static_cast<float>(vk->renderExtent.height);
+
+            bool changed = false;
+            for(auto& [id, mesh]: this->meshes) {
+                uint32_t levels = mesh.vertexArray->getLodCount();
+                auto model = levels > 1? getModelMatrix(id, mesh) : std::nullopt;
+                const auto& bounds = mesh.vertexArray->getBounds();
+
+                //The bounds only cover the first instance, so the instanced meshes keep the full level
+                uint32_t lod = 0;
+                if(model && bounds && mesh.instanceCount == 1) {
+                    auto sphere = bounds->transform(*model);
+                    float scale = bounds->radius > 0.0f? sphere.radius / bounds->radius : 1.0f;
+                    float depth = m[0][3] * sphere.center.x + m[1][3] * sphere.center.y + m[2][3] * sphere.center.z + m[3][3];
+
+                    if(depth > sphere.radius) {
+                        float errorToPixels = scale * pixelsPerUnit / (depth - sphere.radius);
+                        lod = std::min(mesh.lod, levels - 1);
+                        while(lod > 0 && mesh.vertexArray->getLod(lod).error * errorToPixels > LOD_PIXEL_ERROR)
+                            lod--;
+                        while(lod + 1 < levels && mesh.vertexArray->getLod(lod + 1).error * errorToPixels < LOD_PIXEL_ERROR * LOD_HYSTERESIS)
+                            lod++;
+                    }
+                }
+
+                changed |= lod != mesh.lod;
+                mesh.lod = lod;
+            }
+            return changed;
+        }
+
+        //The meshes that can't be culled get a sphere that is never culled, centered where they are sorted
+        void updateCullSphere(unsigned id) {
+            auto& mesh = this->meshes.at(id);
+            auto model = getModelMatrix(id, mesh);
+            mesh.placed = model.has_value();
+            if(!model) {
+                this->culler.set(mesh.cullSlot, { glm::vec3(0.0f), FrustumCuller::NEVER_CULLED });
+                return;
+            }
+
+            //The bounds only cover the first instance
+            const auto& bounds = mesh.vertexArray->getBounds();
+            if(!bounds || mesh.instanceCount > 1) {
+                this->culler.set(mesh.cullSlot, { glm::vec3((*model)[3]), FrustumCuller::NEVER_CULLED });
+                return;
+            }
+
+            auto sphere = bounds->transform(*model);
+            //The GPU culls the ones in the arena
+            if(this->occlusion && drawnWithArena(mesh))
+                sphere.radius = FrustumCuller::NEVER_CULLED;
+            this->culler.set(mesh.cullSlot, sphere);
+        }
+
+        void buildDrawOrder() {
+            if(this->hasCamera)
+                this->culler.cull(this->cameraProjView, this->cullVisible);
+            else
+                this->cullVisible.assign(this->culler.size(), 1);
+
+            this->drawOrder.clear();
+            for(const auto& [id, mesh]: this->meshes) {
+                if(mesh.vertexArray->getVertexCount() == 0 || mesh.vertexArray->getIndexCount() == 0 || mesh.instanceCount < 1)
+                    continue;
+                if(this->cullVisible[mesh.cullSlot])
+                    pushDrawKey(id, mesh, mesh.placed? this->culler.getCenter(mesh.cullSlot) : this->cameraPos);
+            }
+            std::sort(this->drawOrder.begin(), this->drawOrder.end(), [](const DrawKey& a, const DrawKey& b) { return a.key < b.key; });
+        }
+
+        //INDIRECT PATH
+        using DrawData = TDrawData<PushConstants_t>;
+        struct OwnDraw { unsigned id; uint32_t submesh, drawIndex; };
+        struct PendingImageWrite { uint32_t binding, arrayElement; VkDescriptorType type; VkDescriptorImageInfo imageInfo; };
+        struct IndirectFrame {
+            VkBuffer drawBuffer = VK_NULL_HANDLE, commandBuffer = VK_NULL_HANDLE;
+            VmaAllocation drawAlloc = VK_NULL_HANDLE, commandAlloc = VK_NULL_HANDLE;
+            VmaAllocationInfo drawInfo{}, commandInfo{};
+            size_t capacity = 0; //In draws
+
+            //OCCLUSION CULLING, the culled buffer has the visible commands of each phase one after the other
+            VkBuffer boundsBuffer = VK_NULL_HANDLE, culledBuffer = VK_NULL_HANDLE, countBuffer = VK_NULL_HANDLE, rejectedBuffer = VK_NULL_HANDLE;
+            VmaAllocation boundsAlloc = VK_NULL_HANDLE, culledAlloc = VK_NULL_HANDLE, countAlloc = VK_NULL_HANDLE, rejectedAlloc = VK_NULL_HANDLE;
+            VmaAllocationInfo boundsInfo{};
+            VkDescriptorSet cullSet = VK_NULL_HANDLE;
+            bool culled = false; //The first phase was recorded this frame
+
+            //MESHLET CULLING, their draws follow the arena draws. The commands are copied to a buffer where the GPU adds the visible indices
+            uint32_t meshletDrawCount = 0, meshletCount = 0;
+            VkBuffer meshletCommandBuffer = VK_NULL_HANDLE, meshletBuffer = VK_NULL_HANDLE, meshletIndexBuffer = VK_NULL_HANDLE;
+            VmaAllocation meshletCommandAlloc = VK_NULL_HANDLE, meshletAlloc = VK_NULL_HANDLE, meshletIndexAlloc = VK_NULL_HANDLE;
+            VmaAllocationInfo meshletInfo{};
+            size_t meshletCapacity = 0, meshletIndexCapacity = 0; //In meshlets and indices
+            VkDescriptorSet meshletSet = VK_NULL_HANDLE;
+            bool meshletsCulled = false;
+            
+            uint32_t arenaDrawCount = 0; //The first draws are the meshes in the arena, drawn with one call
+            uint64_t arenaGeneration = 0; //The offsets of the commands are stale after a compaction
+            std::vector<OwnDraw> ownDraws; //The submeshes of the meshes with their own buffers
+            bool dirty = true;
+            
+            VkDescriptorSet drawSet = VK_NULL_HANDLE;
+            std::vector<PendingImageWrite> pendingImageWrites;
+        };
+
+        bool indirect = false, occlusion = false, meshletCulling = false, bindless = false;
+        std::array<IndirectFrame, MAX_FRAMES_IN_FLIGHT> indirectFrames;
+        DescriptorSetLayout drawSetLayout;
+        VkDescriptorPool sharedDescriptorPool = VK_NULL_HANDLE, drawDescriptorPool = VK_NULL_HANDLE, cullDescriptorPool = VK_NULL_HANDLE;
+        VkDescriptorPool meshletDescriptorPool = VK_NULL_HANDLE;
+        std::vector<MeshletRecord> meshletRecords; //Kept between writes
+        std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> sharedDescriptorSets;
+
+        //Set 0, the draw data of the indirect path and the bindless table after them
+        void bindSharedSets(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+            std::array<VkDescriptorSet, 3> sets;
+            uint32_t setCount = 0;
+            sets[setCount++] = this->sharedDescriptorSets[currentFrame];
+            if(this->indirect)
+                sets[setCount++] = this->indirectFrames[currentFrame].drawSet;
+            if(this->bindless)
+                sets[setCount++] = vk->bindlessTable->getSet();
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, setCount, sets.data(), 0, nullptr);
+        }
+
+        void markDrawsDirty() {
+            for(auto& frame: this->indirectFrames)
+                frame.dirty = true;
+        }
+
+        bool isStale(const IndirectFrame& frame) const {
+            return frame.dirty || (vk->geometryArena && frame.arenaGeneration != vk->geometryArena->getGeneration());
+        }
+
+        void destroyDrawBuffers(IndirectFrame& frame) {
+            if(frame.drawBuffer)
+                vmaDestroyBuffer(vk->allocator, frame.drawBuffer, frame.drawAlloc);
+            if(frame.commandBuffer)
+                vmaDestroyBuffer(vk->allocator, frame.commandBuffer, frame.commandAlloc);
+            if(frame.boundsBuffer) {
+                vmaDestroyBuffer(vk->allocator, frame.boundsBuffer, frame.boundsAlloc);
+                vmaDestroyBuffer(vk->allocator, frame.culledBuffer, frame.culledAlloc);
+                vmaDestroyBuffer(vk->allocator, frame.countBuffer, frame.countAlloc);
+                vmaDestroyBuffer(vk->allocator, frame.rejectedBuffer, frame.rejectedAlloc);
+            }
+            if(frame.meshletCommandBuffer)
+                vmaDestroyBuffer(vk->allocator, frame.meshletCommandBuffer, frame.meshletCommandAlloc);
+            frame.drawBuffer = frame.commandBuffer = frame.boundsBuffer = frame.meshletCommandBuffer = VK_NULL_HANDLE;
+        }
+
+        void destroyMeshletBuffers(IndirectFrame& frame) {
+            if(frame.meshletBuffer)
+                vmaDestroyBuffer(vk->allocator, frame.meshletBuffer, frame.meshletAlloc);
+            if(frame.meshletIndexBuffer)
+                vmaDestroyBuffer(vk->allocator, frame.meshletIndexBuffer, frame.meshletIndexAlloc);
+            frame.meshletBuffer = frame.meshletIndexBuffer = VK_NULL_HANDLE;
+        }
+
+        //The buffers of this frame aren't in use, its fence was waited before recording
+        void reserveDraws(IndirectFrame& frame, size_t drawCount) {
+            if(drawCount <= frame.capacity)
+                return;
+
+            destroyDrawBuffers(frame);
+            frame.capacity = std::bit_ceil(drawCount);
+
+            VmaAllocationCreateInfo allocInfo{};
+            allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+            allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = sizeof(DrawData) * frame.capacity;
+            bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+            if(vmaCreateBuffer(vk->allocator, &bufferInfo, &allocInfo, &frame.drawBuffer, &frame.drawAlloc, &frame.drawInfo) != VK_SUCCESS)
+                throw std::runtime_error("failed to create draw data buffer!");
+
+            bufferInfo.size = sizeof(VkDrawIndexedIndirectCommand) * frame.capacity;
+            bufferInfo.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            if(vmaCreateBuffer(vk->allocator, &bufferInfo, &allocInfo, &frame.commandBuffer, &frame.commandAlloc, &frame.commandInfo) != VK_SUCCESS)
+                throw std::runtime_error("failed to create indirect command buffer!");
+
+            if(this->meshletCulling) {
+                VmaAllocationCreateInfo deviceAllocInfo{};
+                deviceAllocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+                bufferInfo.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+                if(vmaCreateBuffer(vk->allocator, &bufferInfo, &deviceAllocInfo, &frame.meshletCommandBuffer, &frame.meshletCommandAlloc, nullptr) != VK_SUCCESS)
+                    throw std::runtime_error("failed to create meshlet command buffer!");
+            }
+
+            if(this->occlusion)
+                createCullBuffers(frame);
+
+            VkDescriptorBufferInfo drawBufferInfo{};
+            drawBufferInfo.buffer = frame.drawBuffer;
+            drawBufferInfo.offset = 0;
+            drawBufferInfo.range = VK_WHOLE_SIZE;
+
+            VkWriteDescriptorSet descriptorWrite{};
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet = frame.drawSet;
+            descriptorWrite.dstBinding = 0;
+            descriptorWrite.dstArrayElement = 0;
+            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrite.descriptorCount = 1;
+            descriptorWrite.pBufferInfo = &drawBufferInfo;
+            vkUpdateDescriptorSets(vk->device, 1, &descriptorWrite, 0, nullptr);
+        }
+
+        void createCullBuffers(IndirectFrame& frame) {
+            VmaAllocationCreateInfo hostAllocInfo{};
+            hostAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+            hostAllocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = sizeof(glm::vec4) * frame.capacity;
+            bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+            if(vmaCreateBuffer(vk->allocator, &bufferInfo, &hostAllocInfo, &frame.boundsBuffer, &frame.boundsAlloc, &frame.boundsInfo) != VK_SUCCESS)
+                throw std::runtime_error("failed to create bounds buffer!");
+
+            //Only the GPU touches these
+            VmaAllocationCreateInfo deviceAllocInfo{};
+            deviceAllocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+            bufferInfo.size = 2 * sizeof(VkDrawIndexedIndirectCommand) * frame.capacity;
+            bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+            if(vmaCreateBuffer(vk->allocator, &bufferInfo, &deviceAllocInfo, &frame.culledBuffer, &frame.culledAlloc, nullptr) != VK_SUCCESS)
+                throw std::runtime_error("failed to create culled command buffer!");
+
+            bufferInfo.size = 2 * sizeof(uint32_t);
+            bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            if(vmaCreateBuffer(vk->allocator, &bufferInfo, &deviceAllocInfo, &frame.countBuffer, &frame.countAlloc, nullptr) != VK_SUCCESS)
+                throw std::runtime_error("failed to create draw count buffer!");
+
+            bufferInfo.size = sizeof(uint32_t) * frame.capacity;
+            bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+            if(vmaCreateBuffer(vk->allocator, &bufferInfo, &deviceAllocInfo, &frame.rejectedBuffer, &frame.rejectedAlloc, nullptr) != VK_SUCCESS)
+                throw std::runtime_error("failed to create rejected draws buffer!");
+
+            std::array<VkBuffer, 5> buffers = { frame.boundsBuffer, frame.commandBuffer, frame.culledBuffer, frame.countBuffer, frame.rejectedBuffer };
+            std::array<VkDescriptorBufferInfo, 5> bufferInfos;
+            std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
+            for(size_t i=0; i<buffers.size(); ++i) {
+                bufferInfos[i].buffer = buffers[i];
+                bufferInfos[i].offset = 0;
+                bufferInfos[i].range = VK_WHOLE_SIZE;
+
+                descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[i].dstSet = frame.cullSet;
+                descriptorWrites[i].dstBinding = static_cast<uint32_t>(i);
+                descriptorWrites[i].dstArrayElement = 0;
+                descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[i].descriptorCount = 1;
+                descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+            }
+            vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        }
+
+        void reserveMeshlets(IndirectFrame& frame, size_t meshletCount, size_t indexCount) {
+            if(meshletCount <= frame.meshletCapacity && indexCount <= frame.meshletIndexCapacity)
+                return;
+
+            destroyMeshletBuffers(frame);
+            frame.meshletCapacity = std::bit_ceil(std::max(meshletCount, frame.meshletCapacity));
+            frame.meshletIndexCapacity = std::bit_ceil(std::max(indexCount, frame.meshletIndexCapacity));
+
+            VmaAllocationCreateInfo allocInfo{};
+            allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+            allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = sizeof(MeshletRecord) * frame.meshletCapacity;
+            bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+            if(vmaCreateBuffer(vk->allocator, &bufferInfo, &allocInfo, &frame.meshletBuffer, &frame.meshletAlloc, &frame.meshletInfo) != VK_SUCCESS)
+                throw std::runtime_error("failed to create meshlet buffer!");
+
+            //Written by the culling, it has room for every triangle
+            VmaAllocationCreateInfo deviceAllocInfo{};
+            deviceAllocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+            bufferInfo.size = sizeof(uint32_t) * frame.meshletIndexCapacity;
+            bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+            if(vmaCreateBuffer(vk->allocator, &bufferInfo, &deviceAllocInfo, &frame.meshletIndexBuffer, &frame.meshletIndexAlloc, nullptr) != VK_SUCCESS)
+                throw std::runtime_error("failed to create meshlet index buffer!");
+        }
+
+        //Written on every change, the index buffer of the arena is another one after a compaction or when it grows
+        void writeMeshletSet(IndirectFrame& frame) {
+            std::array<VkBuffer, 4> buffers = { frame.meshletBuffer, vk->geometryArena->getIndexBuffer(), frame.meshletCommandBuffer, frame.meshletIndexBuffer };
+            std::array<VkDescriptorBufferInfo, 4> bufferInfos;
+            std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+            for(size_t i=0; i<buffers.size(); ++i) {
+                bufferInfos[i].buffer = buffers[i];
+                bufferInfos[i].offset = 0;
+                bufferInfos[i].range = VK_WHOLE_SIZE;
+
+                descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[i].dstSet = frame.meshletSet;
+                descriptorWrites[i].dstBinding = static_cast<uint32_t>(i);
+                descriptorWrites[i].dstArrayElement = 0;
+                descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[i].descriptorCount = 1;
+                descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+            }
+            vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        }
+
+        //The meshlets in world space, so the shader doesn't need the model matrices. Each submesh has its command and its meshlets are in order
+        void addMeshletRecords(unsigned id, const MeshData& mesh, uint32_t firstCommand) {
+            glm::mat4 model = *getModelMatrix(id, mesh);
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+            uint32_t firstIndex = mesh.vertexArray->getFirstIndex();
+
+            uint32_t submesh = 0;
+            for(const auto& meshlet: mesh.vertexArray->getMeshlets()) {
+                while(submesh + 1 < mesh.vertexArray->getSubmeshCount() && meshlet.firstIndex >= mesh.vertexArray->getSubmesh(0, submesh + 1).firstIndex)
+                    submesh++;
+
+                auto sphere = meshlet.bounds.transform(model);
+                glm::vec3 axis = meshlet.coneCutoff < 1.0f? glm::normalize(normalMatrix * meshlet.coneAxis) : glm::vec3(0.0f);
+
+                MeshletRecord record{};
+                record.sphere = glm::vec4(sphere.center, sphere.radius);
+                record.cone = glm::vec4(axis, meshlet.coneCutoff);
+                record.firstIndex = firstIndex + meshlet.firstIndex;
+                record.indexCount = meshlet.indexCount;
+                record.command = firstCommand + submesh;
+                this->meshletRecords.push_back(record);
+            }
+        }
+
+        //The commands of this frame start with no indices and the culling adds the visible ones
+        void recordMeshletCulling(VkCommandBuffer commandBuffer, IndirectFrame& frame) {
+            frame.meshletsCulled = false;
+            if(frame.meshletDrawCount == 0)
+                return;
+
+            VkBufferCopy region{};
+            region.srcOffset = sizeof(VkDrawIndexedIndirectCommand) * frame.arenaDrawCount;
+            region.dstOffset = 0;
+            region.size = sizeof(VkDrawIndexedIndirectCommand) * frame.meshletDrawCount;
+            vkCmdCopyBuffer(commandBuffer, frame.commandBuffer, frame.meshletCommandBuffer, 1, &region);
+            memoryBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+            );
+
+            vk->meshletCuller->cull(commandBuffer, frame.meshletSet, frame.meshletCount, this->cameraProjView, this->cameraPos, this->flags & BACK_CULLING_ENABLED);
+            frame.meshletsCulled = true;
+        }
+
+        //Only done when a mesh changes, so a frame without changes costs the same whatever the mesh count
+        void writeDraws(IndirectFrame& frame) {
+            buildDrawOrder();
+            size_t drawCount = 0;
+            for(auto [key, id]: this->drawOrder)
+                drawCount += this->meshes.at(id).vertexArray->getSubmeshCount();
+            reserveDraws(frame, drawCount);
+
+            auto draws = static_cast<DrawData*>(frame.drawInfo.pMappedData);
+            auto commands = static_cast<VkDrawIndexedIndirectCommand*>(frame.commandInfo.pMappedData);
+            uint32_t drawIndex = 0;
+            auto writeDrawData = [&](const MeshData& mesh, uint32_t material) {
+                DrawData data{};
+                if constexpr (fly::not_void<PushConstants_t>)
+                    data.data = mesh.pushConstant;
+                data.textureIndex = mesh.textureIndices[material];
+                memcpy(&draws[drawIndex], &data, sizeof(DrawData));
+            };
+
+            frame.arenaDrawCount = 0;
+            frame.meshletDrawCount = 0;
+            frame.ownDraws.clear();
+            this->meshletRecords.clear();
+            uint32_t meshletIndexCount = 0;
+            for(auto [key, id]: this->drawOrder) {
+                const auto& mesh = this->meshes.at(id);
+                bool meshlets = usesMeshlets(id, mesh);
+                if(meshlets)
+                    addMeshletRecords(id, mesh, frame.meshletDrawCount);
+
+                for(uint32_t i=0; i<mesh.vertexArray->getSubmeshCount(); ++i) {
+                    auto submesh = mesh.vertexArray->getSubmesh(mesh.lod, i);
+                    writeDrawData(mesh, submesh.material);
+
+                    if(!drawnWithArena(mesh)) {
+                        frame.ownDraws.push_back({ id, i, drawIndex++ });
+                        continue;
+                    }
+
+                    //The first instance is the draw index, the shaders find their data with gl_BaseInstance
+                    VkDrawIndexedIndirectCommand command{};
+                    command.indexCount = submesh.indexCount;
+                    command.instanceCount = static_cast<uint32_t>(mesh.instanceCount);
+                    command.firstIndex = mesh.vertexArray->getFirstIndex() + submesh.firstIndex;
+                    command.vertexOffset = mesh.vertexArray->getVertexOffset();
+                    command.firstInstance = drawIndex;
+
+                    //They are sorted after the other arena draws, so their commands are the next ones
+                    if(meshlets) {
+                        command.indexCount = 0;
+                        command.firstIndex = meshletIndexCount;
+                        meshletIndexCount += submesh.indexCount;
+                        frame.meshletDrawCount++;
+                    } else {
+                        if(this->occlusion)
+                            writeBounds(frame, id, mesh, drawIndex);
+                        frame.arenaDrawCount++;
+                    }
+                    memcpy(&commands[drawIndex], &command, sizeof(command));
+                    drawIndex++;
+                }
+            }
+
+            frame.meshletCount = static_cast<uint32_t>(this->meshletRecords.size());
+            if(frame.meshletCount > 0) {
+                reserveMeshlets(frame, this->meshletRecords.size(), meshletIndexCount);
+                memcpy(frame.meshletInfo.pMappedData, this->meshletRecords.data(), sizeof(MeshletRecord) * this->meshletRecords.size());
+                writeMeshletSet(frame);
+            }
+            frame.dirty = false;
+            if(vk->geometryArena)
+                frame.arenaGeneration = vk->geometryArena->getGeneration();
+        }
+
+        //The arena draws are the first ones, so their bounds have the same index as their command
+        void writeBounds(IndirectFrame& frame, unsigned id, const MeshData& mesh, uint32_t drawIndex) {
+            glm::vec4 sphere(0.0f, 0.0f, 0.0f, -1.0f); //Never culled
+            auto model = getModelMatrix(id, mesh);
+            const auto& bounds = mesh.vertexArray->getBounds();
+            if(this->hasCamera && model && bounds && mesh.instanceCount == 1) {
+                auto world = bounds->transform(*model);
+                sphere = glm::vec4(world.center, world.radius);
+            }
+            memcpy(static_cast<glm::vec4*>(frame.boundsInfo.pMappedData) + drawIndex, &sphere, sizeof(sphere));
+        }
+
+        void recordIndirect(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+            auto& frame = this->indirectFrames[currentFrame];
+            if(isStale(frame))
+                writeDraws(frame);
+
+            if(!frame.pendingImageWrites.empty()) {
+                std::vector<VkWriteDescriptorSet> descriptorWrites(frame.pendingImageWrites.size());
+                for(size_t i=0; i<descriptorWrites.size(); ++i) {
+                    const auto& pending = frame.pendingImageWrites[i];
+                    descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                    descriptorWrites[i].dstSet = this->sharedDescriptorSets[currentFrame];
+                    descriptorWrites[i].dstBinding = pending.binding;
+                    descriptorWrites[i].dstArrayElement = pending.arrayElement;
+                    descriptorWrites[i].descriptorType = pending.type;
+                    descriptorWrites[i].descriptorCount = 1;
+                    descriptorWrites[i].pImageInfo = &pending.imageInfo;
+                }
+                vkUpdateDescriptorSets(vk->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+                frame.pendingImageWrites.clear();
+            }
+
+            if(frame.arenaDrawCount == 0 && frame.meshletDrawCount == 0 && frame.ownDraws.empty())
+                return;
+
+            bindSharedSets(commandBuffer, currentFrame);
+
+            VkDeviceSize offsets[] = {0};
+            if(frame.arenaDrawCount > 0) {
+                VkBuffer vBuffer = vk->geometryArena->getVertexBuffer();
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vBuffer, offsets);
+                vkCmdBindIndexBuffer(commandBuffer, vk->geometryArena->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+                //The visible ones of the first phase, their count is written by the GPU
+                if(frame.culled)
+                    vkCmdDrawIndexedIndirectCount(commandBuffer, frame.culledBuffer, 0, frame.countBuffer, 0, frame.arenaDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+                else
+                    vkCmdDrawIndexedIndirect(commandBuffer, frame.commandBuffer, 0, frame.arenaDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+            }
+
+            //The triangles of the visible meshlets, from the compacted index buffer
+            if(frame.meshletsCulled) {
+                VkBuffer vBuffer = vk->geometryArena->getVertexBuffer();
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vBuffer, offsets);
+                vkCmdBindIndexBuffer(commandBuffer, frame.meshletIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+                vkCmdDrawIndexedIndirect(commandBuffer, frame.meshletCommandBuffer, 0, frame.meshletDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+                frame.meshletsCulled = false;
+            }
+
+            //The meshes that didn't fit in the arena or in the shared set are drawn one by one, their submeshes one after the other
+            VkBuffer lastVertexBuffer = VK_NULL_HANDLE;
+            VkDescriptorSet lastSet = this->sharedDescriptorSets[currentFrame];
+            for(auto [id, index, drawIndex]: frame.ownDraws) {
+                const auto& mesh = this->meshes.at(id);
+                VkBuffer vBuffer = mesh.vertexArray->getVertexBuffer();
+                if(vBuffer != lastVertexBuffer) {
+                    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vBuffer, offsets);
+                    vkCmdBindIndexBuffer(commandBuffer, mesh.vertexArray->getIndexBuffer(), 0, mesh.vertexArray->getIndexType());
+                    lastVertexBuffer = vBuffer;
+                }
+
+                //Set 1 with the draw data stays bound, the layouts of set 0 are the same
+                VkDescriptorSet set = hasOwnDescriptorSets(mesh)? mesh.descriptorSets[currentFrame] : this->sharedDescriptorSets[currentFrame];
+                if(set != lastSet) {
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, 1, &set, 0, nullptr);
+                    lastSet = set;
+                }
+
+                auto submesh = mesh.vertexArray->getSubmesh(mesh.lod, index);
+                vkCmdDrawIndexed(commandBuffer, submesh.indexCount, mesh.instanceCount, mesh.vertexArray->getFirstIndex() + submesh.firstIndex, mesh.vertexArray->getVertexOffset(), drawIndex);
+            }
+        }
     
     private:
 
@@ -202,8 +1123,10 @@ namespace fly {
             std::vector<char> fragShaderCode,
 
             VkRenderPass renderPass,
-            VkDescriptorSetLayout descriptorSetLayout,
-            uint32_t flags
+            const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts,
+            uint32_t flags,
+            bool usePushConstants,
+            bool bindless
         ) {
             VkShaderModule vertShaderModule = createShaderModule(vk->device, vertShaderCode);
             VkShaderModule fragShaderModule = createShaderModule(vk->device, fragShaderCode);
@@ -345,20 +1268,27 @@ namespace fly {
         
             VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
             pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-            pipelineLayoutInfo.setLayoutCount = 1;
-            pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+            pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+            pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
             pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
             pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
 
 
+            //The bindless draws push the texture index after the data
+            VkPushConstantRange pushConstant{};
+            if(usePushConstants && bindless) {
+                pushConstant.size = sizeof(DrawData);
+                pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+            }
             if constexpr (fly::not_void<PushConstants_t>) {
-                VkPushConstantRange pushConstant;
-                pushConstant.offset = 0;
-	            pushConstant.size = sizeof(PushConstants_t);
-	            pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
+                if(usePushConstants && !bindless) {
+                    pushConstant.size = sizeof(PushConstants_t);
+                    pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+                }
+            }
+            if(pushConstant.size > 0) {
                 pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
-	            pipelineLayoutInfo.pushConstantRangeCount = 1;
+                pipelineLayoutInfo.pushConstantRangeCount = 1;
             }
 
 
@@ -390,7 +1320,7 @@ namespace fly {
             pipelineInfo.basePipelineIndex = -1; // Optional
         
             VkPipeline graphicsPipeline;
-            if(vkCreateGraphicsPipelines(vk->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+            if(vkCreateGraphicsPipelines(vk->device, vk->pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
                 throw std::runtime_error("failed to create graphics pipeline!");
             }
         
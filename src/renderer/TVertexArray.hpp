@@ -2,10 +2,24 @@
 
 #include "vulkan/VulkanTypes.h"
 #include "vulkan/VulkanHelpers.hpp"
+#include "GeometryArena.hpp"
+#include "StreamBuffer.hpp"
+#include "FrustumCuller.hpp"
+#include "Meshlets.hpp"
+#include "MeshLods.hpp"
+#include "MeshOptimizer.hpp"
+#include "VertexFormat.hpp"
 
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <concepts>
+#include <limits>
+#include <memory>
 #include <vector>
 #include <bit>
 #include <optional>
+#include <span>
 
 
 namespace fly {
@@ -23,7 +37,7 @@ namespace fly {
         BufferWithStaging& buffer, 
         std::shared_ptr<VulkanInstance> vk, 
         VkCommandPool commandPool, 
-        const std::vector<T>& data
+        std::span<const T> data
     ) {
         FLY_ASSERT(!data.empty(), "There cannot be zero items");
         
@@ -47,9 +61,8 @@ namespace fly {
         BufferWithStaging& buffer, 
         std::shared_ptr<VulkanInstance> vk, 
         VkCommandPool commandPool, 
-        const std::vector<T>& data, 
-        VkBufferUsageFlags mainUsage, 
-        bool constMeshData
+        std::span<const T> data, 
+        VkBufferUsageFlags mainUsage
     ) {            
         buffer.capacity = std::bit_ceil(data.size());
 
@@ -76,86 +89,324 @@ namespace fly {
             vmaCreateBuffer(vk->allocator, &bufferInfo, &allocCreateInfo, &buffer.buffer, &buffer.alloc, nullptr);
         }
         
-        copyData(buffer, vk, commandPool, data);
+        copyData<T>(buffer, vk, commandPool, data);
 
-        if(constMeshData) {
-            vmaDestroyBuffer(vk->allocator, buffer.stagingBuffer, buffer.stagingAlloc);
-            buffer.stagingBuffer = nullptr;
-            buffer.stagingAlloc = nullptr;
-            buffer.stagingInfo = {};
-        }
+        vmaDestroyBuffer(vk->allocator, buffer.stagingBuffer, buffer.stagingAlloc);
+        buffer.stagingBuffer = nullptr;
+        buffer.stagingAlloc = nullptr;
+        buffer.stagingInfo = {};
     }   
 
 
-    template<typename T>
-    [[nodiscard]] std::optional<BufferWithStaging> updateBuffer(
-        BufferWithStaging& buffer, 
-        std::shared_ptr<VulkanInstance> vk, 
-        VkCommandPool commandPool, 
-        VkBufferUsageFlags mainUsage, 
-        const std::vector<T>& data
-    ) {
-        buffer.count = data.size();
-        if(buffer.count == 0) return std::nullopt;
+    //The positions in model space of the vertices that have them, packed or not
+    template<typename Vertex_t>
+    std::vector<glm::vec3> decodePositions(std::span<const Vertex_t> vertices, const VertexQuantization& quantization) {
+        std::vector<glm::vec3> positions;
+        if constexpr (requires(const Vertex_t& v) { requires std::same_as<decltype(v.pos), glm::vec3>; }) {
+            positions.resize(vertices.size());
+            std::transform(vertices.begin(), vertices.end(), positions.begin(), [](const Vertex_t& v) { return v.pos; });
+        } else if constexpr (requires(const Vertex_t& v) { { v.decodePosition(quantization) } -> std::same_as<glm::vec3>; }) {
+            positions.resize(vertices.size());
+            std::transform(vertices.begin(), vertices.end(), positions.begin(), [&](const Vertex_t& v) { return v.decodePosition(quantization); });
+        }
+        return positions;
+    }
+
+    template<typename Vertex_t>
+    std::vector<glm::vec3> decodePositions(const std::vector<Vertex_t>& vertices, const VertexQuantization& quantization) {
+        return decodePositions(std::span<const Vertex_t>(vertices), quantization);
+    }
 
-        if(buffer.count > buffer.capacity) { //New buffer creation                
-            auto tmp = buffer;
-            createBuffer(buffer, vk, commandPool, data, mainUsage, false);
-            return tmp;
+    //Only the vertices with a 3D position can be culled
+    inline std::optional<BoundingSphere> computeBounds(const std::vector<glm::vec3>& positions) {
+        if(positions.empty())
+            return std::nullopt;
+
+        glm::vec3 min = positions[0], max = positions[0];
+        for(const auto& p: positions) {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
         }
 
-        copyData(buffer, vk, commandPool, data);
-        return std::nullopt;
+        BoundingSphere sphere{ (min + max) * 0.5f, 0.0f };
+        for(const auto& p: positions)
+            sphere.radius = std::max(sphere.radius, glm::distance(sphere.center, p));
+        return sphere;
     }
 
+    //The first indexCount indices are reordered so each meshlet is contiguous. With submeshes each one has its own meshlets, in the same order
+    inline std::vector<Meshlet> computeMeshlets(const std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices, size_t indexCount, 
+        std::span<const Submesh> submeshes = {}) {
+        if(positions.empty())
+            return {};
+
+        std::vector<Meshlet> meshlets;
+        auto addRange = [&](uint32_t firstIndex, uint32_t count) {
+            std::vector<uint32_t> range(indices.begin() + firstIndex, indices.begin() + firstIndex + count);
+            for(auto meshlet: buildMeshlets(positions, range)) {
+                meshlet.firstIndex += firstIndex;
+                meshlets.push_back(meshlet);
+            }
+            std::copy(range.begin(), range.end(), indices.begin() + firstIndex);
+        };
+
+        if(submeshes.empty())
+            addRange(0, static_cast<uint32_t>(indexCount));
+        for(const auto& submesh: submeshes)
+            addRange(submesh.firstIndex, submesh.indexCount);
+        return meshlets;
+    }
 
+    //The indices of the simplified levels are appended after the full mesh, and reordered for the vertex cache like it
+    //With submeshes the ranges of every level are appended to them, and the triangles don't leave their range
+    inline std::vector<MeshLod> computeLods(const std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices, std::vector<Submesh>& submeshes) {
+        if(positions.empty())
+            return {};
+
+        size_t submeshCount = submeshes.size();
+        auto lods = buildLods(positions, indices, submeshes);
+        for(size_t i=1; i<lods.size(); ++i) {
+            if(submeshCount == 0)
+                optimizeVertexCache(indices.data() + lods[i].firstIndex, lods[i].indexCount, positions);
+            for(size_t j=i*submeshCount; j<(i + 1)*submeshCount; ++j)
+                optimizeVertexCache(indices.data() + submeshes[j].firstIndex, submeshes[j].indexCount, positions);
+        }
+        return lods;
+    }
+
+    inline std::vector<MeshLod> computeLods(const std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices) {
+        std::vector<Submesh> submeshes;
+        return computeLods(positions, indices, submeshes);
+    }
+
+    //A static mesh with every level and meshlet already built, in the layout it has on the GPU. The mesh cache maps it straight from disk
+    template<typename Vertex_t>
+    struct TMeshGeometry {
+        std::span<const Vertex_t> vertices;
+        std::span<const uint32_t> indices; //Every level, the full one in meshlet order
+        std::span<const MeshLod> lods;
+        std::span<const Meshlet> meshlets;
+        std::span<const Submesh> submeshes; //Empty if the mesh has a single material, else the ones of each level after the other
+        BoundingSphere bounds;
+        VertexQuantization quantization;
+    };
 
     template<typename Vertex_t>
     class TVertexArray {
         using Index_t = uint32_t;
         
         BufferWithStaging vertex, index;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32; //The streamed meshes always use 32 bits, the ones in the arena only without indirect draws
+        VertexQuantization quantization; //Only used by packed vertices
+        std::optional<BoundingSphere> bounds; //In model space
+        std::vector<Meshlet> meshlets; //Only the meshes in the arena have them, they are built from the full level
+        std::vector<MeshLod> lods; //Only static meshes have them
+        std::vector<Submesh> submeshes; //Only static meshes with more than one material have them, the ones of each level after the other
+        std::optional<GeometryArena::Handle> arenaHandle; //Static meshes live in the shared arena when there is room
+        std::unique_ptr<StreamBuffer> vertexStream, indexStream; //Only the streamed meshes have them
         std::shared_ptr<VulkanInstance> vk;
 
 
     public:
-        TVertexArray(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, std::vector<Vertex_t> vertices, std::vector<Index_t> indices, bool constMeshData = true): vk{vk} {
+        //Without constMeshData the mesh is streamed, it can be written every frame and the pipeline records the copies
+        TVertexArray(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, std::vector<Vertex_t> vertices, std::vector<Index_t> indices, 
+            bool constMeshData = true, const VertexQuantization& quantization = {}): quantization{quantization}, vk{vk} {
+            if(!constMeshData) {
+                this->vertexStream = std::make_unique<StreamBuffer>(vk, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+                this->indexStream = std::make_unique<StreamBuffer>(vk, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+                updateVertexBuffer(vertices);
+                updateIndexBuffer(indices);
+                return;
+            }
+
+            auto positions = decodePositions(vertices, quantization);
+            this->lods = computeLods(positions, indices);
+
             this->vertex.count = vertices.size();
             this->index.count = indices.size();
+            this->bounds = computeBounds(positions);
 
-            if(vertices.size() != 0)
-                createBuffer<Vertex_t>(this->vertex, this->vk, commandPool, vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, constMeshData);
-            
-            if(indices.size() != 0)
-                createBuffer<Index_t>(this->index, this->vk, commandPool, indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, constMeshData);
+            if(allocateInArena(commandPool)) {
+                if(vk->meshletCuller)
+                    this->meshlets = computeMeshlets(positions, indices, getLod(0).indexCount);
+                uploadToArena(commandPool, vertices, indices);
+                return;
+            }
+
+            createBuffers(commandPool, vertices, indices);
+        }
+
+        //Nothing is computed, the data is copied as is to the arena or the staging buffers
+        TVertexArray(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, const TMeshGeometry<Vertex_t>& geometry): quantization{geometry.quantization}, vk{vk} {
+            size_t levelCount = std::max<size_t>(geometry.lods.size(), 1);
+            FLY_ASSERT(geometry.submeshes.size() % levelCount == 0, "Every level must have the same submeshes!");
+            this->lods.assign(geometry.lods.begin(), geometry.lods.end());
+            if(geometry.submeshes.size() > levelCount)
+                this->submeshes.assign(geometry.submeshes.begin(), geometry.submeshes.end());
+            this->vertex.count = geometry.vertices.size();
+            this->index.count = geometry.indices.size();
+            if(!geometry.vertices.empty())
+                this->bounds = geometry.bounds;
+
+            if(allocateInArena(commandPool)) {
+                if(vk->meshletCuller)
+                    this->meshlets.assign(geometry.meshlets.begin(), geometry.meshlets.end());
+                uploadToArena(commandPool, geometry.vertices, geometry.indices);
+                return;
+            }
+
+            createBuffers(commandPool, geometry.vertices, geometry.indices);
         }
         
         ~TVertexArray() {
+            if(arenaHandle && vk->geometryArena)
+                vk->geometryArena->free(*this->arenaHandle);
+
             if(vertex.buffer)
                 vmaDestroyBuffer(vk->allocator, this->vertex.buffer, this->vertex.alloc);
             if(index.buffer)
                 vmaDestroyBuffer(vk->allocator, this->index.buffer, this->index.alloc);
-
-            if(vertex.stagingBuffer)
-                vmaDestroyBuffer(vk->allocator, this->vertex.stagingBuffer, this->vertex.stagingAlloc);
-            if(index.stagingBuffer)
-                vmaDestroyBuffer(vk->allocator, this->index.stagingBuffer, this->index.stagingAlloc);
         }
 
         
-        VkBuffer getVertexBuffer() const { return this->vertex.buffer; }
-        VkBuffer getIndexBuffer() const { return this->index.buffer; }
+        VkBuffer getVertexBuffer() const { 
+            if(this->vertexStream)
+                return this->vertexStream->getBuffer();
+            return this->arenaHandle? vk->geometryArena->getVertexBuffer() : this->vertex.buffer; 
+        }
+        VkBuffer getIndexBuffer() const { 
+            if(this->indexStream)
+                return this->indexStream->getBuffer();
+            return this->arenaHandle? vk->geometryArena->getIndexBuffer() : this->index.buffer; 
+        }
+        VkIndexType getIndexType() const { return this->indexType; }
+        const VertexQuantization& getQuantization() const { return this->quantization; }
+        bool isInArena() const { return this->arenaHandle.has_value(); }
+        bool isStreaming() const { return this->vertexStream != nullptr; }
+        //Where the mesh starts in the bound buffers, in indices and vertices. The arena compaction can move it
+        uint32_t getFirstIndex() const { 
+            if(!this->arenaHandle)
+                return 0;
+            auto allocation = vk->geometryArena->get(*this->arenaHandle);
+            return static_cast<uint32_t>(allocation.indexOffset / allocation.indexStride); 
+        }
+        int32_t getVertexOffset() const { 
+            return this->arenaHandle? static_cast<int32_t>(vk->geometryArena->get(*this->arenaHandle).vertexOffset / sizeof(Vertex_t)) : 0; 
+        }
 
-        size_t getIndexCount() const { return this->index.count; }
+        const std::optional<BoundingSphere>& getBounds() const { return this->bounds; }
+        const std::vector<Meshlet>& getMeshlets() const { return this->meshlets; }
+
+        //Level 0 is the full mesh. The meshes without levels only have that one
+        uint32_t getLodCount() const { return std::max<uint32_t>(static_cast<uint32_t>(this->lods.size()), 1); }
+        MeshLod getLod(uint32_t level) const {
+            if(this->lods.empty())
+                return { 0, static_cast<uint32_t>(this->index.count), 0.0f };
+            return this->lods[level];
+        }
+
+        //The ranges drawn at a level, each with its material. The meshes with a single material have the range of the level
+        uint32_t getSubmeshCount() const { return std::max<uint32_t>(static_cast<uint32_t>(this->submeshes.size()) / getLodCount(), 1); }
+        Submesh getSubmesh(uint32_t level, uint32_t index) const {
+            if(this->submeshes.empty()) {
+                auto lod = getLod(level);
+                return { lod.firstIndex, lod.indexCount, 0 };
+            }
+            return this->submeshes[level * getSubmeshCount() + index];
+        }
+        uint32_t getMaterialCount() const {
+            uint32_t count = 1;
+            for(const auto& submesh: this->submeshes)
+                count = std::max(count, submesh.material + 1);
+            return count;
+        }
+
+        size_t getIndexCount() const { return this->index.count; } //Of every level
         size_t getVertexCount() const { return this->vertex.count; }
 
         
-        [[nodiscard]] std::optional<BufferWithStaging> updateVertexBuffer(VkCommandPool commandPool, std::vector<Vertex_t> vertices) {
-            return updateBuffer<Vertex_t>(this->vertex, this->vk, commandPool, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertices);
+        //STREAMING, the writes are only kept on the CPU until the pipeline records the upload of the frame
+        void updateVertexBuffer(std::span<const Vertex_t> vertices) {
+            FLY_ASSERT(isStreaming(), "Only streamed meshes can be updated!");
+            this->vertexStream->resize(sizeof(Vertex_t) * vertices.size());
+            this->vertexStream->write(0, std::as_bytes(vertices));
+            this->vertex.count = vertices.size();
+            this->bounds = computeBounds(decodePositions(vertices, this->quantization));
+        }
+
+        void updateIndexBuffer(std::span<const Index_t> indices) {
+            FLY_ASSERT(isStreaming(), "Only streamed meshes can be updated!");
+            this->indexStream->resize(sizeof(Index_t) * indices.size());
+            this->indexStream->write(0, std::as_bytes(indices));
+            this->index.count = indices.size();
         }
 
-        [[nodiscard]] std::optional<BufferWithStaging> updateIndexBuffer(VkCommandPool commandPool, std::vector<Index_t> indices) {
-            return updateBuffer<Index_t>(this->index, this->vk, commandPool, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indices);
+        //Only the vertices from first on are written, the mesh grows if they don't fit. The bounds only grow
+        void writeVertices(size_t first, std::span<const Vertex_t> vertices) {
+            FLY_ASSERT(isStreaming(), "Only streamed meshes can be updated!");
+            this->vertexStream->write(sizeof(Vertex_t) * first, std::as_bytes(vertices));
+            this->vertex.count = std::max(this->vertex.count, first + vertices.size());
+            
+            auto positions = decodePositions(vertices, this->quantization);
+            if(!this->bounds) {
+                this->bounds = computeBounds(positions);
+                return;
+            }
+            for(const auto& p: positions)
+                this->bounds->radius = std::max(this->bounds->radius, glm::distance(this->bounds->center, p));
+        }
+
+        void writeIndices(size_t first, std::span<const Index_t> indices) {
+            FLY_ASSERT(isStreaming(), "Only streamed meshes can be updated!");
+            this->indexStream->write(sizeof(Index_t) * first, std::as_bytes(indices));
+            this->index.count = std::max(this->index.count, first + indices.size());
+        }
+
+        bool hasPendingUpload() const { return isStreaming() && (this->vertexStream->isDirty() || this->indexStream->isDirty()); }
+
+        //Outside of a render pass, once per frame even if nothing changed so the outgrown buffers are destroyed
+        void recordUpload(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+            this->vertexStream->recordUpload(commandBuffer, currentFrame);
+            this->indexStream->recordUpload(commandBuffer, currentFrame);
+        }
+
+
+    private:
+        //Static meshes live in the shared arena when there is room. Without indirect draws every mesh binds the index buffer
+        //with its own type, so they can use 16 bits there too
+        bool allocateInArena(VkCommandPool commandPool) {
+            if(!vk->geometryArena || this->vertex.count == 0 || this->index.count == 0)
+                return false;
+
+            bool shortIndices = !vk->indirectDrawSupported && this->vertex.count <= std::numeric_limits<uint16_t>::max() + 1;
+            VkDeviceSize indexStride = shortIndices? sizeof(uint16_t) : sizeof(Index_t);
+            this->arenaHandle = vk->geometryArena->allocate(commandPool, sizeof(Vertex_t) * this->vertex.count, sizeof(Vertex_t), indexStride * this->index.count, indexStride);
+            if(this->arenaHandle && shortIndices)
+                this->indexType = VK_INDEX_TYPE_UINT16;
+            return this->arenaHandle.has_value();
+        }
+
+        void uploadToArena(VkCommandPool commandPool, std::span<const Vertex_t> vertices, std::span<const Index_t> indices) {
+            if(this->indexType == VK_INDEX_TYPE_UINT16) {
+                std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+                vk->geometryArena->upload(commandPool, *this->arenaHandle, vertices.data(), shortIndices.data());
+                return;
+            }
+            vk->geometryArena->upload(commandPool, *this->arenaHandle, vertices.data(), indices.data());
+        }
+
+        void createBuffers(VkCommandPool commandPool, std::span<const Vertex_t> vertices, std::span<const Index_t> indices) {
+            if(vertices.size() != 0)
+                createBuffer<Vertex_t>(this->vertex, this->vk, commandPool, vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+            
+            //Half the index memory when every vertex can be addressed with 16 bits
+            if(!indices.empty() && vertices.size() <= std::numeric_limits<uint16_t>::max() + 1) {
+                std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+                createBuffer<uint16_t>(this->index, this->vk, commandPool, shortIndices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+                this->indexType = VK_INDEX_TYPE_UINT16;
+            } else if(indices.size() != 0) {
+                createBuffer<Index_t>(this->index, this->vk, commandPool, indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+            }
         }
 
     };
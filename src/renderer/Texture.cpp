@@ -12,6 +12,7 @@
 #include <stb/stb_image.h>
 
 #include "vulkan/VulkanHelpers.hpp"
+#include "BindlessTable.hpp"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -83,6 +84,29 @@ namespace fly {
         stbi_image_free(pixels);
     }
 
+    Texture::Texture(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, std::span<const std::byte> encoded, STB_Format stbFormat, VkFormat format):
+        format{format}, vk{vk}, cubemap{false}
+    {
+        int texWidth, texHeight, texChannels;
+        stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(encoded.data()), static_cast<int>(encoded.size()), 
+            &texWidth, &texHeight, &texChannels, static_cast<int>(stbFormat));
+        if (!pixels) {
+            throw std::runtime_error("failed to load texture image!");
+        }
+
+        this->width = texWidth; 
+        this->height = texHeight;
+        VkDeviceSize imageSize;
+        if(stbFormat == STB_Format::STBI_rgb_alpha)
+            imageSize = this->width * this->height * 4;
+        else
+            imageSize = this->width * this->height * texChannels;
+
+        _createTextureFromPixels(commandPool, pixels, imageSize);
+
+        stbi_image_free(pixels);
+    }
+
     //DEFAULT TEXTURE
     Texture::Texture(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool): 
         width{2}, height{2}, format{VK_FORMAT_R8G8B8A8_SRGB}, vk{vk}, cubemap{false}
@@ -314,7 +338,44 @@ namespace fly {
     }
 
 
+    //3D TEXTURE
+    Texture::Texture(std::shared_ptr<VulkanInstance> vk, uint32_t width, uint32_t height, uint32_t depth, VkFormat format, VkImageUsageFlags usage):
+        mipLevels{1}, width{width}, height{height}, depth{depth}, format{format}, vk{vk}, cubemap{false}
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_3D;
+        imageInfo.extent = {this->width, this->height, this->depth};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = this->format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VmaAllocationCreateInfo allocCreateInfo = {};
+        allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+        if(vmaCreateImage(vk->allocator, &imageInfo, &allocCreateInfo, &this->image, &this->imageAlloc, nullptr) != VK_SUCCESS)
+            throw std::runtime_error("failed to create 3D image!");
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = this->image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_3D;
+        viewInfo.format = this->format;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+        if(vkCreateImageView(vk->device, &viewInfo, nullptr, &this->imageView) != VK_SUCCESS)
+            throw std::runtime_error("failed to create 3D image view!");
+    }
+
     Texture::~Texture() {
+        //A new view could get the same handle, it must not find the slot of this one
+        if(vk->bindlessTable)
+            vk->bindlessTable->releaseImage(this->imageView);
         vkDestroyImageView(vk->device, this->imageView, nullptr);
         vmaDestroyImage(vk->allocator, this->image, this->imageAlloc);
     }
@@ -424,6 +485,8 @@ namespace fly {
     }
 
     TextureSampler::~TextureSampler() {
+        if(vk->bindlessTable)
+            vk->bindlessTable->releaseSampler(this->textureSampler);
         vkDestroySampler(vk->device, this->textureSampler, nullptr);
     }
 
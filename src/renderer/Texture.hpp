@@ -2,6 +2,7 @@
 
 #include <filesystem>
 #include <memory>
+#include <span>
 
 #include "vulkan/VulkanTypes.h"
 
@@ -42,10 +43,14 @@ namespace fly {
         );
         //Texture obtained from the path given in png, jpeg or bmp
         Texture(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, std::filesystem::path path, STB_Format stbFormat, VkFormat format);
+        //Texture from a png or jpeg already in memory, like the images embedded in a glb
+        Texture(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, std::span<const std::byte> encoded, STB_Format stbFormat, VkFormat format);
         //Ktx texture in bc7 with mipmaps included, they aren't generated
         Texture(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool, std::filesystem::path ktxPath);
         //Default 2x2 magenta and black texture ready to be sampled
         Texture(std::shared_ptr<VulkanInstance> vk, VkCommandPool commandPool);
+        //3D texture without mipmaps, for volumes like colour lookup tables
+        Texture(std::shared_ptr<VulkanInstance> vk, uint32_t width, uint32_t height, uint32_t depth, VkFormat format, VkImageUsageFlags usage);
         
 
         ~Texture();
@@ -67,7 +72,7 @@ namespace fly {
         VkImageView imageView;
         VmaAllocation imageAlloc;
 
-        uint32_t width, height;
+        uint32_t width, height, depth = 1;
         VkFormat format;
 
         std::shared_ptr<VulkanInstance> vk;
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "vulkan/VulkanTypes.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace fly {
+
+    //PACKED COMPONENTS, read by the vertex input as normalized floats
+    struct Snorm16x4 { int16_t x, y, z, w; };
+    struct Snorm16x2 { int16_t x, y; };
+    struct Unorm16x2 { uint16_t x, y; };
+
+    inline int16_t packSnorm16(float v) { return static_cast<int16_t>(std::round(std::clamp(v, -1.0f, 1.0f) * 32767.0f)); }
+    inline uint16_t packUnorm16(float v) { return static_cast<uint16_t>(std::round(std::clamp(v, 0.0f, 1.0f) * 65535.0f)); }
+    inline float unpackSnorm16(int16_t v) { return std::max(static_cast<float>(v) / 32767.0f, -1.0f); }
+
+    //Octahedral encoding, the unit sphere is folded into a square so a normal only needs two components
+    inline glm::vec2 octahedralEncode(const glm::vec3& n) {
+        float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if(sum == 0.0f)
+            return glm::vec2(0.0f);
+
+        glm::vec2 p(n.x / sum, n.y / sum);
+        if(n.z < 0.0f) {
+            p = glm::vec2(
+                (1.0f - std::abs(p.y)) * (p.x >= 0.0f? 1.0f : -1.0f),
+                (1.0f - std::abs(p.x)) * (p.y >= 0.0f? 1.0f : -1.0f)
+            );
+        }
+        return p;
+    }
+
+    //How the packed attributes of a mesh go back to model space, the positions are relative to its bounds
+    struct VertexQuantization {
+        glm::vec3 center{0.0f}, extent{1.0f};
+        glm::vec2 texCoordOffset{0.0f}, texCoordScale{1.0f};
+    };
+
+
+    //ATTRIBUTE DESCRIPTIONS, built at compile time from the members of the vertex
+    template<typename T> constexpr VkFormat vertexFormat() = delete;
+    template<> constexpr VkFormat vertexFormat<float>() { return VK_FORMAT_R32_SFLOAT; }
+    template<> constexpr VkFormat vertexFormat<glm::vec2>() { return VK_FORMAT_R32G32_SFLOAT; }
+    template<> constexpr VkFormat vertexFormat<glm::vec3>() { return VK_FORMAT_R32G32B32_SFLOAT; }
+    template<> constexpr VkFormat vertexFormat<glm::vec4>() { return VK_FORMAT_R32G32B32A32_SFLOAT; }
+    template<> constexpr VkFormat vertexFormat<Snorm16x4>() { return VK_FORMAT_R16G16B16A16_SNORM; }
+    template<> constexpr VkFormat vertexFormat<Snorm16x2>() { return VK_FORMAT_R16G16_SNORM; }
+    template<> constexpr VkFormat vertexFormat<Unorm16x2>() { return VK_FORMAT_R16G16_UNORM; }
+
+    struct VertexAttribute {
+        uint32_t offset;
+        VkFormat format;
+    };
+
+    //The location of each attribute is its position in the list
+    #define FLY_VERTEX_ATTRIBUTE(Vertex, member) ::fly::VertexAttribute{ static_cast<uint32_t>(offsetof(Vertex, member)), ::fly::vertexFormat<decltype(Vertex::member)>() }
+
+    template<size_t N>
+    constexpr std::array<VkVertexInputAttributeDescription, N> makeAttributeDescriptions(const VertexAttribute (&attributes)[N]) {
+        std::array<VkVertexInputAttributeDescription, N> result{};
+        for(size_t i=0; i<N; ++i) {
+            result[i].location = static_cast<uint32_t>(i);
+            result[i].binding = 0;
+            result[i].format = attributes[i].format;
+            result[i].offset = attributes[i].offset;
+        }
+        return result;
+    }
+
+    template<typename Vertex_t>
+    constexpr VkVertexInputBindingDescription makeBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(Vertex_t);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescription;
+    }
+
+}
@@ -0,0 +1,160 @@
+#include "WorkgroupTuner.hpp"
+
+#include "vulkan/VulkanHelpers.hpp"
+
+#include <Utils.hpp>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+namespace fly {
+
+    WorkgroupTuner::WorkgroupTuner(const std::string& path, const std::string& deviceKey, bool canTime): 
+        path{path}, deviceKey{deviceKey}, canTime{canTime} 
+    {
+        load();
+    }
+
+    void WorkgroupTuner::beginFrame(uint32_t currentFrame, const std::map<std::string, double>& passTimes) {
+        for(auto& [pass, candidate]: this->handedOut[currentFrame]) {
+            auto time = passTimes.find(pass);
+            if(time == passTimes.end())
+                continue;
+
+            auto& tuning = this->passes[pass];
+            if(tuning.best.has_value())
+                continue;
+
+            tuning.samples[candidate].push_back(time->second);
+            
+            bool done = std::all_of(tuning.samples.begin(), tuning.samples.end(), [](const auto& s) {
+                return s.size() >= SAMPLES_PER_CANDIDATE;
+            });
+            if(done)
+                pickBest(pass, tuning);
+        }
+        this->handedOut[currentFrame].clear();
+    }
+
+    WorkgroupSize WorkgroupTuner::getSize(const std::string& pass, uint32_t currentFrame) {
+        auto& tuning = this->passes[pass];
+        if(tuning.best.has_value())
+            return tuning.best.value();
+        if(!this->canTime)
+            return WorkgroupSize{};
+
+        //A pass that runs more than once in a frame keeps the same size, so all its time goes to one candidate
+        auto [it, inserted] = this->handedOut[currentFrame].try_emplace(pass, 0);
+        if(inserted) {
+            auto next = std::find_if(tuning.samples.begin(), tuning.samples.end(), [](const auto& s) {
+                return s.size() < SAMPLES_PER_CANDIDATE;
+            });
+            it->second = next == tuning.samples.end()? 0 : static_cast<size_t>(std::distance(tuning.samples.begin(), next));
+        }
+
+        return CANDIDATES[it->second];
+    }
+
+    bool WorkgroupTuner::isTuning() const {
+        return this->canTime && std::any_of(this->passes.begin(), this->passes.end(), [](const auto& p) {
+            return !p.second.best.has_value();
+        });
+    }
+
+    void WorkgroupTuner::pickBest(const std::string& pass, PassTuning& tuning) {
+        //The median ignores the frames that got a hitch
+        size_t best = 0;
+        double bestTime = std::numeric_limits<double>::max();
+        for(size_t i=0; i<CANDIDATES.size(); ++i) {
+            auto& samples = tuning.samples[i];
+            std::nth_element(samples.begin(), samples.begin() + samples.size()/2, samples.end());
+            double median = samples[samples.size()/2];
+            if(median < bestTime) {
+                bestTime = median;
+                best = i;
+            }
+        }
+
+        tuning.best = CANDIDATES[best];
+        FLY_DEBUG_LOG("Workgroup size for {}: {}x{} ({:.3f}ms)\n", pass, CANDIDATES[best].x, CANDIDATES[best].y, bestTime);
+        save();
+    }
+
+    void WorkgroupTuner::load() {
+        std::ifstream file(this->path);
+        if(!file.is_open())
+            return;
+
+        auto data = nlohmann::json::parse(file, nullptr, false);
+        if(data.is_discarded() || !data.contains(this->deviceKey))
+            return;
+
+        for(auto& [pass, size]: data[this->deviceKey].items()) {
+            WorkgroupSize s{size[0].get<uint32_t>(), size[1].get<uint32_t>()};
+            this->passes[pass].best = s;
+        }
+    }
+
+    void WorkgroupTuner::save() const {
+        //Keep the sizes of the other devices that have run from this folder
+        nlohmann::json data = nlohmann::json::object();
+        {
+            std::ifstream file(this->path);
+            if(file.is_open()) {
+                data = nlohmann::json::parse(file, nullptr, false);
+                if(data.is_discarded() || !data.is_object())
+                    data = nlohmann::json::object();
+            }
+        }
+
+        auto& deviceData = data[this->deviceKey];
+        for(auto& [pass, tuning]: this->passes) {
+            if(tuning.best.has_value())
+                deviceData[pass] = {tuning.best->x, tuning.best->y};
+        }
+
+        std::ofstream file(this->path);
+        if(!file.is_open()) {
+            std::cerr << std::format("Couldn't save the workgroup sizes to {}\n", this->path);
+            return;
+        }
+        file << data.dump(4);
+    }
+
+
+
+    //TUNED COMPUTE PIPELINE IMPLEMENTATION
+    TunedComputePipeline::TunedComputePipeline(
+        std::shared_ptr<VulkanInstance> vk, 
+        const std::string& passName, 
+        VkPipelineLayout pipelineLayout, 
+        std::vector<char> shaderCode, 
+        SpecializationConstants constants
+    ): vk{vk}, passName{passName}, pipelineLayout{pipelineLayout}, shaderCode{std::move(shaderCode)}, constants{std::move(constants)} {}
+
+    TunedComputePipeline::~TunedComputePipeline() {
+        for(auto& [key, pipeline]: this->pipelines)
+            vkDestroyPipeline(vk->device, pipeline, nullptr);
+    }
+
+    WorkgroupSize TunedComputePipeline::bind(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+        WorkgroupSize size = vk->workgroupTuner? vk->workgroupTuner->getSize(this->passName, currentFrame) : WorkgroupSize{};
+        uint64_t key = (static_cast<uint64_t>(size.x) << 32) | size.y;
+
+        auto it = this->pipelines.find(key);
+        if(it == this->pipelines.end()) {
+            SpecializationConstants sizedConstants = this->constants;
+            sizedConstants.add(WorkgroupTuner::SIZE_X_CONSTANT_ID, size.x);
+            sizedConstants.add(WorkgroupTuner::SIZE_Y_CONSTANT_ID, size.y);
+
+            auto pipeline = createSpecializedComputePipeline(vk, this->pipelineLayout, this->shaderCode, sizedConstants.getInfo());
+            it = this->pipelines.emplace(key, pipeline).first;
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, it->second);
+        return size;
+    }
+
+}
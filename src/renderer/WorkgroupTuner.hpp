@@ -0,0 +1,89 @@
+#pragma once
+
+#include "vulkan/VulkanTypes.h"
+#include "vulkan/VulkanConstants.h"
+
+#include <array>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace fly {
+
+    struct WorkgroupSize {
+        uint32_t x = 16, y = 16;
+
+        //Workgroups needed to cover the extent
+        VkExtent2D groupCount(VkExtent2D extent) const { 
+            return {(extent.width + this->x - 1) / this->x, (extent.height + this->y - 1) / this->y}; 
+        }
+    };
+
+    /*
+    Picks the workgroup size of every tuned compute pass. The first time the engine runs on a device, each pass
+    gets every candidate for some frames while its GPU time is measured, and the fastest one is saved for the next runs
+    */
+    class WorkgroupTuner {
+    public:
+        static constexpr uint32_t SIZE_X_CONSTANT_ID = 100, SIZE_Y_CONSTANT_ID = 101; //Must match local_size_x_id and local_size_y_id in the shaders
+        static constexpr std::array<WorkgroupSize, 4> CANDIDATES = {{ {8, 8}, {16, 8}, {16, 16}, {32, 8} }};
+        static constexpr uint32_t SAMPLES_PER_CANDIDATE = 32;
+
+        //If the passes can't be timed the default size is used and nothing is tuned
+        WorkgroupTuner(const std::string& path, const std::string& deviceKey, bool canTime);
+
+        //The pass times must be the ones of the last frame recorded on this slot
+        void beginFrame(uint32_t currentFrame, const std::map<std::string, double>& passTimes);
+        WorkgroupSize getSize(const std::string& pass, uint32_t currentFrame);
+        
+        bool isTuning() const;
+        void save() const;
+
+    private:
+        struct PassTuning {
+            std::array<std::vector<double>, CANDIDATES.size()> samples;
+            std::optional<WorkgroupSize> best;
+        };
+
+        std::string path, deviceKey;
+        bool canTime;
+        std::map<std::string, PassTuning> passes;
+        //Candidate given to each pass on the frames in flight
+        std::array<std::map<std::string, size_t>, MAX_FRAMES_IN_FLIGHT> handedOut;
+
+        void load();
+        void pickBest(const std::string& pass, PassTuning& tuning);
+    };
+
+
+
+    //The pipelines of a tuned compute shader, one for every workgroup size the tuner asks for
+    class TunedComputePipeline {
+    public:
+        TunedComputePipeline(
+            std::shared_ptr<VulkanInstance> vk, 
+            const std::string& passName, 
+            VkPipelineLayout pipelineLayout, 
+            std::vector<char> shaderCode, 
+            SpecializationConstants constants = {}
+        );
+        ~TunedComputePipeline();
+
+        TunedComputePipeline(const TunedComputePipeline&) = delete;
+        TunedComputePipeline& operator=(const TunedComputePipeline&) = delete;
+
+        //Binds the pipeline with the size the tuner picked for this frame and returns that size
+        WorkgroupSize bind(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+
+    private:
+        std::shared_ptr<VulkanInstance> vk;
+        std::string passName;
+        VkPipelineLayout pipelineLayout;
+        std::vector<char> shaderCode;
+        SpecializationConstants constants;
+
+        std::map<uint64_t, VkPipeline> pipelines;
+    };
+
+}
@@ -9,6 +9,7 @@ namespace fly {
     struct DescriptorSetBindingInfo {
         VkDescriptorType type;
         VkShaderStageFlags stage;
+        uint32_t count = 1; //Size of the descriptor array in this binding
     };
     
     template<size_t N>
@@ -37,11 +38,11 @@ namespace fly {
     constexpr DescriptorSetBuildInfo<N> newDescriptorSetBuild(uint32_t descriptorCount, const DescriptorSetBindingInfo (&bindings)[N]) {
         DescriptorSetBuildInfo<N> result;
         for(size_t i=0; i<N; ++i) {
-            result.poolSizes[i] = VkDescriptorPoolSize{bindings[i].type, descriptorCount};
+            result.poolSizes[i] = VkDescriptorPoolSize{bindings[i].type, descriptorCount * bindings[i].count};
         
             VkDescriptorSetLayoutBinding b{};
             b.binding = static_cast<uint32_t>(i);
-            b.descriptorCount = 1;
+            b.descriptorCount = bindings[i].count;
             b.descriptorType = bindings[i].type;
             b.pImmutableSamplers = nullptr;
             b.stageFlags = bindings[i].stage;
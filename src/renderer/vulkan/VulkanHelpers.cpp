@@ -171,6 +171,20 @@ namespace fly {
         return requiredExtensions.empty();
     }
 
+    bool hasDeviceExtension(VkPhysicalDevice device, const char* extensionName) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto& extension : availableExtensions) {
+            if(strcmp(extension.extensionName, extensionName) == 0)
+                return true;
+        }
+        return false;
+    }
+
 
     SwapChainSupportDetails querySwapChainSupport(const VkSurfaceKHR surface, VkPhysicalDevice device) {
         SwapChainSupportDetails details;
@@ -211,7 +225,8 @@ namespace fly {
         VkPhysicalDeviceFeatures supportedFeatures;
         vkGetPhysicalDeviceFeatures(device, &supportedFeatures);        
 
-        return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy && supportedFeatures.independentBlend;
+        return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy && supportedFeatures.independentBlend
+            && supportedFeatures.shaderStorageImageArrayDynamicIndexing;
     }
 
 
@@ -424,6 +439,28 @@ namespace fly {
         );
     }
 
+    void memoryBarrier(
+        VkCommandBuffer commandBuffer,
+        VkPipelineStageFlags srcStageMask,
+        VkPipelineStageFlags dstStageMask,
+        VkAccessFlags srcAccessMask,
+        VkAccessFlags dstAccessMask
+    ) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccessMask;
+        barrier.dstAccessMask = dstAccessMask;
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            srcStageMask, dstStageMask,
+            0,
+            1, &barrier,
+            0, nullptr,
+            0, nullptr
+        );
+    }
+
 
     void copyBufferToImage(
         VkCommandBuffer commandBuffer,
@@ -504,10 +541,16 @@ namespace fly {
         VkFormat format, 
         VkImageAspectFlags aspectFlags, 
         uint32_t mipLevels,
-        bool cubemap
+        bool cubemap,
+        VkImageUsageFlags usage
     ) {
+        VkImageViewUsageCreateInfo usageInfo{};
+        usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+        usageInfo.usage = usage;
+
         VkImageViewCreateInfo viewInfo{};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.pNext = usage != 0? &usageInfo : nullptr;
         viewInfo.image = image;
         viewInfo.format = format;
         viewInfo.subresourceRange.aspectMask = aspectFlags;
@@ -581,16 +624,20 @@ namespace fly {
         std::shared_ptr<VulkanInstance> vk, 
         VkDescriptorSetLayout descriptorSetLayout, 
         const std::vector<char>& shaderCode, 
-        size_t pushConstantSize
+        size_t pushConstantSize,
+        const VkSpecializationInfo* specializationInfo
     ) {
-        VkShaderModule computeShaderModule = createShaderModule(vk->device, shaderCode);
+        VkPipelineLayout pipelineLayout = createComputePipelineLayout(vk, descriptorSetLayout, pushConstantSize);
+        VkPipeline pipeline = createSpecializedComputePipeline(vk, pipelineLayout, shaderCode, specializationInfo);
 
-        VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
-        computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-        computeShaderStageInfo.module = computeShaderModule;
-        computeShaderStageInfo.pName = "main";
+        return std::make_pair(pipeline, pipelineLayout);
+    }
 
+    VkPipelineLayout createComputePipelineLayout(
+        std::shared_ptr<VulkanInstance> vk, 
+        VkDescriptorSetLayout descriptorSetLayout, 
+        size_t pushConstantSize
+    ) {
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipelineLayoutInfo.setLayoutCount = 1;
@@ -611,19 +658,37 @@ namespace fly {
             throw std::runtime_error("failed to create compute pipeline layout!");
         }
 
+        return pipelineLayout;
+    }
+
+    VkPipeline createSpecializedComputePipeline(
+        std::shared_ptr<VulkanInstance> vk, 
+        VkPipelineLayout pipelineLayout, 
+        const std::vector<char>& shaderCode, 
+        const VkSpecializationInfo* specializationInfo
+    ) {
+        VkShaderModule computeShaderModule = createShaderModule(vk->device, shaderCode);
+
+        VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
+        computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        computeShaderStageInfo.module = computeShaderModule;
+        computeShaderStageInfo.pName = "main";
+        computeShaderStageInfo.pSpecializationInfo = specializationInfo;
+
         VkComputePipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
         pipelineInfo.layout = pipelineLayout;
         pipelineInfo.stage = computeShaderStageInfo;
 
         VkPipeline pipeline;
-        if(vkCreateComputePipelines(vk->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        if(vkCreateComputePipelines(vk->device, vk->pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
             throw std::runtime_error("failed to create compute pipeline!");
         }
 
         vkDestroyShaderModule(vk->device, computeShaderModule, nullptr);
 
-        return std::make_pair(pipeline, pipelineLayout);
+        return pipeline;
     }
 
     
@@ -652,7 +717,7 @@ namespace fly {
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         poolInfo.poolSizeCount = static_cast<uint32_t>(layout.poolSizes.size());
         poolInfo.pPoolSizes = layout.poolSizes.data();
-        poolInfo.maxSets = layout.poolSizes[0].descriptorCount;
+        poolInfo.maxSets = layout.descriptorCount;
 
         VkDescriptorPool descriptorPool;
         if(vkCreateDescriptorPool(vk->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
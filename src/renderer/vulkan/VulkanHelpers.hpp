@@ -43,6 +43,8 @@ namespace fly {
     QueueFamilyIndices findQueueFamilies(const VkSurfaceKHR surface, VkPhysicalDevice physicalDevice);
 
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    //For the optional extensions, the required ones are checked when picking the device
+    bool hasDeviceExtension(VkPhysicalDevice device, const char* extensionName);
     
     SwapChainSupportDetails querySwapChainSupport(const VkSurfaceKHR surface, VkPhysicalDevice device);
     
@@ -84,6 +86,15 @@ namespace fly {
         bool cubemap
     );
 
+    //Global barrier, for resources that don't need a layout change
+    void memoryBarrier(
+        VkCommandBuffer commandBuffer,
+        VkPipelineStageFlags srcStageMask,
+        VkPipelineStageFlags dstStageMask,
+        VkAccessFlags srcAccessMask,
+        VkAccessFlags dstAccessMask
+    );
+
     void copyBufferToImage(
         VkCommandBuffer commandBuffer,
         VkBuffer buffer, 
@@ -108,7 +119,8 @@ namespace fly {
         VkFormat format, 
         VkImageAspectFlags aspectFlags, 
         uint32_t mipLevels,
-        bool cubemap
+        bool cubemap,
+        VkImageUsageFlags usage = 0 //If not 0, restricts the usage of the view, needed when the image has usages its view format doesn't support
     );
 
     void createImage(
@@ -130,9 +142,23 @@ namespace fly {
         std::shared_ptr<VulkanInstance> vk, 
         VkDescriptorSetLayout descriptorSetLayout, 
         const std::vector<char>& shaderCode, 
+        size_t pushConstantSize,
+        const VkSpecializationInfo* specializationInfo = nullptr
+    );
+
+    VkPipelineLayout createComputePipelineLayout(
+        std::shared_ptr<VulkanInstance> vk, 
+        VkDescriptorSetLayout descriptorSetLayout, 
         size_t pushConstantSize
     );
 
+    VkPipeline createSpecializedComputePipeline(
+        std::shared_ptr<VulkanInstance> vk, 
+        VkPipelineLayout pipelineLayout, 
+        const std::vector<char>& shaderCode, 
+        const VkSpecializationInfo* specializationInfo
+    );
+
     std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> allocateDescriptorSets(
         std::shared_ptr<VulkanInstance> vk, 
         VkDescriptorSetLayout descriptorSetLayout,
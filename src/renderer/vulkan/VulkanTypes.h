@@ -5,9 +5,16 @@
 #include <vector>
 #include <optional>
 #include <mutex>
+#include <memory>
 
 namespace fly {
 
+    class WorkgroupTuner;
+    class GeometryArena;
+    class OcclusionCuller;
+    class MeshletCuller;
+    class BindlessTable;
+
     struct VulkanInstance {
         VkInstance instance;
         VkSurfaceKHR surface;
@@ -22,9 +29,23 @@ namespace fly {
 
         VkSwapchainKHR swapChain;
         VkFormat swapChainImageFormat;
+        VkFormat swapChainStorageFormat = VK_FORMAT_UNDEFINED; //Format of the storage views, undefined if there are none
         VkExtent2D swapChainExtent;
+        VkExtent2D renderExtent; //Part of the attachments the 3D rendering uses, it is smaller than the swapchain with dynamic resolution
         std::vector<VkImage> swapChainImages;
         std::vector<VkImageView> swapChainImageViews;
+        std::vector<VkImageView> swapChainStorageViews; //UNORM views the tonemapper writes straight into, empty if the swapchain can't be a storage image
+        bool swapChainMutableFormat = false; //VK_KHR_swapchain_mutable_format is enabled
+
+        VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+        std::shared_ptr<WorkgroupTuner> workgroupTuner;
+        std::shared_ptr<GeometryArena> geometryArena;
+        bool indirectDrawSupported = false; //multiDrawIndirect, drawIndirectFirstInstance and shaderDrawParameters are enabled
+        bool drawIndirectCountSupported = false;
+        bool bindlessSupported = false; //runtimeDescriptorArray, partially bound and update after bind sampled images and non uniform indexing
+        std::shared_ptr<OcclusionCuller> occlusionCuller; //Null without indirect draws or drawIndirectCount
+        std::shared_ptr<MeshletCuller> meshletCuller; //Null without indirect draws
+        std::shared_ptr<BindlessTable> bindlessTable; //Null without descriptor indexing
     };
 
     struct QueueFamilyIndices {
@@ -42,9 +63,30 @@ namespace fly {
     };
 
     struct DescriptorSetLayout {
-        VkDescriptorSetLayout layout;
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
         std::vector<VkDescriptorPoolSize> poolSizes;
         uint32_t descriptorCount;
     };
 
+    //32 bit specialization constants, the info returned points into this struct
+    struct SpecializationConstants {
+        std::vector<uint32_t> data;
+        std::vector<VkSpecializationMapEntry> entries;
+        VkSpecializationInfo info{};
+
+        SpecializationConstants& add(uint32_t constantId, uint32_t value) {
+            this->entries.push_back({constantId, static_cast<uint32_t>(this->data.size() * sizeof(uint32_t)), sizeof(uint32_t)});
+            this->data.push_back(value);
+            return *this;
+        }
+
+        const VkSpecializationInfo* getInfo() {
+            this->info.mapEntryCount = static_cast<uint32_t>(this->entries.size());
+            this->info.pMapEntries = this->entries.data();
+            this->info.dataSize = this->data.size() * sizeof(uint32_t);
+            this->info.pData = this->data.data();
+            return &this->info;
+        }
+    };
+
 }
@@ -142,25 +142,6 @@ namespace fly {
 
 
     //VERTEX IMPLEMENTATION
-    VkVertexInputBindingDescription Vertex2D::getBindingDescription() {
-        VkVertexInputBindingDescription bindingDescription{};
-        bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(Vertex2D);
-        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-        return bindingDescription;
-    }
-    
-    std::vector<VkVertexInputAttributeDescription> Vertex2D::getAttributeDescriptions() {
-        std::vector<VkVertexInputAttributeDescription> attributeDescriptions(1);
-        attributeDescriptions[0].binding = 0;
-        attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(Vertex2D, pos);
-
-        return attributeDescriptions;
-    }
-
     bool Vertex2D::operator==(const Vertex2D& other) const {
         return pos == other.pos;
     }
@@ -29,9 +29,9 @@ namespace fly {
     struct Vertex2D {
         glm::vec2 pos;
     
-        static VkVertexInputBindingDescription getBindingDescription();
+        static constexpr VkVertexInputBindingDescription getBindingDescription() { return makeBindingDescription<Vertex2D>(); }
     
-        static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+        static constexpr auto getAttributeDescriptions() { return makeAttributeDescriptions({ FLY_VERTEX_ATTRIBUTE(Vertex2D, pos) }); }
     
         bool operator==(const Vertex2D& other) const;
     };
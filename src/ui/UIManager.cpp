@@ -136,6 +136,10 @@ namespace fly {
         renderPassInfo.clearValueCount = clearColors.size();
         renderPassInfo.pClearValues = clearColors.data();
         
+        //The copies can't be recorded inside the render pass
+        this->renderer2d.getPipeline()->recordTransfers(commandBuffer, currentFrame);
+        this->textRenderer.getPipeline()->recordTransfers(commandBuffer, currentFrame);
+
         vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
         VkViewport viewport{};